@@ -0,0 +1,116 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include <vector>
+#include <algorithm>
+
+#include "Core/Aes.h"
+#include "Core/AppleCP.h"
+
+namespace Benchmark {
+namespace Impl {
+
+// FIPS-197 Appendix C.1
+//
+constexpr Core::Aes::Key kKnownKey{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+constexpr Core::Aes::Block kKnownPlaintext{
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+constexpr Core::Aes::Block kKnownCiphertext{
+    0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30,
+    0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A};
+
+// The known answer, in every lane of the hardware path and in its tail, and both paths must agree
+// on the payloads of the stream
+//
+inline bool CheckDecryptors(benchmark::State &state, std::span<const Core::Aes::Block> payloads)
+{
+    const Core::Aes::Decryptor hardware{kKnownKey}, portable{kKnownKey, false};
+
+    for (const auto &decryptor : {&hardware, &portable}) {
+        std::vector<Core::Aes::Block> blocks(7, kKnownCiphertext);
+        decryptor->Decrypt(blocks);
+        if (std::ranges::count(blocks, kKnownPlaintext) != std::ssize(blocks)) {
+            state.SkipWithError("The known answer test failed");
+            return false;
+        }
+    }
+
+    std::vector<Core::Aes::Block> expected{payloads.begin(), payloads.end()}, actual = expected;
+    portable.Decrypt(expected);
+    hardware.Decrypt(actual);
+    if (expected != actual) {
+        state.SkipWithError("The decryptors disagree");
+        return false;
+    }
+    return true;
+}
+
+template <bool kAllowHardware>
+void DecryptBenchmark(benchmark::State &state, const Stream &stream)
+{
+    std::vector<Core::Aes::Block> payloads;
+    payloads.reserve(stream.packets.size());
+    for (const auto &data : stream.packets) {
+        const auto protocol = Core::AppleCP::As<Core::AppleCP::AirPods>(
+            data.GetManufacturerData(Core::AppleCP::VendorId).value());
+
+        auto &payload = payloads.emplace_back();
+        std::ranges::copy(protocol->GetEncryptedPayload(), payload.begin());
+    }
+
+    if (!CheckDecryptors(state, payloads)) {
+        return;
+    }
+
+    const Core::Aes::Decryptor decryptor{kKnownKey, kAllowHardware};
+    if (kAllowHardware && !decryptor.IsHardwareAccelerated()) {
+        state.SkipWithError("AES-NI is not supported");
+        return;
+    }
+
+    std::vector<Core::Aes::Block> blocks = payloads;
+    int64_t packetCount = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        decryptor.Decrypt(blocks);
+        benchmark::DoNotOptimize(blocks.data());
+        benchmark::ClobberMemory();
+        packetCount += static_cast<int64_t>(blocks.size());
+    }
+    ReportPerPacket(state, allocations, packetCount);
+}
+} // namespace Impl
+
+void Aes_Decrypt(benchmark::State &state, const Stream &stream)
+{
+    Impl::DecryptBenchmark<true>(state, stream);
+}
+APD_STREAM_BENCHMARK(Aes_Decrypt);
+
+void Aes_DecryptPortable(benchmark::State &state, const Stream &stream)
+{
+    Impl::DecryptBenchmark<false>(state, stream);
+}
+APD_STREAM_BENCHMARK(Aes_DecryptPortable);
+} // namespace Benchmark
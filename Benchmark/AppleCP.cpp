@@ -0,0 +1,321 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include <random>
+#include <cstring>
+#include <algorithm>
+
+#include "Core/AppleCP.h"
+
+namespace Benchmark {
+namespace Impl {
+
+std::vector<std::span<const uint8_t>> GetPayloads(const Stream &stream)
+{
+    std::vector<std::span<const uint8_t>> result;
+    result.reserve(stream.packets.size());
+
+    for (const auto &data : stream.packets) {
+        result.push_back(data.GetManufacturerData(Core::AppleCP::VendorId).value());
+    }
+    return result;
+}
+
+std::vector<Core::AppleCP::AirPods> GetPackets(std::span<const std::span<const uint8_t>> payloads)
+{
+    std::vector<Core::AppleCP::AirPods> result;
+    result.reserve(payloads.size());
+
+    for (const auto &payload : payloads) {
+        result.push_back(Core::AppleCP::As<Core::AppleCP::AirPods>(payload).value());
+    }
+    return result;
+}
+
+// The state fields the advertisement is built from, to compare the decoders
+//
+struct DecodedAirPods {
+    Core::AirPods::Model model;
+    Core::AirPods::Side side;
+    Core::AirPods::Battery leftBattery, rightBattery, caseBattery;
+    bool leftCharging, rightCharging, caseCharging;
+    bool leftInEar, rightInEar;
+    bool bothInCase, lidOpened;
+
+    bool operator==(const DecodedAirPods &rhs) const = default;
+};
+
+template <class T>
+inline DecodedAirPods Decode(const T &protocol)
+{
+    return DecodedAirPods{
+        .model = protocol.GetModel(),
+        .side = protocol.GetBroadcastedSide(),
+        .leftBattery = protocol.GetLeftBattery(),
+        .rightBattery = protocol.GetRightBattery(),
+        .caseBattery = protocol.GetCaseBattery(),
+        .leftCharging = protocol.IsLeftCharging(),
+        .rightCharging = protocol.IsRightCharging(),
+        .caseCharging = protocol.IsCaseCharging(),
+        .leftInEar = protocol.IsLeftInEar(),
+        .rightInEar = protocol.IsRightInEar(),
+        .bothInCase = protocol.IsBothPodsInCase(),
+        .lidOpened = protocol.IsLidOpened(),
+    };
+}
+
+// The previous decoder, which copied the payload into a packed struct with bit-fields. Its
+// layout is only guaranteed by MSVC, it is kept as the baseline of `AppleCP_Decode`.
+//
+#pragma pack(push)
+#pragma pack(1)
+class LegacyAirPods
+{
+public:
+    static std::optional<LegacyAirPods> Parse(std::span<const uint8_t> data)
+    {
+        if (!Core::AppleCP::AirPods::IsValid(data)) {
+            return std::nullopt;
+        }
+
+        LegacyAirPods result;
+        std::memcpy(&result, data.data(), sizeof(LegacyAirPods));
+        return result;
+    }
+
+    Core::AirPods::Side GetBroadcastedSide() const
+    {
+        return broadcastFrom == 1 ? Core::AirPods::Side::Left : Core::AirPods::Side::Right;
+    }
+    bool IsLeftBroadcasted() const
+    {
+        return broadcastFrom == 1;
+    }
+    bool IsRightBroadcasted() const
+    {
+        return broadcastFrom != 1;
+    }
+    Core::AirPods::Model GetModel() const
+    {
+        return Core::AppleCP::AirPods::GetModel(modelId);
+    }
+    Core::AirPods::Battery GetLeftBattery() const
+    {
+        return ToBattery(IsLeftBroadcasted() ? battery.curr : battery.anot);
+    }
+    Core::AirPods::Battery GetRightBattery() const
+    {
+        return ToBattery(IsRightBroadcasted() ? battery.curr : battery.anot);
+    }
+    Core::AirPods::Battery GetCaseBattery() const
+    {
+        return ToBattery(battery.caseBox);
+    }
+    bool IsLeftCharging() const
+    {
+        return (IsLeftBroadcasted() ? battery.currCharging : battery.anotCharging) != 0;
+    }
+    bool IsRightCharging() const
+    {
+        return (IsRightBroadcasted() ? battery.currCharging : battery.anotCharging) != 0;
+    }
+    bool IsCaseCharging() const
+    {
+        return battery.caseCharging;
+    }
+    bool IsBothPodsInCase() const
+    {
+        return bothInCase;
+    }
+    bool IsLidOpened() const
+    {
+        return lid.closed == 0;
+    }
+    bool IsLeftInEar() const
+    {
+        return !IsLeftCharging() && (IsLeftBroadcasted() ? currInEar : anotInEar);
+    }
+    bool IsRightInEar() const
+    {
+        return !IsRightCharging() && (IsRightBroadcasted() ? currInEar : anotInEar);
+    }
+
+private:
+    Core::AppleCP::Header header;
+    uint8_t unk1[1];
+    uint16_t modelId;
+    struct {
+        uint8_t unk4 : 1;
+        uint8_t currInEar : 1;
+        uint8_t bothInCase : 1;
+        uint8_t anotInEar : 1;
+        uint8_t unk6 : 1;
+        uint8_t broadcastFrom : 1;
+        uint8_t unk7 : 1;
+        uint8_t unk8 : 1;
+    };
+    struct {
+        uint8_t curr : 4;
+        uint8_t anot : 4;
+        uint8_t caseBox : 4;
+        uint8_t currCharging : 1;
+        uint8_t anotCharging : 1;
+        uint8_t caseCharging : 1;
+        uint8_t unk9 : 1;
+    } battery;
+    struct {
+        uint8_t switchCount : 3;
+        uint8_t closed : 1;
+        uint8_t unk10 : 4;
+    } lid;
+    Core::AppleCP::Color color;
+    uint8_t unk11[1];
+    uint8_t unk12[16];
+
+    static Core::AirPods::Battery ToBattery(uint8_t value)
+    {
+        return value <= 10 ? value : Core::AirPods::Battery{};
+    }
+};
+static_assert(sizeof(LegacyAirPods) == Core::AppleCP::AirPods::kSize);
+#pragma pack(pop)
+
+// Both decoders must agree on every packet, otherwise the comparison is meaningless
+//
+inline bool
+CheckDecoders(benchmark::State &state, std::span<const std::span<const uint8_t>> payloads)
+{
+    for (const auto &payload : payloads) {
+        const auto current = Core::AppleCP::As<Core::AppleCP::AirPods>(payload);
+        const auto legacy = LegacyAirPods::Parse(payload);
+        if (current.has_value() != legacy.has_value() ||
+            (current.has_value() && Decode(current.value()) != Decode(legacy.value())))
+        {
+            state.SkipWithError("The decoders disagree");
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace Impl
+
+void AppleCP_AirPods_IsValid(benchmark::State &state, const Stream &stream)
+{
+    const auto payloads = Impl::GetPayloads(stream);
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Core::AppleCP::AirPods::IsValid(payloads[index]));
+        index = index + 1 == payloads.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(AppleCP_AirPods_IsValid);
+
+void AppleCP_Decode(benchmark::State &state, const Stream &stream)
+{
+    const auto payloads = Impl::GetPayloads(stream);
+    if (!Impl::CheckDecoders(state, payloads)) {
+        return;
+    }
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        const auto protocol = Core::AppleCP::As<Core::AppleCP::AirPods>(payloads[index]);
+        benchmark::DoNotOptimize(Impl::Decode(protocol.value()));
+        index = index + 1 == payloads.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(AppleCP_Decode);
+
+void AppleCP_DecodeLegacy(benchmark::State &state, const Stream &stream)
+{
+    const auto payloads = Impl::GetPayloads(stream);
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        const auto protocol = Impl::LegacyAirPods::Parse(payloads[index]);
+        benchmark::DoNotOptimize(Impl::Decode(protocol.value()));
+        index = index + 1 == payloads.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(AppleCP_DecodeLegacy);
+
+// Each iteration decodes the whole stream, compare with `Advertisement_Construct` for the cost of
+// decoding packet by packet
+//
+template <auto kDecodeBatch>
+void DecodeBatchBenchmark(benchmark::State &state, const Stream &stream)
+{
+    const auto payloads = Impl::GetPayloads(stream);
+    const auto packets = Impl::GetPackets(payloads);
+
+    // Also compare on random bit-fields, the stream may not cover all of them
+    //
+    std::mt19937 random{0};
+    std::vector<std::array<uint8_t, Core::AppleCP::AirPods::kSize>> randomPayloads(1000);
+    std::vector<Core::AppleCP::AirPods> randomPackets;
+    for (auto &payload : randomPayloads) {
+        std::ranges::generate(payload, [&] { return static_cast<uint8_t>(random()); });
+        payload[0] = Helper::ToUnderlying(Core::AppleCP::PacketType::ProximityPairing);
+        payload[1] = Core::AppleCP::AirPods::kSize - sizeof(Core::AppleCP::Header);
+        randomPackets.emplace_back(Core::AppleCP::AirPods::Data{payload});
+    }
+
+    Core::AppleCP::AirPodsColumns columns, expected;
+    using Packets = std::span<const Core::AppleCP::AirPods>;
+    for (const auto checked : {Packets{packets}, Packets{randomPackets}}) {
+        kDecodeBatch(checked, columns);
+        Core::AppleCP::Details::DecodeBatchScalar(checked, expected);
+        if (columns != expected) {
+            state.SkipWithError("The batch decoder disagrees with the scalar one");
+            return;
+        }
+    }
+
+    int64_t packetCount = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        kDecodeBatch(packets, columns);
+        benchmark::DoNotOptimize(columns.leftBattery.data());
+        benchmark::ClobberMemory();
+        packetCount += static_cast<int64_t>(packets.size());
+    }
+    ReportPerPacket(state, allocations, packetCount);
+}
+
+void AppleCP_DecodeBatch(benchmark::State &state, const Stream &stream)
+{
+    DecodeBatchBenchmark<&Core::AppleCP::DecodeBatch>(state, stream);
+}
+APD_STREAM_BENCHMARK(AppleCP_DecodeBatch);
+
+void AppleCP_DecodeBatchScalar(benchmark::State &state, const Stream &stream)
+{
+    DecodeBatchBenchmark<&Core::AppleCP::Details::DecodeBatchScalar>(state, stream);
+}
+APD_STREAM_BENCHMARK(AppleCP_DecodeBatchScalar);
+} // namespace Benchmark
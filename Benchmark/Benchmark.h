@@ -0,0 +1,109 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <filesystem>
+
+#include <benchmark/benchmark.h>
+
+#include "Core/Bluetooth_abstract.h"
+
+namespace Core::AirPods::Details {
+class Advertisement;
+} // namespace Core::AirPods::Details
+
+namespace Benchmark {
+
+// A sequence of advertisements fed to the benchmarks, either generated or loaded from a capture
+// file recorded with `--capture`.
+//
+// The labels tell which packets are from the device we desire, one per packet, they are empty if
+// it is unknown. A capture is labelled by a text file next to it with the `.labels` extension
+// appended, listing the addresses of our device in hex, one per line.
+//
+// `packets` only holds AirPods advertisements. The others are in `rejected`, which is empty if
+// the stream has none.
+//
+struct Stream {
+    std::string name;
+    std::vector<Core::Bluetooth::AdvertisementReceivedData> packets;
+    std::vector<bool> labels;
+    std::vector<Core::Bluetooth::AdvertisementReceivedData> rejected;
+};
+
+Stream GenerateSyntheticStream(size_t count);
+Stream GenerateCrowdedStream(size_t count, size_t neighborCount);
+Stream GenerateRepeatedStream(size_t count, size_t repeat);
+std::optional<Stream> LoadRecordedStream(const std::filesystem::path &path);
+
+// Decodes the AirPods packets of `stream`. The second overload refills `advs`, reusing its
+// storage, so it does not allocate once it has been filled with the same stream.
+//
+std::vector<Core::AirPods::Details::Advertisement> MakeAdvertisements(const Stream &stream);
+void MakeAdvertisements(
+    const Stream &stream, std::vector<Core::AirPods::Details::Advertisement> &advs);
+
+// Every benchmark registered by `APD_STREAM_BENCHMARK` is instantiated once for each stream, and
+// is expected to process one packet per iteration unless it reports otherwise.
+//
+using FnStreamBenchmark = void (*)(benchmark::State &state, const Stream &stream);
+
+bool RegisterStreamBenchmark(const char *name, FnStreamBenchmark function);
+
+#define APD_STREAM_BENCHMARK(function)                                                             \
+    [[maybe_unused]] static const bool kRegistered_##function =                                    \
+        ::Benchmark::RegisterStreamBenchmark(#function, function)
+
+// Counts the calls to the global `operator new` of the current process
+//
+uint64_t GetAllocationCount();
+
+class AllocationCounter
+{
+public:
+    inline AllocationCounter() : _begin{GetAllocationCount()} {}
+
+    inline uint64_t Get() const
+    {
+        return GetAllocationCount() - _begin;
+    }
+
+private:
+    uint64_t _begin;
+};
+
+inline void
+ReportPerPacket(benchmark::State &state, const AllocationCounter &allocations, int64_t packets)
+{
+    state.SetItemsProcessed(packets);
+    state.counters["time/packet"] = benchmark::Counter{
+        static_cast<double>(packets), benchmark::Counter::kIsRate | benchmark::Counter::kInvert};
+    state.counters["allocs/packet"] =
+        benchmark::Counter{static_cast<double>(allocations.Get()) / packets};
+}
+
+inline void ReportPerPacket(benchmark::State &state, const AllocationCounter &allocations)
+{
+    ReportPerPacket(state, allocations, state.iterations());
+}
+} // namespace Benchmark
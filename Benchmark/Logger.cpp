@@ -0,0 +1,68 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include "Logger.h"
+#include "Core/StateManager.h"
+
+namespace Benchmark {
+
+// The trace of each packet in `Manager::OnAdvertisementReceived`, with trace disabled as it is by
+// default. The arguments are not evaluated, so it is only the level check.
+//
+void Logger_TraceDisabled(benchmark::State &state, const Stream &stream)
+{
+    const auto advs = MakeAdvertisements(stream);
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        const auto &adv = advs[index];
+        LOG(Trace, "AirPods advertisement received. Data: {}, Address Hash: {}, RSSI: {}",
+            Helper::ToString(std::span<const uint8_t>{adv.GetDesensitizedData()}),
+            Helper::Hash(adv.GetAddress()), adv.GetRssi());
+        benchmark::ClobberMemory();
+        index = index + 1 == advs.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(Logger_TraceDisabled);
+
+// The same trace with the arguments evaluated before the level is checked, as `LOG` used to do
+//
+void Logger_TraceDisabledEager(benchmark::State &state, const Stream &stream)
+{
+    const auto advs = MakeAdvertisements(stream);
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        const auto &adv = advs[index];
+        Logger::Details::Log<Logger::Details::Level::Trace>(
+            spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION},
+            "AirPods advertisement received. Data: {}, Address Hash: {}, RSSI: {}",
+            Helper::ToString(std::span<const uint8_t>{adv.GetDesensitizedData()}),
+            Helper::Hash(adv.GetAddress()), adv.GetRssi());
+        benchmark::ClobberMemory();
+        index = index + 1 == advs.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(Logger_TraceDisabledEager);
+} // namespace Benchmark
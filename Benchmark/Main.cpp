@@ -0,0 +1,135 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+
+#include <spdlog/spdlog.h>
+
+//
+// Allocation tracking
+//
+// Only the non-aligned forms are replaced, the others forward to them by default.
+//
+
+namespace {
+std::atomic<uint64_t> gAllocationCount{0};
+} // namespace
+
+void *operator new(size_t size)
+{
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace Benchmark {
+namespace Impl {
+
+struct RegisteredBenchmark {
+    const char *name;
+    FnStreamBenchmark function;
+};
+
+std::vector<RegisteredBenchmark> &GetRegisteredBenchmarks()
+{
+    static std::vector<RegisteredBenchmark> i;
+    return i;
+}
+} // namespace Impl
+
+constexpr size_t kSyntheticStreamSize = 4096;
+constexpr size_t kCrowdedNeighborCount = 24;
+constexpr size_t kRepeatCount = 8;
+
+uint64_t GetAllocationCount()
+{
+    return gAllocationCount.load(std::memory_order_relaxed);
+}
+
+bool RegisterStreamBenchmark(const char *name, FnStreamBenchmark function)
+{
+    Impl::GetRegisteredBenchmarks().push_back({.name = name, .function = function});
+    return true;
+}
+} // namespace Benchmark
+
+// Usage: ApdBenchmark [benchmark options] [capture files...]
+//
+// Capture files are recorded by `AirPodsDesktop --capture <path>` (binary) or written by hand in
+// the text replay format, each of them is benchmarked as an additional stream.
+//
+int main(int argc, char **argv)
+{
+    using namespace Benchmark;
+
+    // `LOG` only checks the level, its arguments are not evaluated
+    //
+    spdlog::set_level(spdlog::level::off);
+
+    benchmark::Initialize(&argc, argv);
+
+    // Streams must outlive the benchmarks referring to them
+    //
+    std::vector<Stream> streams;
+    streams.push_back(GenerateSyntheticStream(kSyntheticStreamSize));
+    streams.push_back(GenerateCrowdedStream(kSyntheticStreamSize, kCrowdedNeighborCount));
+    streams.push_back(GenerateRepeatedStream(kSyntheticStreamSize, kRepeatCount));
+
+    for (int i = 1; i < argc; ++i) {
+        auto optStream = LoadRecordedStream(argv[i]);
+        if (!optStream.has_value()) {
+            std::cerr << "Failed to load capture file '" << argv[i] << "'." << std::endl;
+            return 1;
+        }
+        streams.push_back(std::move(optStream.value()));
+    }
+
+    for (const auto &stream : streams) {
+        if (stream.packets.empty()) {
+            std::cerr << "Stream '" << stream.name << "' has no AirPods packet." << std::endl;
+            return 1;
+        }
+
+        for (const auto &registered : Impl::GetRegisteredBenchmarks()) {
+            const auto name = std::string{registered.name} + '/' + stream.name;
+            benchmark::RegisterBenchmark(name.c_str(), registered.function, std::cref(stream));
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,78 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include "Core/Metrics.h"
+
+namespace Benchmark {
+
+using namespace Core;
+
+// The metrics recorded for a packet accepted by the state manager, from the watcher to the batch
+// it's part of. The values recorded in the registry are checked against the iterations.
+//
+void Metrics_PerPacket(benchmark::State &state, const Stream &stream)
+{
+    const auto before = Metrics::TakeSnapshot();
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        Metrics::Increment(Metrics::Counter::WatcherReceived);
+        Metrics::Increment(Metrics::Counter::WatcherDispatched);
+        Metrics::SampledTimer timer{Metrics::Histogram::StateBatchTime};
+        Metrics::Increment(Metrics::Counter::StateAccepted);
+    }
+    ReportPerPacket(state, allocations);
+
+    const auto after = Metrics::TakeSnapshot();
+    const auto accepted = after.Get(Metrics::Counter::StateAccepted) -
+                          before.Get(Metrics::Counter::StateAccepted);
+    const auto sampled = after.Get(Metrics::Histogram::StateBatchTime).count -
+                         before.Get(Metrics::Histogram::StateBatchTime).count;
+    const auto iterations = static_cast<uint64_t>(state.iterations());
+    if (accepted != iterations || sampled > iterations / Metrics::kSampleInterval + 1) {
+        state.SkipWithError("The snapshot doesn't match the recorded values");
+    }
+}
+APD_STREAM_BENCHMARK(Metrics_PerPacket);
+
+// The time of a batch, measured with the steady clock every time
+//
+void Metrics_ScopedTimer(benchmark::State &state, const Stream &stream)
+{
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        Metrics::ScopedTimer timer{Metrics::Histogram::StateBatchTime};
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(Metrics_ScopedTimer);
+
+// The same, sampled as on the paths running for every packet
+//
+void Metrics_SampledTimer(benchmark::State &state, const Stream &stream)
+{
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        Metrics::SampledTimer timer{Metrics::Histogram::StateBatchTime};
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(Metrics_SampledTimer);
+} // namespace Benchmark
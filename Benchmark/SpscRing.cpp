@@ -0,0 +1,45 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+namespace Benchmark {
+
+using Core::Bluetooth::AdvertisementReceivedData;
+
+// The cost of handing a packet off from the Bluetooth thread to the consumer thread of
+// `AirPods::Manager`. Both sides run on the benchmark thread so the result does not depend on
+// scheduling, the wake-up latency of the consumer is not included.
+//
+void SpscRing_PushPop(benchmark::State &state, const Stream &stream)
+{
+    auto ring = std::make_unique<Helper::SpscRing<AdvertisementReceivedData, 64>>();
+    AdvertisementReceivedData data;
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        ring->TryPush(stream.packets[index]);
+        ring->TryPop(data);
+        benchmark::DoNotOptimize(data);
+        index = index + 1 == stream.packets.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(SpscRing_PushPop);
+} // namespace Benchmark
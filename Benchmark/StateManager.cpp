@@ -0,0 +1,337 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include "Core/StateManager.h"
+
+namespace Benchmark {
+
+using Core::AirPods::Side;
+using Core::AirPods::Details::Advertisement;
+using Core::AirPods::Details::RssiFilter;
+using Core::AirPods::Details::StateManager;
+
+// The internal steps are called under the lock as `OnAdvReceived` does, since the timers of the
+// state manager are still running in the background
+//
+struct StateManagerAccess {
+    static float ScoreAdv(const StateManager &stateMgr, const Advertisement &adv)
+    {
+        std::lock_guard<std::mutex> lock{stateMgr._mutex};
+        return stateMgr.ScoreAdv(adv, std::nullopt);
+    }
+
+    static auto UpdateState(StateManager &stateMgr, Advertisement adv)
+    {
+        std::lock_guard<std::mutex> lock{stateMgr._mutex};
+        stateMgr.UpdateAdv(std::move(adv), stateMgr._scheduler.Now());
+        return stateMgr.UpdateState();
+    }
+};
+
+namespace Impl {
+
+std::unique_ptr<StateManager>
+MakeStateManager(Helper::Scheduler &scheduler = Helper::Scheduler::GetReal())
+{
+    auto stateMgr = std::make_unique<StateManager>(scheduler);
+    stateMgr->OnRssiMinChanged(std::numeric_limits<int16_t>::min());
+    return stateMgr;
+}
+
+// Advertisements are consumed by the state manager, so the pool is refilled outside the timing
+// once all of them have been used. The storage is reused, so refilling does not allocate.
+//
+class AdvertisementPool
+{
+public:
+    inline AdvertisementPool(const Stream &stream)
+        : _stream{stream}, _advs{MakeAdvertisements(stream)}
+    {
+    }
+
+    inline Advertisement Next(benchmark::State &state)
+    {
+        return std::move(NextBatch(state, 1).front());
+    }
+
+    // The batch is shorter than `maxCount` at the end of the stream
+    //
+    inline std::span<Advertisement> NextBatch(benchmark::State &state, size_t maxCount)
+    {
+        if (_index == _advs.size()) {
+            state.PauseTiming();
+            MakeAdvertisements(_stream, _advs);
+            _index = 0;
+            state.ResumeTiming();
+        }
+
+        const auto count = std::min(maxCount, _advs.size() - _index);
+        const auto batch = std::span{_advs}.subspan(_index, count);
+        _index += count;
+        return batch;
+    }
+
+private:
+    const Stream &_stream;
+    std::vector<Advertisement> _advs;
+    size_t _index{0};
+};
+} // namespace Impl
+
+void Advertisement_Construct(benchmark::State &state, const Stream &stream)
+{
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        Advertisement adv{stream.packets[index]};
+        benchmark::DoNotOptimize(adv);
+        index = index + 1 == stream.packets.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(Advertisement_Construct);
+
+// Smoothing the RSSI of the side broadcasting, which is done for each packet of the bound device
+//
+void RssiFilter_Update(benchmark::State &state, const Stream &stream)
+{
+    const auto advs = MakeAdvertisements(stream);
+
+    Helper::Sides<RssiFilter> filters;
+    uint64_t outlierCount = 0;
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        const auto &adv = advs[index];
+        auto &filter = adv.GetAdvState().side == Side::Left ? filters.left : filters.right;
+        outlierCount += !filter.Update(adv.GetRssi());
+        benchmark::DoNotOptimize(filter);
+        index = index + 1 == advs.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+
+    state.counters["outliers/packet"] = benchmark::Counter{
+        static_cast<double>(outlierCount), benchmark::Counter::kAvgIterations};
+}
+APD_STREAM_BENCHMARK(RssiFilter_Update);
+
+// The evidence of one packet against our last advertisements, which is the per-packet cost of a
+// candidate device
+//
+void StateManager_ScoreAdv(benchmark::State &state, const Stream &stream)
+{
+    const auto advs = MakeAdvertisements(stream);
+    auto stateMgr = Impl::MakeStateManager();
+
+    // Let both sides have a previous advertisement to compare with
+    //
+    for (size_t i = 0; i < std::min<size_t>(advs.size(), 2); ++i) {
+        stateMgr->OnAdvReceived(Advertisement{stream.packets[i]});
+    }
+
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(StateManagerAccess::ScoreAdv(*stateMgr, advs[index]));
+        index = index + 1 == advs.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(StateManager_ScoreAdv);
+
+void StateManager_UpdateState(benchmark::State &state, const Stream &stream)
+{
+    Impl::AdvertisementPool pool{stream};
+    auto stateMgr = Impl::MakeStateManager();
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        auto optUpdateEvent = StateManagerAccess::UpdateState(*stateMgr, pool.Next(state));
+        benchmark::DoNotOptimize(optUpdateEvent);
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(StateManager_UpdateState);
+
+// The whole ingest path of the state manager, including the state changed callback
+//
+void StateManager_OnAdvReceived(benchmark::State &state, const Stream &stream)
+{
+    Impl::AdvertisementPool pool{stream};
+    auto stateMgr = Impl::MakeStateManager();
+
+    uint64_t stateChangedCount = 0;
+    stateMgr->CbStateChanged() += [&](const auto &) { ++stateChangedCount; };
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(stateMgr->OnAdvReceived(pool.Next(state)));
+    }
+    ReportPerPacket(state, allocations);
+
+    const auto statistics = stateMgr->GetStatistics();
+    state.counters["changes/packet"] = benchmark::Counter{
+        static_cast<double>(stateChangedCount), benchmark::Counter::kAvgIterations};
+    state.counters["rejected/packet"] = benchmark::Counter{
+        static_cast<double>(statistics.rejected), benchmark::Counter::kAvgIterations};
+    state.counters["ignored/packet"] = benchmark::Counter{
+        static_cast<double>(statistics.ignored), benchmark::Counter::kAvgIterations};
+    state.counters["outliers/packet"] = benchmark::Counter{
+        static_cast<double>(statistics.outliers), benchmark::Counter::kAvgIterations};
+    state.counters["duplicates/packet"] = benchmark::Counter{
+        static_cast<double>(statistics.duplicates), benchmark::Counter::kAvgIterations};
+}
+APD_STREAM_BENCHMARK(StateManager_OnAdvReceived);
+
+// A burst of advertisements received in a short time, see `StateManager_OnAdvReceived` for the
+// one-by-one baseline
+//
+void StateManager_OnAdvBatch(benchmark::State &state, const Stream &stream)
+{
+    constexpr size_t kBatchSize = 16;
+
+    Impl::AdvertisementPool pool{stream};
+    auto stateMgr = Impl::MakeStateManager();
+
+    uint64_t stateChangedCount = 0;
+    stateMgr->CbStateChanged() += [&](const auto &) { ++stateChangedCount; };
+
+    int64_t packetCount = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        auto batch = pool.NextBatch(state, kBatchSize);
+        packetCount += static_cast<int64_t>(batch.size());
+        benchmark::DoNotOptimize(stateMgr->OnAdvBatch(batch));
+    }
+    ReportPerPacket(state, allocations, packetCount);
+
+    state.counters["changes/packet"] = benchmark::Counter{
+        static_cast<double>(stateChangedCount) / static_cast<double>(packetCount)};
+}
+APD_STREAM_BENCHMARK(StateManager_OnAdvBatch);
+
+// Replays the stream with its recorded timing on a virtual scheduler, so the expiry timer runs
+// as it would on a real session, without waiting for it
+//
+void StateManager_VirtualReplay(benchmark::State &state, const Stream &stream)
+{
+    Helper::Scheduler scheduler{Helper::Scheduler::TimePoint{}};
+
+    Impl::AdvertisementPool pool{stream};
+    auto stateMgr = Impl::MakeStateManager(scheduler);
+
+    uint64_t disconnectedCount = 0;
+    stateMgr->CbDisconnected() += [&] { ++disconnectedCount; };
+
+    std::optional<Advertisement::TimestampType> lastTimestamp;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        auto adv = pool.Next(state);
+
+        // The time does not go backward when the pool restarts from the beginning of the stream
+        //
+        const auto timestamp = adv.GetTimestamp();
+        if (lastTimestamp.has_value() && timestamp > lastTimestamp.value()) {
+            scheduler.AdvanceBy(timestamp - lastTimestamp.value());
+        }
+        lastTimestamp = timestamp;
+
+        benchmark::DoNotOptimize(stateMgr->OnAdvReceived(std::move(adv)));
+    }
+    ReportPerPacket(state, allocations);
+
+    const auto statistics = scheduler.GetStatistics();
+    state.counters["virtual_hours"] = std::chrono::duration<double, std::ratio<3600>>{
+        statistics.uptime}.count();
+    state.counters["timers/packet"] = benchmark::Counter{
+        static_cast<double>(statistics.fired), benchmark::Counter::kAvgIterations};
+    state.counters["lost"] = static_cast<double>(disconnectedCount);
+}
+APD_STREAM_BENCHMARK(StateManager_VirtualReplay);
+
+// Evaluates the identification of our device against the labels of the stream. Each iteration
+// replays the whole stream on a new state manager, with the recorded timing on a virtual
+// scheduler, and counts the packets accepted from ours and from the others.
+//
+void StateManager_Identify(benchmark::State &state, const Stream &stream)
+{
+    if (stream.labels.empty()) {
+        state.SkipWithError("The stream is not labelled.");
+        return;
+    }
+
+    std::optional<Helper::Scheduler> scheduler;
+    std::unique_ptr<StateManager> stateMgr;
+    std::vector<Advertisement> advs;
+    advs.reserve(stream.packets.size());
+
+    uint64_t oursCount = 0, othersCount = 0, oursAccepted = 0, othersAccepted = 0;
+    int64_t packetCount = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        state.PauseTiming();
+        stateMgr.reset();
+        scheduler.emplace(Helper::Scheduler::TimePoint{});
+        stateMgr = Impl::MakeStateManager(scheduler.value());
+        MakeAdvertisements(stream, advs);
+        state.ResumeTiming();
+
+        for (size_t i = 0; i < advs.size(); ++i) {
+            if (i != 0 && advs[i].GetTimestamp() > stream.packets[i - 1].timestamp) {
+                scheduler->AdvanceBy(advs[i].GetTimestamp() - stream.packets[i - 1].timestamp);
+            }
+
+            const bool accepted = stateMgr->OnAdvReceived(std::move(advs[i]));
+            if (stream.labels[i]) {
+                ++oursCount;
+                oursAccepted += accepted;
+            }
+            else {
+                ++othersCount;
+                othersAccepted += accepted;
+            }
+        }
+        packetCount += static_cast<int64_t>(advs.size());
+    }
+    ReportPerPacket(state, allocations, packetCount);
+
+    const auto ratio = [](uint64_t count, uint64_t total) {
+        return total != 0 ? static_cast<double>(count) / static_cast<double>(total) : 0.0;
+    };
+    state.counters["recall"] = ratio(oursAccepted, oursCount);
+    state.counters["false_accepts"] = ratio(othersAccepted, othersCount);
+
+    // Of the last iteration, they are the same in all of them
+    //
+    const auto statistics = stateMgr->GetStatistics();
+    state.counters["rotations"] = static_cast<double>(statistics.rotations);
+    state.counters["reacquire_ms"] = static_cast<double>(
+        statistics.rotationLatencyTotal.count() / std::max<uint64_t>(statistics.rotations, 1));
+    state.counters["reacquire_max_ms"] = static_cast<double>(statistics.rotationLatencyMax.count());
+    state.counters["duplicate_hits"] = ratio(statistics.duplicates, statistics.accepted);
+}
+APD_STREAM_BENCHMARK(StateManager_Identify);
+} // namespace Benchmark
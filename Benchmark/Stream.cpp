@@ -0,0 +1,328 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include <random>
+#include <fstream>
+#include <algorithm>
+#include <unordered_set>
+
+#include "Core/Capture.h"
+#include "Core/StateManager.h"
+#include "Core/Bluetooth_replay.h"
+
+namespace Benchmark {
+namespace Impl {
+
+using Core::Bluetooth::AdvertisementReceivedData;
+
+// Builds a Proximity Pairing payload field by field, see `AppleCP::AirPods::Fields` for the layout
+//
+std::array<uint8_t, Core::AppleCP::AirPods::kSize> MakeAirPodsPayload(
+    std::mt19937 &random, bool broadcastFromLeft, uint8_t leftBattery, uint8_t rightBattery,
+    uint8_t caseBattery, uint16_t modelId = 0x200E /* AirPods Pro */)
+{
+    std::array<uint8_t, Core::AppleCP::AirPods::kSize> payload{};
+
+    const uint8_t currBattery = broadcastFromLeft ? leftBattery : rightBattery;
+    const uint8_t anotBattery = broadcastFromLeft ? rightBattery : leftBattery;
+
+    payload[0] = Helper::ToUnderlying(Core::AppleCP::PacketType::ProximityPairing);
+    payload[1] = Core::AppleCP::AirPods::kSize - sizeof(Core::AppleCP::Header);
+    payload[2] = 0x01;
+    payload[3] = static_cast<uint8_t>(modelId & 0xFF);
+    payload[4] = static_cast<uint8_t>(modelId >> 8);
+    payload[5] = 0b0000'1011 | (broadcastFromLeft ? 0b0010'0000 : 0); // Both pods in ear
+    payload[6] = currBattery | (anotBattery << 4);
+    payload[7] = caseBattery | 0b0100'0000; // Case is charging
+    payload[8] = 0b0000'1000;               // Lid closed
+    payload[9] = Helper::ToUnderlying(Core::AppleCP::Color::White);
+
+    std::uniform_int_distribution<uint32_t> byteDist{0, 0xFF};
+    for (size_t i = 10; i < payload.size(); ++i) {
+        payload[i] = static_cast<uint8_t>(byteDist(random));
+    }
+    return payload;
+}
+
+void AppendPacket(
+    Stream &stream, AdvertisementReceivedData::Timestamp timestamp, uint64_t address, int16_t rssi,
+    std::span<const uint8_t> payload)
+{
+    auto &data = stream.packets.emplace_back();
+    data.timestamp = timestamp;
+    data.address = address;
+    data.rssi = rssi;
+
+    auto manufacturerData = data.manufacturerData.emplace_back();
+    manufacturerData->companyId = Core::AppleCP::VendorId;
+    manufacturerData->data.assign(payload);
+}
+
+// What else a busy place is full of, in turn: packets from other vendors, packets without any
+// manufacturer data, and Apple packets of other types, some of them of the same size as the
+// AirPods ones and some of the AirPods type but of another size
+//
+void AppendRejectedPacket(
+    Stream &stream, AdvertisementReceivedData::Timestamp timestamp, std::mt19937 &random)
+{
+    struct Kind {
+        std::optional<uint16_t> companyId;
+        std::optional<uint8_t> packetType;
+        size_t size;
+    };
+    constexpr std::array<Kind, 6> kKinds{{
+        {.companyId = 0x0006, .size = 27},  // Microsoft, Swift Pair and device discovery
+        {.companyId = 0x0075, .size = 24},  // Samsung
+        {.companyId = std::nullopt},        // Only service data
+        {.companyId = Core::AppleCP::VendorId, .packetType = 0x10, .size = 7},  // Nearby info
+        {.companyId = Core::AppleCP::VendorId, .packetType = 0x12, .size = 27}, // Find My
+        {.companyId = Core::AppleCP::VendorId, .packetType = 0x07, .size = 19}, // Pairing mode
+    }};
+
+    const auto &kind = kKinds[stream.rejected.size() % kKinds.size()];
+
+    auto &data = stream.rejected.emplace_back();
+    data.timestamp = timestamp;
+    data.address = 0xC0FFEE000000 + random() % 0x10000;
+    data.rssi = static_cast<int16_t>(-90 + static_cast<int>(random() % 40));
+
+    if (!kind.companyId.has_value()) {
+        return;
+    }
+
+    std::array<uint8_t, Core::Bluetooth::ManufacturerData::kMaxSize> bytes;
+    std::uniform_int_distribution<uint32_t> byteDist{0, 0xFF};
+    for (auto &byte : bytes) {
+        byte = static_cast<uint8_t>(byteDist(random));
+    }
+    if (kind.packetType.has_value()) {
+        bytes[0] = kind.packetType.value();
+        bytes[1] = static_cast<uint8_t>(kind.size - sizeof(Core::AppleCP::Header));
+    }
+
+    auto manufacturerData = data.manufacturerData.emplace_back();
+    manufacturerData->companyId = kind.companyId.value();
+    manufacturerData->data.assign(std::span{bytes}.first(kind.size));
+}
+} // namespace Impl
+
+// A pair of AirPods Pro in ear, broadcasting from both sides alternately. The batteries drain
+// slowly and the random addresses rotate periodically, which covers the common paths of
+// `StateManager`. The seed is fixed so the results are comparable between runs.
+//
+Stream GenerateSyntheticStream(size_t count)
+{
+    constexpr auto kInterval = std::chrono::milliseconds{100};
+    constexpr size_t kAddressRotationInterval = 512;
+    constexpr size_t kBatteryDrainInterval = 256;
+
+    Stream stream{.name = "Synthetic"};
+    stream.packets.reserve(count);
+
+    std::mt19937 random{0x41504442};
+    std::uniform_int_distribution<int> rssiDist{-60, -40};
+
+    auto timestamp =
+        Core::Bluetooth::AdvertisementReceivedData::Timestamp{} + std::chrono::hours{1};
+
+    for (size_t i = 0; i < count; ++i) {
+        const bool broadcastFromLeft = i % 2 == 0;
+        const uint64_t address =
+            0xA1B2C3D4E500 + (i / kAddressRotationInterval) * 2 + (broadcastFromLeft ? 0 : 1);
+
+        // Drain between two address rotations, the state manager rejects an address change
+        // together with a battery change
+        //
+        const auto drained =
+            static_cast<uint8_t>((i + kBatteryDrainInterval / 2) / kBatteryDrainInterval % 8);
+        const uint8_t podBattery = 10 - drained;
+        const uint8_t caseBattery = 10 - drained / 2;
+
+        const auto payload = Impl::MakeAirPodsPayload(
+            random, broadcastFromLeft, podBattery, podBattery, caseBattery);
+
+        Impl::AppendPacket(
+            stream, timestamp, address, static_cast<int16_t>(rssiDist(random)), payload);
+        timestamp += kInterval;
+    }
+    stream.labels.assign(count, true);
+    return stream;
+}
+
+// The synthetic stream with the packets of other AirPods around, as in an open-plan office. Every
+// fourth packet is from ours, the others are from random neighbors, weaker and with addresses
+// rotating as well. Some of them are the same model with the same batteries as ours. There are
+// as many other packets, see `AppendRejectedPacket`.
+//
+Stream GenerateCrowdedStream(size_t count, size_t neighborCount)
+{
+    constexpr size_t kAddressRotationInterval = 2048;
+    constexpr std::array<uint16_t, 4> kModelIds{0x200E, 0x200F, 0x2014, 0x2013};
+
+    const auto ours = GenerateSyntheticStream(count / 4);
+
+    Stream stream{.name = "Crowded"};
+    stream.packets.reserve(count);
+    stream.rejected.reserve(count);
+
+    std::mt19937 random{0x43524F57};
+    std::uniform_int_distribution<int> rssiDist{-75, -55};
+    std::uniform_int_distribution<size_t> neighborDist{0, neighborCount - 1};
+    std::uniform_int_distribution<uint32_t> batteryDist{0, 10};
+
+    struct Neighbor {
+        uint16_t modelId;
+        uint8_t leftBattery, rightBattery, caseBattery;
+    };
+    std::vector<Neighbor> neighbors;
+    for (size_t i = 0; i < neighborCount; ++i) {
+        neighbors.push_back(Neighbor{
+            .modelId = kModelIds[i % kModelIds.size()],
+            .leftBattery = static_cast<uint8_t>(i % 8 == 0 ? 10 : batteryDist(random)),
+            .rightBattery = static_cast<uint8_t>(i % 8 == 0 ? 10 : batteryDist(random)),
+            .caseBattery = static_cast<uint8_t>(batteryDist(random)),
+        });
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const auto &our = ours.packets[std::min(i / 4, ours.packets.size() - 1)];
+        if (i % 4 == 0) {
+            stream.packets.push_back(our);
+            stream.labels.push_back(true);
+            continue;
+        }
+
+        const auto index = neighborDist(random);
+        const auto &neighbor = neighbors[index];
+        const bool broadcastFromLeft = random() % 2 == 0;
+        const uint64_t address = 0x5E1000000000 + (i / kAddressRotationInterval) * 0x10000 +
+                                 index * 2 + (broadcastFromLeft ? 0 : 1);
+
+        const auto payload = Impl::MakeAirPodsPayload(
+            random, broadcastFromLeft, neighbor.leftBattery, neighbor.rightBattery,
+            neighbor.caseBattery, neighbor.modelId);
+
+        Impl::AppendPacket(
+            stream, our.timestamp, address, static_cast<int16_t>(rssiDist(random)), payload);
+        stream.labels.push_back(false);
+    }
+
+    for (const auto &packet : stream.packets) {
+        Impl::AppendRejectedPacket(stream, packet.timestamp, random);
+    }
+    return stream;
+}
+
+// The synthetic stream with each packet received `repeat` times in a row, as the AirPods do when
+// nothing changes. Only the timestamp and the RSSI of the copies differ.
+//
+Stream GenerateRepeatedStream(size_t count, size_t repeat)
+{
+    constexpr auto kInterval = std::chrono::milliseconds{20};
+
+    const auto original = GenerateSyntheticStream((count + repeat - 1) / repeat);
+
+    Stream stream{.name = "Repeated"};
+    stream.packets.reserve(count);
+
+    std::mt19937 random{0x52455054};
+    std::uniform_int_distribution<int> rssiDist{-3, 3};
+
+    for (size_t i = 0; i < count; ++i) {
+        auto &packet = stream.packets.emplace_back(original.packets[i / repeat]);
+        packet.timestamp += kInterval * static_cast<int>(i % repeat);
+        packet.rssi = static_cast<int16_t>(packet.rssi + rssiDist(random));
+    }
+    stream.labels.assign(count, true);
+    return stream;
+}
+
+// Loads a binary capture or a text capture, the packets that are not from AirPods are moved to
+// `rejected`
+//
+std::optional<Stream> LoadRecordedStream(const std::filesystem::path &path)
+{
+    Stream stream{.name = path.filename().string()};
+
+    if (Core::Capture::IsCaptureFile(path)) {
+        Core::Capture::Reader reader;
+        if (!reader.Open(path)) {
+            return std::nullopt;
+        }
+
+        stream.packets.reserve(reader.GetRecords().size());
+        for (const auto &record : reader) {
+            Impl::AppendPacket(
+                stream, record.GetTimestamp(), record.addressHash, record.rssi,
+                record.GetPayload());
+        }
+    }
+    else {
+        std::ifstream file{path};
+        if (!file.is_open()) {
+            return std::nullopt;
+        }
+
+        std::string line;
+        while (std::getline(file, line)) {
+            auto optData = Core::Bluetooth::ReplayAdvertisementWatcher::ParseLine(line);
+            if (optData.has_value()) {
+                stream.packets.push_back(std::move(optData.value()));
+            }
+        }
+    }
+
+    const auto rejected = std::ranges::stable_partition(stream.packets, [](const auto &data) {
+        return Core::AirPods::Details::Advertisement::IsDesiredAdv(data);
+    });
+    stream.rejected.assign(rejected.begin(), rejected.end());
+    stream.packets.erase(rejected.begin(), rejected.end());
+
+    if (std::ifstream labelsFile{path.string() + ".labels"}; labelsFile.is_open()) {
+        std::unordered_set<uint64_t> ourAddresses;
+        for (uint64_t address; labelsFile >> std::hex >> address;) {
+            ourAddresses.insert(address);
+        }
+
+        stream.labels.reserve(stream.packets.size());
+        for (const auto &data : stream.packets) {
+            stream.labels.push_back(ourAddresses.contains(data.address));
+        }
+    }
+    return stream;
+}
+
+std::vector<Core::AirPods::Details::Advertisement> MakeAdvertisements(const Stream &stream)
+{
+    std::vector<Core::AirPods::Details::Advertisement> result;
+    result.reserve(stream.packets.size());
+    MakeAdvertisements(stream, result);
+    return result;
+}
+
+void MakeAdvertisements(
+    const Stream &stream, std::vector<Core::AirPods::Details::Advertisement> &advs)
+{
+    advs.clear();
+    for (const auto &data : stream.packets) {
+        advs.emplace_back(data);
+    }
+}
+} // namespace Benchmark
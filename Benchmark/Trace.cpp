@@ -0,0 +1,108 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include "Core/Trace.h"
+#include "Core/Capture.h"
+#include "Core/StateManager.h"
+
+namespace Benchmark {
+
+using Core::AirPods::Details::Advertisement;
+
+namespace Impl {
+
+// The per-packet event of `Manager::OnAdvertisementReceived`
+//
+inline void TraceAdvReceived(const Advertisement &adv)
+{
+    const auto &data = adv.GetDesensitizedData();
+    APD_TRACE(
+        AirPodsAdvReceived, Core::Trace::LoadBytes(data, 0), Core::Trace::LoadBytes(data, 8),
+        adv.GetAddress(), adv.GetRssi());
+}
+} // namespace Impl
+
+// Recording to a file, compared with the text of the same event. The ring of the thread is
+// drained outside the timing before it is full, as the background thread would.
+//
+void Trace_Record(benchmark::State &state, const Stream &stream)
+{
+    constexpr size_t kDrainInterval = Core::Trace::Details::ThreadBuffer::kCapacity / 2;
+
+    const auto advs = MakeAdvertisements(stream);
+
+    const auto path = std::filesystem::temp_directory_path() / "ApdBenchmark.trace";
+    if (!Core::Trace::Open(path)) {
+        state.SkipWithError("Failed to open the trace file.");
+        return;
+    }
+
+    size_t index = 0, textSize = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        Impl::TraceAdvReceived(advs[index]);
+        index = index + 1 == advs.size() ? 0 : index + 1;
+
+        if (index % kDrainInterval == 0) {
+            state.PauseTiming();
+            Core::Trace::Flush();
+            state.ResumeTiming();
+        }
+    }
+    ReportPerPacket(state, allocations);
+
+    Core::Trace::Close();
+
+    for (const auto &adv : advs) {
+        const auto &data = adv.GetDesensitizedData();
+        const std::array<uint64_t, 4> args{
+            Core::Trace::LoadBytes(data, 0), Core::Trace::LoadBytes(data, 8),
+            Core::Capture::HashAddress(adv.GetAddress()),
+            static_cast<uint64_t>(static_cast<int64_t>(adv.GetRssi()))};
+        textSize += Core::Trace::Render(Core::Trace::Event::AirPodsAdvReceived, args).size() + 1;
+    }
+
+    state.counters["file_bytes/packet"] = benchmark::Counter{
+        static_cast<double>(std::filesystem::file_size(path)), benchmark::Counter::kAvgIterations};
+    state.counters["text_bytes/packet"] =
+        static_cast<double>(textSize) / static_cast<double>(advs.size());
+    std::filesystem::remove(path);
+}
+APD_STREAM_BENCHMARK(Trace_Record);
+
+// Neither recorded nor logged, which is the default
+//
+void Trace_Disabled(benchmark::State &state, const Stream &stream)
+{
+    const auto advs = MakeAdvertisements(stream);
+
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        Impl::TraceAdvReceived(advs[index]);
+        benchmark::ClobberMemory();
+        index = index + 1 == advs.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+}
+APD_STREAM_BENCHMARK(Trace_Disabled);
+} // namespace Benchmark
@@ -0,0 +1,117 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Benchmark.h"
+
+#include <array>
+
+#include "Core/AppleCP.h"
+#include "Core/StateManager.h"
+#include "Core/Bluetooth_replay.h"
+
+namespace Benchmark {
+
+using Core::AirPods::Details::Advertisement;
+using Core::Bluetooth::AdvertisementReceivedData;
+using Core::Bluetooth::ReplayAdvertisementWatcher;
+
+struct WatcherAccess {
+    static void Dispatch(ReplayAdvertisementWatcher &watcher, const AdvertisementReceivedData &data)
+    {
+        watcher.Dispatch(data);
+    }
+};
+
+namespace Impl {
+
+// The filters of `Manager`
+//
+constexpr std::array<Core::Bluetooth::ManufacturerDataFilter, 1> kAirPodsFilters{{{
+    .companyId = Core::AppleCP::VendorId,
+    .packetType = Helper::ToUnderlying(Core::AppleCP::PacketType::ProximityPairing),
+    .length = Core::AppleCP::AirPods::kSize,
+}}};
+
+// The packets the watcher and the manager throw away, which are most of the packets received in
+// a busy place. Each one is built from the bytes reported by the platform as the watcher does,
+// then dispatched through the filters to the check of the manager.
+//
+// Without the filters, every packet reaches `Advertisement::IsDesiredAdv`, as on the platforms
+// not filtering in the watcher.
+//
+template <bool kFiltered>
+void RejectedBenchmark(benchmark::State &state, const Stream &stream)
+{
+    if (stream.rejected.empty()) {
+        state.SkipWithError("The stream has no rejected packet.");
+        return;
+    }
+
+    ReplayAdvertisementWatcher watcher{{}};
+    if constexpr (kFiltered) {
+        watcher.SetFilters(kAirPodsFilters);
+    }
+
+    uint64_t desiredCount = 0;
+    watcher.CbReceived() += [&](const auto &data) {
+        desiredCount += Advertisement::IsDesiredAdv(data);
+    };
+
+    size_t index = 0;
+
+    AllocationCounter allocations;
+    for (auto _ : state) {
+        const auto &packet = stream.rejected[index];
+
+        AdvertisementReceivedData data;
+        data.rssi = packet.rssi;
+        data.timestamp = packet.timestamp;
+        data.address = packet.address;
+        for (const auto &section : packet.manufacturerData) {
+            auto manufacturerData = data.manufacturerData.emplace_back();
+            manufacturerData->companyId = section.companyId;
+            manufacturerData->data.assign(section.data);
+        }
+
+        WatcherAccess::Dispatch(watcher, data);
+        index = index + 1 == stream.rejected.size() ? 0 : index + 1;
+    }
+    ReportPerPacket(state, allocations);
+
+    const auto statistics = watcher.GetStatistics();
+    state.counters["filtered/packet"] = benchmark::Counter{
+        static_cast<double>(statistics.filtered), benchmark::Counter::kAvgIterations};
+
+    if (desiredCount != 0) {
+        state.SkipWithError("A rejected packet is desired");
+    }
+}
+} // namespace Impl
+
+void Watcher_Rejected(benchmark::State &state, const Stream &stream)
+{
+    Impl::RejectedBenchmark<true>(state, stream);
+}
+APD_STREAM_BENCHMARK(Watcher_Rejected);
+
+void Watcher_RejectedUnfiltered(benchmark::State &state, const Stream &stream)
+{
+    Impl::RejectedBenchmark<false>(state, stream);
+}
+APD_STREAM_BENCHMARK(Watcher_RejectedUnfiltered);
+} // namespace Benchmark
@@ -27,6 +27,7 @@
 #include "Core/GlobalMedia.h"
 #include "Core/Settings.h"
 #include "Core/Update.h"
+#include "Core/Trace.h"
 
 void ApdApplication::PreConstruction()
 {
@@ -130,6 +131,10 @@ bool ApdApplication::Prepare(int argc, char *argv[])
 
     LOG(Info, "Opts: {}", opts);
 
+    if (!opts.traceFile.empty()) {
+        Core::Trace::Open(QString::fromStdString(opts.traceFile).toStdWString());
+    }
+
     Logger::CleanUpOldLogFiles();
 
     QFont font;
@@ -157,6 +162,16 @@ bool ApdApplication::Prepare(int argc, char *argv[])
     _mainWindow = std::make_unique<Gui::MainWindow>();
     _lowAudioLatencyController = std::make_unique<Core::LowAudioLatency::Controller>();
 
+    if (!opts.captureFile.empty()) {
+        _mainWindow->GetApdMgr().StartCapture(
+            QString::fromStdString(opts.captureFile).toStdWString());
+    }
+
+    if (!opts.replayFile.empty()) {
+        _mainWindow->GetApdMgr().ReplayCapture(
+            QString::fromStdString(opts.replayFile).toStdWString(), opts.replaySpeed);
+    }
+
     InitSettings(settingsLoadResult);
 
     return true;
@@ -19,10 +19,24 @@
 #include "Assert.h"
 
 #include <format>
+#include <cstdlib>
 
-#include "Error.h"
+#include "Logger.h"
 
 namespace Assert {
+namespace Impl {
+
+FnHandler &GetHandler()
+{
+    static FnHandler handler;
+    return handler;
+}
+} // namespace Impl
+
+void SetHandler(FnHandler handler)
+{
+    Impl::GetHandler() = std::move(handler);
+}
 
 void Trigger(const std::string &condition, const std::source_location &srcloc)
 {
@@ -34,6 +48,13 @@ void Trigger(const std::string &condition, const std::source_location &srcloc)
         "Line: {}",
         condition, srcloc.file_name(), srcloc.line());
 
-    FatalError(content, true);
+    const auto &handler = Impl::GetHandler();
+    if (handler) {
+        handler(content);
+    }
+
+    LOG(Critical, "{}", content);
+    Logger::FlushBeforeAbort();
+    std::abort();
 }
 } // namespace Assert
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <string>
+#include <functional>
 #include <source_location>
 
 #include "Helper.h"
@@ -30,7 +31,14 @@
 
 namespace Assert {
 
-void Trigger(
+using FnHandler = std::function<void(const std::string &content)>;
+
+// The handler is invoked when an assertion is triggered and it is not expected to return.
+// If no handler is set, the content is logged and the process is aborted.
+//
+void SetHandler(FnHandler handler);
+
+[[noreturn]] void Trigger(
     const std::string &condition,
     const std::source_location &srcloc = std::source_location::current());
 
@@ -0,0 +1,334 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Aes.h"
+
+#if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+    #define APD_AES_NI
+    #include <wmmintrin.h>
+    #if defined _MSC_VER
+        #include <intrin.h>
+        #define APD_AES_NI_TARGET
+    #else
+        #define APD_AES_NI_TARGET __attribute__((target("aes,sse2")))
+    #endif
+#endif
+
+namespace Core::Aes {
+namespace Impl {
+
+// The tables are generated at compile time from their definition in FIPS-197, it's easier to
+// review than 512 magic numbers
+//
+constexpr uint8_t RotateLeft(uint8_t value, int shift)
+{
+    return static_cast<uint8_t>((value << shift) | (value >> (8 - shift)));
+}
+
+constexpr std::array<uint8_t, 256> MakeSBox()
+{
+    std::array<uint8_t, 256> result{};
+
+    // `p` walks the multiplicative group by multiplying by 3, and `q` by dividing by 3, so `q` is
+    // always the inverse of `p`
+    //
+    uint8_t p = 1, q = 1;
+    do {
+        p = static_cast<uint8_t>(p ^ (p << 1) ^ ((p & 0x80) != 0 ? 0x1B : 0));
+
+        q = static_cast<uint8_t>(q ^ (q << 1));
+        q = static_cast<uint8_t>(q ^ (q << 2));
+        q = static_cast<uint8_t>(q ^ (q << 4));
+        if ((q & 0x80) != 0) {
+            q ^= 0x09;
+        }
+
+        result[p] = static_cast<uint8_t>(
+            q ^ RotateLeft(q, 1) ^ RotateLeft(q, 2) ^ RotateLeft(q, 3) ^ RotateLeft(q, 4) ^ 0x63);
+    } while (p != 1);
+
+    result[0] = 0x63;
+    return result;
+}
+
+constexpr std::array<uint8_t, 256> MakeInverse(const std::array<uint8_t, 256> &box)
+{
+    std::array<uint8_t, 256> result{};
+    for (size_t i = 0; i < box.size(); ++i) {
+        result[box[i]] = static_cast<uint8_t>(i);
+    }
+    return result;
+}
+
+constexpr auto kSBox = MakeSBox();
+constexpr auto kInvSBox = MakeInverse(kSBox);
+
+static_assert(kSBox[0x00] == 0x63 && kSBox[0x01] == 0x7C && kSBox[0x53] == 0xED);
+static_assert(kSBox[0xFF] == 0x16 && kInvSBox[0x63] == 0x00 && kInvSBox[0x16] == 0xFF);
+
+constexpr RoundKeys ExpandKey(const Key &key)
+{
+    constexpr std::array<uint8_t, kRounds> kRcon{
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36};
+
+    RoundKeys result{};
+    result[0] = key;
+
+    for (size_t round = 1; round <= kRounds; ++round) {
+        const auto &prev = result[round - 1];
+        auto &curr = result[round];
+
+        // RotWord and SubWord of the last word
+        //
+        curr[0] = prev[0] ^ kSBox[prev[13]] ^ kRcon[round - 1];
+        curr[1] = prev[1] ^ kSBox[prev[14]];
+        curr[2] = prev[2] ^ kSBox[prev[15]];
+        curr[3] = prev[3] ^ kSBox[prev[12]];
+
+        for (size_t i = 4; i < kBlockSize; ++i) {
+            curr[i] = prev[i] ^ curr[i - 4];
+        }
+    }
+    return result;
+}
+
+// FIPS-197 Appendix A.1
+//
+static_assert(
+    ExpandKey({0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF,
+               0x4F, 0x3C})[kRounds] ==
+    Block{0xD0, 0x14, 0xF9, 0xA8, 0xC9, 0xEE, 0x25, 0x89, 0xE1, 0x3F, 0x0C, 0xC8, 0xB6, 0x63,
+          0x0C, 0xA6});
+
+constexpr uint8_t XTime(uint8_t value)
+{
+    return static_cast<uint8_t>((value << 1) ^ ((value & 0x80) != 0 ? 0x1B : 0));
+}
+
+inline void AddRoundKey(Block &state, const Block &roundKey)
+{
+    for (size_t i = 0; i < kBlockSize; ++i) {
+        state[i] ^= roundKey[i];
+    }
+}
+
+// The state is column-major, the byte `i` is in the row `i % 4` of the column `i / 4`. Row `r` is
+// rotated right by `r`, this is where each byte comes from.
+//
+constexpr std::array<uint8_t, kBlockSize> kInvShiftRows{
+    0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3};
+
+inline void InvShiftRowsAndSubBytes(Block &state)
+{
+    const Block copy = state;
+    for (size_t i = 0; i < kBlockSize; ++i) {
+        state[i] = kInvSBox[copy[kInvShiftRows[i]]];
+    }
+}
+
+// The products by {0e}, {0b}, {0d} and {09}, which are combinations of {02}, {04} and {08}
+//
+constexpr std::array<uint8_t, 256> MakeMultiplication(uint8_t factor)
+{
+    std::array<uint8_t, 256> result{};
+    for (size_t i = 0; i < result.size(); ++i) {
+        const auto x1 = static_cast<uint8_t>(i), x2 = XTime(x1), x4 = XTime(x2), x8 = XTime(x4);
+        result[i] = static_cast<uint8_t>(
+            ((factor & 1) != 0 ? x1 : 0) ^ ((factor & 2) != 0 ? x2 : 0) ^
+            ((factor & 4) != 0 ? x4 : 0) ^ ((factor & 8) != 0 ? x8 : 0));
+    }
+    return result;
+}
+
+constexpr auto kMul09 = MakeMultiplication(0x09);
+constexpr auto kMul0B = MakeMultiplication(0x0B);
+constexpr auto kMul0D = MakeMultiplication(0x0D);
+constexpr auto kMul0E = MakeMultiplication(0x0E);
+
+static_assert(kMul0E[0x57] == 0x67 && kMul09[0xFF] == 0x46);
+
+inline void InvMixColumns(Block &state)
+{
+    for (size_t column = 0; column < 4; ++column) {
+        const auto a = &state[column * 4];
+        const uint8_t a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+
+        a[0] = kMul0E[a0] ^ kMul0B[a1] ^ kMul0D[a2] ^ kMul09[a3];
+        a[1] = kMul09[a0] ^ kMul0E[a1] ^ kMul0B[a2] ^ kMul0D[a3];
+        a[2] = kMul0D[a0] ^ kMul09[a1] ^ kMul0E[a2] ^ kMul0B[a3];
+        a[3] = kMul0B[a0] ^ kMul0D[a1] ^ kMul09[a2] ^ kMul0E[a3];
+    }
+}
+
+inline void DecryptPortable(const RoundKeys &roundKeys, std::span<Block> blocks)
+{
+    for (auto &state : blocks) {
+        AddRoundKey(state, roundKeys[kRounds]);
+        for (size_t round = kRounds - 1; round > 0; --round) {
+            InvShiftRowsAndSubBytes(state);
+            AddRoundKey(state, roundKeys[round]);
+            InvMixColumns(state);
+        }
+        InvShiftRowsAndSubBytes(state);
+        AddRoundKey(state, roundKeys[0]);
+    }
+}
+
+#if defined APD_AES_NI
+namespace AesNi {
+
+inline bool IsSupported()
+{
+    #if defined _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) != 0;
+    #else
+    return __builtin_cpu_supports("aes");
+    #endif
+}
+
+// The equivalent inverse cipher of FIPS-197, `aesdec` expects the round keys in reverse order
+// and passed through InvMixColumns
+//
+APD_AES_NI_TARGET inline RoundKeys MakeDecryptionKeys(const RoundKeys &roundKeys)
+{
+    RoundKeys result;
+
+    const auto load = [&](size_t index) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(roundKeys[index].data()));
+    };
+    const auto store = [&](size_t index, __m128i value) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(result[index].data()), value);
+    };
+
+    store(0, load(kRounds));
+    for (size_t round = 1; round < kRounds; ++round) {
+        store(round, _mm_aesimc_si128(load(kRounds - round)));
+    }
+    store(kRounds, load(0));
+    return result;
+}
+
+APD_AES_NI_TARGET inline void Decrypt(const RoundKeys &decryptionKeys, std::span<Block> blocks)
+{
+    // Not `std::array`, the alignment attribute of `__m128i` would be dropped
+    //
+    __m128i keys[kRounds + 1];
+    for (size_t i = 0; i <= kRounds; ++i) {
+        keys[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(decryptionKeys[i].data()));
+    }
+
+    const auto load = [&](size_t index) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(blocks[index].data()));
+    };
+    const auto store = [&](size_t index, __m128i value) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(blocks[index].data()), value);
+    };
+
+    // The blocks are independent, so the latency of `aesdec` is hidden by interleaving them
+    //
+    size_t index = 0;
+    for (; index + 4 <= blocks.size(); index += 4) {
+        __m128i b0 = _mm_xor_si128(load(index + 0), keys[0]);
+        __m128i b1 = _mm_xor_si128(load(index + 1), keys[0]);
+        __m128i b2 = _mm_xor_si128(load(index + 2), keys[0]);
+        __m128i b3 = _mm_xor_si128(load(index + 3), keys[0]);
+
+        for (size_t round = 1; round < kRounds; ++round) {
+            b0 = _mm_aesdec_si128(b0, keys[round]);
+            b1 = _mm_aesdec_si128(b1, keys[round]);
+            b2 = _mm_aesdec_si128(b2, keys[round]);
+            b3 = _mm_aesdec_si128(b3, keys[round]);
+        }
+
+        store(index + 0, _mm_aesdeclast_si128(b0, keys[kRounds]));
+        store(index + 1, _mm_aesdeclast_si128(b1, keys[kRounds]));
+        store(index + 2, _mm_aesdeclast_si128(b2, keys[kRounds]));
+        store(index + 3, _mm_aesdeclast_si128(b3, keys[kRounds]));
+    }
+
+    for (; index < blocks.size(); ++index) {
+        __m128i block = _mm_xor_si128(load(index), keys[0]);
+        for (size_t round = 1; round < kRounds; ++round) {
+            block = _mm_aesdec_si128(block, keys[round]);
+        }
+        store(index, _mm_aesdeclast_si128(block, keys[kRounds]));
+    }
+}
+} // namespace AesNi
+#endif
+} // namespace Impl
+
+Decryptor::Decryptor(const Key &key, bool allowHardware) : _roundKeys{Impl::ExpandKey(key)}
+{
+#if defined APD_AES_NI
+    if (allowHardware && Impl::AesNi::IsSupported()) {
+        _hardwareRoundKeys = Impl::AesNi::MakeDecryptionKeys(_roundKeys);
+        _hardware = true;
+    }
+#endif
+}
+
+void Decryptor::Decrypt(std::span<Block> blocks) const
+{
+#if defined APD_AES_NI
+    if (_hardware) {
+        Impl::AesNi::Decrypt(_hardwareRoundKeys, blocks);
+        return;
+    }
+#endif
+    Impl::DecryptPortable(_roundKeys, blocks);
+}
+
+std::optional<Key> Decryptor::ParseKey(std::string_view hex)
+{
+    const auto digit = [](char ch) -> int {
+        if (ch >= '0' && ch <= '9') {
+            return ch - '0';
+        }
+        if (ch >= 'a' && ch <= 'f') {
+            return ch - 'a' + 10;
+        }
+        if (ch >= 'A' && ch <= 'F') {
+            return ch - 'A' + 10;
+        }
+        return -1;
+    };
+
+    Key result{};
+    size_t count = 0;
+    for (const auto ch : hex) {
+        if (ch == ' ' || ch == ':' || ch == '-') {
+            continue;
+        }
+
+        const auto value = digit(ch);
+        if (value < 0 || count == kBlockSize * 2) {
+            return std::nullopt;
+        }
+        result[count / 2] = static_cast<uint8_t>(result[count / 2] << 4 | value);
+        ++count;
+    }
+
+    if (count != kBlockSize * 2) {
+        return std::nullopt;
+    }
+    return result;
+}
+} // namespace Core::Aes
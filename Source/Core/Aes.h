@@ -0,0 +1,67 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <span>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace Core::Aes {
+
+constexpr size_t kBlockSize = 16;
+constexpr size_t kRounds = 10;
+
+using Block = std::array<uint8_t, kBlockSize>;
+using Key = std::array<uint8_t, kBlockSize>;
+using RoundKeys = std::array<Block, kRounds + 1>;
+
+// AES-128 decryption of independent blocks (ECB), which is how the encrypted payload of AirPods
+// advertisements is decrypted. Only decryption is needed, so there is no encryptor.
+//
+// Blocks are decrypted with AES-NI if the CPU supports it, four at a time so their rounds are
+// pipelined, otherwise with a portable implementation.
+//
+class Decryptor
+{
+public:
+    // `allowHardware` is for comparing both implementations
+    //
+    explicit Decryptor(const Key &key, bool allowHardware = true);
+
+    // In place
+    //
+    void Decrypt(std::span<Block> blocks) const;
+
+    inline bool IsHardwareAccelerated() const
+    {
+        return _hardware;
+    }
+
+    // 32 hex digits, spaces, colons and dashes between them are ignored
+    //
+    static std::optional<Key> ParseKey(std::string_view hex);
+
+private:
+    RoundKeys _roundKeys;
+    RoundKeys _hardwareRoundKeys; // For `aesdec`, in the order they are used
+    bool _hardware{false};
+};
+} // namespace Core::Aes
@@ -26,6 +26,8 @@
 
 #include "Bluetooth.h"
 #include "GlobalMedia.h"
+#include "Trace.h"
+#include "Metrics.h"
 #include "../Helper.h"
 #include "../Logger.h"
 #include "../Assert.h"
@@ -36,372 +38,134 @@ using namespace Core;
 using namespace std::chrono_literals;
 
 namespace Core::AirPods {
-namespace Details {
 
 //
-// Advertisement
+// Manager
 //
 
-bool Advertisement::IsDesiredAdv(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
-{
-    auto iter = data.manufacturerDataMap.find(AppleCP::VendorId);
-    if (iter == data.manufacturerDataMap.end()) {
-        return false;
-    }
-
-    const auto &manufacturerData = (*iter).second;
-    if (!AppleCP::AirPods::IsValid(manufacturerData)) {
-        return false;
-    }
-
-    return true;
-}
-
-Advertisement::Advertisement(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
+Manager::Manager()
 {
-    APD_ASSERT(IsDesiredAdv(data));
-    _data = data;
+    SetWatcher(std::make_unique<Bluetooth::AdvertisementWatcher>());
 
-    auto protocol = AppleCP::As<AppleCP::AirPods>(GetMfrData());
-    APD_ASSERT(protocol.has_value());
-    _protocol = std::move(protocol.value());
-
-    // Store state
+    // The state manager is only fed from `AdvConsumerThread`, which holds `_mutex` while passing
+    // the batches drained from `_advQueue` to `OnAdvBatch`
     //
+    _stateMgr.CbStateChanged() += [this](const auto &updateEvent) { OnStateChanged(updateEvent); };
 
-    _state.model = _protocol.GetModel();
-    _state.side = _protocol.GetBroadcastedSide();
-
-    _state.pods.left.battery = _protocol.GetLeftBattery();
-    _state.pods.left.isCharging = _protocol.IsLeftCharging();
-    _state.pods.left.isInEar = _protocol.IsLeftInEar();
-
-    _state.pods.right.battery = _protocol.GetRightBattery();
-    _state.pods.right.isCharging = _protocol.IsRightCharging();
-    _state.pods.right.isInEar = _protocol.IsRightInEar();
-
-    _state.caseBox.battery = _protocol.GetCaseBattery();
-    _state.caseBox.isCharging = _protocol.IsCaseCharging();
-
-    _state.caseBox.isBothPodsInCase = _protocol.IsBothPodsInCase();
-    _state.caseBox.isLidOpened = _protocol.IsLidOpened();
-
-    if (_state.pods.left.battery.Available()) {
-        _state.pods.left.battery = _state.pods.left.battery.Value() * 10;
-    }
-    if (_state.pods.right.battery.Available()) {
-        _state.pods.right.battery = _state.pods.right.battery.Value() * 10;
-    }
-    if (_state.caseBox.battery.Available()) {
-        _state.caseBox.battery = _state.caseBox.battery.Value() * 10;
-    }
-}
-
-int16_t Advertisement::GetRssi() const
-{
-    return _data.rssi;
-}
-
-const auto &Advertisement::GetTimestamp() const
-{
-    return _data.timestamp;
-}
+    _stateMgr.CbDisconnected() += [] { ApdApp->GetMainWindow()->DisconnectSafely(); };
 
-auto Advertisement::GetAddress() const -> AddressType
-{
-    return _data.address;
+    _advConsumerThread = std::thread{&Manager::AdvConsumerThread, this};
 }
 
-std::vector<uint8_t> Advertisement::GetDesensitizedData() const
+Manager::~Manager()
 {
-    auto desensitizedData = _protocol.Desensitize();
-
-    std::vector<uint8_t> result(sizeof(desensitizedData), 0);
-    std::memcpy(result.data(), &desensitizedData, sizeof(desensitizedData));
-    return result;
+    _advQueue.Close();
+    _advConsumerThread.join();
 }
 
-auto Advertisement::GetAdvState() const -> const AdvState &
-{
-    return _state;
-}
-
-const std::vector<uint8_t> &Advertisement::GetMfrData() const
-{
-    auto iter = _data.manufacturerDataMap.find(AppleCP::VendorId);
-    APD_ASSERT(iter != _data.manufacturerDataMap.end());
-
-    return (*iter).second;
-}
-
-//
-// StateManager
-//
-
-StateManager::StateManager()
-{
-    _lostTimer.Start(10s, [this] {
-        std::lock_guard<std::mutex> lock{_mutex};
-        DoLost();
-    });
-
-    _stateResetTimer.left.Start(10s, [this] {
-        std::lock_guard<std::mutex> lock{_mutex};
-        DoStateReset(Side::Left);
-    });
-
-    _stateResetTimer.right.Start(10s, [this] {
-        std::lock_guard<std::mutex> lock{_mutex};
-        DoStateReset(Side::Right);
-    });
-}
-
-std::optional<State> StateManager::GetCurrentState() const
+auto Manager::GetStatistics() -> Statistics
 {
     std::lock_guard<std::mutex> lock{_mutex};
-    return _cachedState;
-}
 
-auto StateManager::OnAdvReceived(Advertisement adv) -> std::optional<UpdateEvent>
-{
-    std::lock_guard<std::mutex> lock{_mutex};
-
-    if (!IsPossibleDesiredAdv(adv)) {
-        LOG(Warn, "This adv may not be broadcast from the device we desire.");
-        return std::nullopt;
-    }
-
-    UpdateAdv(std::move(adv));
-    return UpdateState();
-}
-
-void StateManager::Disconnect()
-{
-    std::lock_guard<std::mutex> lock{_mutex};
-
-    LOG(Info, "StateManager: Disconnect.");
-    ResetAll();
-}
-
-void StateManager::OnRssiMinChanged(int16_t rssiMin)
-{
-    std::lock_guard<std::mutex> lock{_mutex};
-    _rssiMin = rssiMin;
+    return Statistics{
+        .watcher = _adWatcher->GetStatistics(),
+        .dropped = _droppedCount.load(std::memory_order_relaxed),
+        .notDesired = _notDesiredCount,
+        .disconnected = _disconnectedCount,
+        .stateMgr = _stateMgr.GetStatistics(),
+        .timer = Helper::Timer::GetStatistics(),
+    };
 }
 
-bool StateManager::IsPossibleDesiredAdv(const Advertisement &adv) const
+auto Manager::GetSignal() -> Helper::Sides<std::optional<Details::StateManager::Signal>>
 {
-    const auto advRssi = adv.GetRssi();
-    if (advRssi < _rssiMin) {
-        LOG(Warn,
-            "IsPossibleDesiredAdv returns false. Reason: RSSI is less than the limit. "
-            "curr: '{}' min: '{}'",
-            advRssi, _rssiMin);
-        return false;
-    }
-
-    const auto &advState = adv.GetAdvState();
-
-    auto &lastAdv = advState.side == Side::Left ? _adv.left : _adv.right;
-    auto &lastAnotherAdv = advState.side == Side::Left ? _adv.right : _adv.left;
-
-    // If the Random Non-resolvable Address of our devices is changed
-    // or the packet is sent from another device that it isn't ours
-    //
-    if (lastAdv.has_value() && lastAdv->first.GetAddress() != adv.GetAddress()) {
-        const auto &lastAdvState = lastAdv->first.GetAdvState();
-
-        if (advState.model != lastAdvState.model) {
-            LOG(Warn, "IsPossibleDesiredAdv returns false. Reason: model new='{}' old='{}'",
-                Helper::ToString(advState.model), Helper::ToString(lastAdvState.model));
-            return false;
-        }
-
-        Battery::ValueType leftBatteryDiff = 0, rightBatteryDiff = 0, caseBatteryDiff = 0;
-
-        using SignedBatteryValueT = std::make_signed_t<Battery::ValueType>;
-
-        if (advState.pods.left.battery.Available() && lastAdvState.pods.left.battery.Available()) {
-            leftBatteryDiff = std::abs(
-                static_cast<SignedBatteryValueT>(advState.pods.left.battery.Value()) -
-                static_cast<SignedBatteryValueT>(lastAdvState.pods.left.battery.Value()));
-        }
-        if (advState.pods.right.battery.Available() && lastAdvState.pods.right.battery.Available())
-        {
-            rightBatteryDiff = std::abs(
-                static_cast<SignedBatteryValueT>(advState.pods.right.battery.Value()) -
-                static_cast<SignedBatteryValueT>(lastAdvState.pods.right.battery.Value()));
-        }
-        if (advState.caseBox.battery.Available() && lastAdvState.caseBox.battery.Available()) {
-            caseBatteryDiff = std::abs(
-                static_cast<SignedBatteryValueT>(advState.caseBox.battery.Value()) -
-                static_cast<SignedBatteryValueT>(lastAdvState.caseBox.battery.Value()));
-        }
-
-        // The battery changes in steps of 1, so the data of two packets in a short time
-        // can not exceed 1, otherwise it is not our device
-        //
-        if (leftBatteryDiff > 1 || rightBatteryDiff > 1 || caseBatteryDiff > 1) {
-            LOG(Warn,
-                "IsPossibleDesiredAdv returns false. Reason: BatteryDiff l='{}' r='{}' c='{}'",
-                leftBatteryDiff, rightBatteryDiff, caseBatteryDiff);
-            return false;
-        }
-
-        int16_t rssiDiff = std::abs(advRssi - lastAdv->first.GetRssi());
-        if (rssiDiff > 50) {
-            LOG(Warn, "IsPossibleDesiredAdv returns false. Reason: Current side rssiDiff '{}'",
-                rssiDiff);
-            return false;
-        }
-
-        LOG(Warn, "Address changed, but it might still be the same device.");
-    }
-
-    if (lastAnotherAdv.has_value()) {
-        int16_t rssiDiff = std::abs(advRssi - lastAnotherAdv->first.GetRssi());
-        if (rssiDiff > 50) {
-            LOG(Warn, "IsPossibleDesiredAdv returns false. Reason: Another side rssiDiff '{}'",
-                rssiDiff);
-            return false;
-        }
-    }
-
-    return true;
+    return _stateMgr.GetSignal();
 }
 
-void StateManager::UpdateAdv(Advertisement adv)
+void Manager::StartScanner()
 {
-    _lostTimer.Reset();
-
-    const auto &advState = adv.GetAdvState();
-
-    if (advState.side == Side::Left) {
-        _stateResetTimer.left.Reset();
-        _adv.left = std::make_pair(std::move(adv), Clock::now());
+    if (!_adWatcher->Start()) {
+        LOG(Warn, "Bluetooth AdvWatcher start failed.");
     }
-    else if (advState.side == Side::Right) {
-        _stateResetTimer.right.Reset();
-        _adv.right = std::make_pair(std::move(adv), Clock::now());
+    else {
+        LOG(Info, "Bluetooth AdvWatcher start succeeded.");
     }
 }
 
-auto StateManager::UpdateState() -> std::optional<UpdateEvent>
+void Manager::StopScanner()
 {
-    Helper::Sides<std::pair<Advertisement::AdvState, Timestamp>> cachedAdvState;
-
-    if (_adv.left.has_value()) {
-        cachedAdvState.left = std::make_pair(_adv.left->first.GetAdvState(), _adv.left->second);
-    }
-    if (_adv.right.has_value()) {
-        cachedAdvState.right = std::make_pair(_adv.right->first.GetAdvState(), _adv.right->second);
+    if (!_adWatcher->Stop()) {
+        LOG(Warn, "AsyncScanner::Stop() failed.");
     }
-
-    State newState;
-
-#define PICK_SIDE(available_condition_with_field)                                                  \
-    [&]() -> decltype(auto) {                                                                      \
-        const Helper::Sides<bool> available = {                                                    \
-            .left = cachedAdvState.left.first.available_condition_with_field,                      \
-            .right = cachedAdvState.right.first.available_condition_with_field,                    \
-        };                                                                                         \
-        if (available.left && available.right) {                                                   \
-            return cachedAdvState.left.second > cachedAdvState.right.second                        \
-                       ? cachedAdvState.left.first                                                 \
-                       : cachedAdvState.right.first;                                               \
-        }                                                                                          \
-        else {                                                                                     \
-            return available.left ? cachedAdvState.left.first : cachedAdvState.right.first;        \
-        }                                                                                          \
-    }()
-
-    newState.model = PICK_SIDE(model != Model::Unknown).model;
-    newState.pods.left = std::move(PICK_SIDE(pods.left.battery.Available()).pods.left);
-    newState.pods.right = std::move(PICK_SIDE(pods.right.battery.Available()).pods.right);
-    newState.caseBox = std::move(PICK_SIDE(caseBox.battery.Available()).caseBox);
-
-#undef PICK_SIDE
-
-    if (newState == _cachedState) {
-        return std::nullopt;
+    else {
+        LOG(Info, "AsyncScanner::Stop() succeeded.");
     }
-
-    auto oldState = std::move(_cachedState);
-    _cachedState = std::move(newState);
-
-    return UpdateEvent{.oldState = std::move(oldState), .newState = _cachedState.value()};
 }
 
-void StateManager::ResetAll()
+bool Manager::StartCapture(const std::filesystem::path &path)
 {
-    if (_cachedState.has_value()) {
-        ApdApp->GetMainWindow()->DisconnectSafely();
-    }
-
-    _adv.left.reset();
-    _adv.right.reset();
-    _cachedState.reset();
+    return _recorder.Open(path);
 }
 
-void StateManager::DoLost()
+void Manager::ReplayCapture(const std::filesystem::path &path, double speed)
 {
-    if (_cachedState.has_value()) {
-        LOG(Info, "StateManager: Device is lost.");
-    }
-    ResetAll();
-}
+    LOG(Info, "Replaying capture file '{}' at speed {}.", path.string(), speed);
 
-void StateManager::DoStateReset(Side side)
-{
-    auto &adv = side == Side::Left ? _adv.left : _adv.right;
-    if (adv.has_value()) {
-        LOG(Info, "StateManager: DoStateReset called. Side: {}", Helper::ToString(side));
-        adv.reset();
-    }
+    SetWatcher(std::make_unique<Bluetooth::ReplayAdvertisementWatcher>(path, speed));
 }
-} // namespace Details
 
+// The previous watcher, if any, must not have been started, so there is still only one producer
+// of `_advQueue`
 //
-// Manager
-//
-
-Manager::Manager()
+void Manager::SetWatcher(std::unique_ptr<Bluetooth::Details::AdvertisementWatcherAbstract> watcher)
 {
-    _adWatcher.CbReceived() += [this](auto &&...args) {
-        std::lock_guard<std::mutex> lock{_mutex};
-        OnAdvertisementReceived(std::forward<decltype(args)>(args)...);
+    _adWatcher = std::move(watcher);
+
+    // Drop everything except AirPods advertisements in the watcher, before they are copied
+    //
+    constexpr static std::array<Bluetooth::ManufacturerDataFilter, 1> filters{{{
+        .companyId = AppleCP::VendorId,
+        .packetType = Helper::ToUnderlying(AppleCP::PacketType::ProximityPairing),
+        .length = AppleCP::AirPods::kSize,
+    }}};
+    _adWatcher->SetFilters(filters);
+
+    // The watcher invokes this callback under its own lock, so there is only one producer
+    //
+    _adWatcher->CbReceived() += [this](const auto &data) {
+        if (!_advQueue.TryPush(data)) {
+            _droppedCount.fetch_add(1, std::memory_order_relaxed);
+            Metrics::Increment(Metrics::Counter::ManagerQueueFull);
+            APD_TRACE(AdvQueueFull, data.address, data.rssi);
+        }
     };
 
-    _adWatcher.CbStateChanged() += [this](auto &&...args) {
+    _adWatcher->CbStateChanged() += [this](auto &&...args) {
         std::lock_guard<std::mutex> lock{_mutex};
         OnAdvWatcherStateChanged(std::forward<decltype(args)>(args)...);
     };
 }
 
-void Manager::StartScanner()
+void Manager::OnRssiMinChanged(int16_t rssiMin)
 {
-    if (!_adWatcher.Start()) {
-        LOG(Warn, "Bluetooth AdvWatcher start failed.");
-    }
-    else {
-        LOG(Info, "Bluetooth AdvWatcher start succeeded.");
-    }
+    std::lock_guard<std::mutex> lock{_mutex};
+    _stateMgr.OnRssiMinChanged(rssiMin);
 }
 
-void Manager::StopScanner()
+void Manager::OnEncryptionKeyChanged(const QString &key)
 {
-    if (!_adWatcher.Stop()) {
-        LOG(Warn, "AsyncScanner::Stop() failed.");
-    }
-    else {
-        LOG(Info, "AsyncScanner::Stop() succeeded.");
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    if (key.isEmpty()) {
+        _stateMgr.OnEncryptionKeyChanged(std::nullopt);
+        return;
     }
-}
 
-void Manager::OnRssiMinChanged(int16_t rssiMin)
-{
-    std::lock_guard<std::mutex> lock{_mutex};
-    _stateMgr.OnRssiMinChanged(rssiMin);
+    auto optKey = Aes::Decryptor::ParseKey(key.toStdString());
+    if (!optKey.has_value()) {
+        LOG(Warn, "The encryption key is not 16 bytes in hex, it is ignored.");
+    }
+    _stateMgr.OnEncryptionKeyChanged(optKey);
 }
 
 void Manager::OnAutomaticEarDetectionChanged(bool enable)
@@ -442,6 +206,8 @@ void Manager::OnBoundDeviceAddressChanged(uint64_t address)
         // See https://github.com/SpriteOvO/AirPodsDesktop/issues/15
         return name.find("Bluetooth") != std::string::npos ? std::string{} : name;
     }());
+    _deviceName.remove(" - Find My");
+    _displayName.reset();
 
     _boundDevice->CbConnectionStatusChanged() += [this](auto &&...args) {
         std::lock_guard<std::mutex> lock{_mutex};
@@ -467,33 +233,42 @@ void Manager::OnBoundDeviceConnectionStateChanged(Bluetooth::DeviceState state)
 
 void Manager::OnStateChanged(Details::StateManager::UpdateEvent updateEvent)
 {
-    const auto &oldState = updateEvent.oldState;
-    auto &newState = updateEvent.newState;
+    using Field = PackedState::Field;
 
-    newState.displayName =
-        _deviceName.isEmpty() ? Helper::ToString(newState.model) : _deviceName.remove(" - Find My");
+    const auto newState = updateEvent.newState.Unpack();
 
-    ApdApp->GetMainWindow()->UpdateStateSafely(newState);
+    ApdApp->GetMainWindow()->UpdateStateSafely(
+        updateEvent.newState, GetDisplayName(newState.model));
+
+    // Only the fields in the XOR of both words have changed
+    //
+    const auto changes = updateEvent.newState.Diff(updateEvent.oldState);
+    const auto oldState = updateEvent.oldState.Unpack();
 
     // Lid opened
     //
     bool newLidOpened = newState.caseBox.isLidOpened && newState.caseBox.isBothPodsInCase;
     bool lidStateSwitched;
-    if (!oldState.has_value()) {
+    if (!updateEvent.oldState.HasValue()) {
         lidStateSwitched = newLidOpened;
     }
-    else {
-        bool oldLidOpened = oldState->caseBox.isLidOpened && oldState->caseBox.isBothPodsInCase;
+    else if (changes.Contains(Field::LidOpened) || changes.Contains(Field::BothPodsInCase)) {
+        bool oldLidOpened = oldState.caseBox.isLidOpened && oldState.caseBox.isBothPodsInCase;
         lidStateSwitched = oldLidOpened != newLidOpened;
     }
+    else {
+        lidStateSwitched = false;
+    }
     if (lidStateSwitched) {
         OnLidOpened(newLidOpened);
     }
 
     // Both in ear
     //
-    if (oldState.has_value()) {
-        bool oldBothInEar = oldState->pods.left.isInEar && oldState->pods.right.isInEar;
+    if (updateEvent.oldState.HasValue() &&
+        (changes.Contains(Field::LeftInEar) || changes.Contains(Field::RightInEar)))
+    {
+        bool oldBothInEar = oldState.pods.left.isInEar && oldState.pods.right.isInEar;
         bool newBothInEar = newState.pods.left.isInEar && newState.pods.right.isInEar;
         if (oldBothInEar != newBothInEar) {
             OnBothInEar(newBothInEar);
@@ -501,6 +276,18 @@ void Manager::OnStateChanged(Details::StateManager::UpdateEvent updateEvent)
     }
 }
 
+// Built once per bound device and model, the GUI then shares the same string instead of getting
+// a new one with every state change
+//
+const QString &Manager::GetDisplayName(Model model)
+{
+    if (!_displayName.has_value() || _displayName->first != model) {
+        _displayName = std::make_pair(
+            model, _deviceName.isEmpty() ? Helper::ToString(model) : _deviceName);
+    }
+    return _displayName->second;
+}
+
 void Manager::OnLidOpened(bool opened)
 {
     auto &mainWindow = ApdApp->GetMainWindow();
@@ -527,27 +314,65 @@ void Manager::OnBothInEar(bool isBothInEar)
     }
 }
 
-bool Manager::OnAdvertisementReceived(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
+void Manager::AdvConsumerThread()
+{
+    Bluetooth::AdvertisementWatcher::ReceivedData data;
+    std::vector<Details::Advertisement> advs;
+    advs.reserve(kAdvBatchMaxSize);
+
+    while (_advQueue.Wait()) {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+
+            advs.clear();
+            while (advs.size() < kAdvBatchMaxSize && _advQueue.TryPop(data)) {
+                auto optAdv = OnAdvertisementReceived(data);
+                if (optAdv.has_value()) {
+                    advs.push_back(std::move(optAdv.value()));
+                }
+            }
+
+            if (!advs.empty()) {
+                _stateMgr.OnAdvBatch(advs);
+            }
+        }
+
+        // The records are only buffered under `_mutex`, the file is written out of it
+        //
+        _recorder.FlushIfFull();
+    }
+}
+
+// Returns the advertisement to be passed to the state manager, if any
+//
+std::optional<Details::Advertisement>
+Manager::OnAdvertisementReceived(const Bluetooth::AdvertisementWatcher::ReceivedData &data)
 {
     if (!Details::Advertisement::IsDesiredAdv(data)) {
-        return false;
+        ++_notDesiredCount;
+        return std::nullopt;
     }
 
     Details::Advertisement adv{data};
+    const auto &desensitizedData = adv.GetDesensitizedData();
+
+    // Only the first 16 bytes, the rest of the desensitized data is zeroed
+    //
+    static_assert(AppleCP::AirPods::Fields::kUnk12Offset <= 16);
+    APD_TRACE(
+        AirPodsAdvReceived, Trace::LoadBytes(desensitizedData, 0),
+        Trace::LoadBytes(desensitizedData, 8), data.address, data.rssi);
 
-    LOG(Trace, "AirPods advertisement received. Data: {}, Address Hash: {}, RSSI: {}",
-        Helper::ToString(adv.GetDesensitizedData()), Helper::Hash(data.address), data.rssi);
+    _recorder.Write(data.timestamp, data.address, data.rssi, desensitizedData);
 
     if (!_deviceConnected) {
         LOG(Info, "AirPods advertisement received, but device disconnected.");
-        return false;
+        ++_disconnectedCount;
+        Metrics::Increment(Metrics::Counter::ManagerDisconnected);
+        return std::nullopt;
     }
 
-    auto optUpdateEvent = _stateMgr.OnAdvReceived(Details::Advertisement{data});
-    if (optUpdateEvent.has_value()) {
-        OnStateChanged(std::move(optUpdateEvent.value()));
-    }
-    return true;
+    return adv;
 }
 
 void Manager::OnAdvWatcherStateChanged(
@@ -18,157 +18,85 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <functional>
 
 #include "Bluetooth.h"
 #include "AppleCP.h"
+#include "Capture.h"
+#include "StateManager.h"
 
 namespace Core::AirPods {
 
-//
-// Structures
-//
-
-namespace Details {
-
-struct BasicState {
-    Battery battery;
-    bool isCharging{false};
-
-    bool operator==(const BasicState &rhs) const = default;
-};
-} // namespace Details
-
-struct PodState : Details::BasicState {
-    bool isInEar{false};
-
-    bool operator==(const PodState &rhs) const = default;
-};
-
-struct CaseState : Details::BasicState {
-    bool isBothPodsInCase{false};
-    bool isLidOpened{false};
-
-    bool operator==(const CaseState &rhs) const = default;
-};
-
-struct PodsState {
-    PodState left, right;
-
-    bool operator==(const PodsState &rhs) const = default;
-};
-
-struct State {
-    Model model{Model::Unknown};
-    PodsState pods;
-    CaseState caseBox;
-    QString displayName;
-
-    bool operator==(const State &rhs) const = default;
-};
-
-//
-// Classes
-//
-
-namespace Details {
-
-class Advertisement
-{
-public:
-    using AddressType = decltype(Bluetooth::AdvertisementWatcher::ReceivedData::address);
-
-    struct AdvState : AirPods::State {
-        Side side;
-    };
-
-    static bool IsDesiredAdv(const Bluetooth::AdvertisementWatcher::ReceivedData &data);
-
-    Advertisement(const Bluetooth::AdvertisementWatcher::ReceivedData &data);
-
-    int16_t GetRssi() const;
-    const auto &GetTimestamp() const;
-    AddressType GetAddress() const;
-    std::vector<uint8_t> GetDesensitizedData() const;
-    const AdvState &GetAdvState() const;
-
-private:
-    Bluetooth::AdvertisementWatcher::ReceivedData _data;
-    AppleCP::AirPods _protocol;
-    AdvState _state;
-
-    const std::vector<uint8_t> &GetMfrData() const;
-};
-
-// AirPods use Random Non-resolvable device addresses for privacy reasons. This means we
-// can't "Remember" the user's AirPods by any device property. Here we track our desired
-// devices in some non-elegant ways, but obviously it is sometimes unreliable.
-//
-class StateManager
+class Manager
 {
 public:
-    struct UpdateEvent {
-        std::optional<State> oldState;
-        State newState;
+    struct Statistics {
+        Bluetooth::AdvertisementWatcher::Statistics watcher;
+        uint64_t dropped{0};      // Dropped because the advertisement queue is full
+        uint64_t notDesired{0};   // Rejected by `Advertisement::IsDesiredAdv`
+        uint64_t disconnected{0}; // Dropped because the bound device is disconnected
+        Details::StateManager::Statistics stateMgr;
+        Helper::Scheduler::Statistics timer;
     };
 
-    StateManager();
-
-    std::optional<State> GetCurrentState() const;
-
-    std::optional<UpdateEvent> OnAdvReceived(Advertisement adv);
-    void Disconnect();
-
-    void OnRssiMinChanged(int16_t rssiMin);
-
-private:
-    using Clock = std::chrono::steady_clock;
-    using Timestamp = std::chrono::time_point<Clock>;
-
-    mutable std::mutex _mutex;
-
-    Helper::Timer _lostTimer;
-    Helper::Sides<Helper::Timer> _stateResetTimer;
-    Helper::Sides<std::optional<std::pair<Advertisement, Timestamp>>> _adv;
-    std::optional<State> _cachedState;
-    int16_t _rssiMin{std::numeric_limits<int16_t>::max()};
-
-    bool IsPossibleDesiredAdv(const Advertisement &adv) const;
-    void UpdateAdv(Advertisement adv);
-    std::optional<UpdateEvent> UpdateState();
-    void ResetAll();
-
-    void DoLost();
-    void DoStateReset(Side side);
-};
-} // namespace Details
-
-class Manager
-{
-public:
     Manager();
+    ~Manager();
+
+    Statistics GetStatistics();
+    Helper::Sides<std::optional<Details::StateManager::Signal>> GetSignal();
 
     void StartScanner();
     void StopScanner();
 
+    bool StartCapture(const std::filesystem::path &path);
+
+    // Replaces the Bluetooth watcher with one replaying `path` at `speed`, see
+    // `ReplayAdvertisementWatcher`, so the whole pipeline runs from a capture. Must be called
+    // before `StartScanner`.
+    //
+    void ReplayCapture(const std::filesystem::path &path, double speed);
+
     void OnRssiMinChanged(int16_t rssiMin);
+    void OnEncryptionKeyChanged(const QString &key);
     void OnAutomaticEarDetectionChanged(bool enable);
     void OnBoundDeviceAddressChanged(uint64_t address);
 
 private:
+    constexpr static size_t kAdvQueueCapacity = 64;
+    constexpr static size_t kAdvBatchMaxSize = 16;
+
     std::mutex _mutex;
-    Bluetooth::AdvertisementWatcher _adWatcher;
+
+    // Advertisements are handed off from the watcher callback to `AdvConsumerThread` through the
+    // queue, so the Bluetooth thread never waits for `_mutex`. It must outlive `_adWatcher`.
+    //
+    Helper::SpscRing<Bluetooth::AdvertisementReceivedData, kAdvQueueCapacity> _advQueue;
+    std::atomic<uint64_t> _droppedCount{0};
+
+    std::unique_ptr<Bluetooth::Details::AdvertisementWatcherAbstract> _adWatcher;
     Details::StateManager _stateMgr;
+    Capture::Recorder _recorder;
     std::optional<Bluetooth::Device> _boundDevice;
     QString _deviceName;
+    std::optional<std::pair<Model, QString>> _displayName;
     bool _deviceConnected{false};
     bool _automaticEarDetection{false};
+    uint64_t _notDesiredCount{0}, _disconnectedCount{0};
+    std::thread _advConsumerThread;
 
     void OnBoundDeviceConnectionStateChanged(Bluetooth::DeviceState state);
     void OnStateChanged(Details::StateManager::UpdateEvent updateEvent);
+    const QString &GetDisplayName(Model model);
     void OnLidOpened(bool opened);
     void OnBothInEar(bool isBothInEar);
-    bool OnAdvertisementReceived(const Bluetooth::AdvertisementWatcher::ReceivedData &data);
+    void AdvConsumerThread();
+    void SetWatcher(std::unique_ptr<Bluetooth::Details::AdvertisementWatcherAbstract> watcher);
+    std::optional<Details::Advertisement>
+    OnAdvertisementReceived(const Bluetooth::AdvertisementWatcher::ReceivedData &data);
     void OnAdvWatcherStateChanged(
         Bluetooth::AdvertisementWatcher::State state, const std::optional<std::string> &optError);
 };
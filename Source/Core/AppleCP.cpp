@@ -18,25 +18,220 @@
 
 #include "AppleCP.h"
 
+#include <algorithm>
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+    #define APD_APPLECP_SSE2
+    #include <emmintrin.h>
+#endif
+
+#include "../Helper.h"
+
 namespace Core::AppleCP {
 
-bool AirPods::IsValid(const std::vector<uint8_t> &data)
+namespace Impl {
+
+// A packet of AirPods Pro broadcast from the left earphone, both in ear, the left one is 90%, the
+// right one 80%, the case 50% and charging with its lid closed
+//
+constexpr std::array<uint8_t, AirPods::kSize> kSamplePacket{
+    0x07, 0x19, 0x01, 0x0E, 0x20, 0x2B, 0x89, 0x45, 0x09, 0x00, 0x04};
+
+template <Details::Field kField>
+constexpr uint16_t ExtractSample()
 {
-    if (data.size() != sizeof(AirPods)) {
-        return false;
+    return Details::Extract<kField>(AirPods::Data{kSamplePacket});
+}
+
+using Fields = AirPods::Fields;
+
+static_assert(ExtractSample<Fields::packetType>() == 0x07);
+static_assert(ExtractSample<Fields::remainingLength>() == AirPods::kSize - sizeof(Header));
+static_assert(ExtractSample<Fields::modelId>() == 0x200E);
+static_assert(ExtractSample<Fields::unk4>() == 1);
+static_assert(ExtractSample<Fields::currInEar>() == 1);
+static_assert(ExtractSample<Fields::bothInCase>() == 0);
+static_assert(ExtractSample<Fields::anotInEar>() == 1);
+static_assert(ExtractSample<Fields::broadcastFrom>() == 1);
+static_assert(ExtractSample<Fields::currBattery>() == 9);
+static_assert(ExtractSample<Fields::anotBattery>() == 8);
+static_assert(ExtractSample<Fields::caseBattery>() == 5);
+static_assert(ExtractSample<Fields::currCharging>() == 0);
+static_assert(ExtractSample<Fields::caseCharging>() == 1);
+static_assert(ExtractSample<Fields::lidSwitchCount>() == 1);
+static_assert(ExtractSample<Fields::lidClosed>() == 1);
+static_assert(ExtractSample<Fields::unk11>() == 0x04);
+
+inline uint8_t ToBatteryColumn(const Core::AirPods::Battery &battery)
+{
+    return battery.Available() ? static_cast<uint8_t>(battery.Value() * 10)
+                               : AirPodsColumns::kBatteryUnavailable;
+}
+
+// Decodes the rows from `begin` to the end, the columns are already sized
+//
+inline void DecodeRows(std::span<const AirPods> packets, AirPodsColumns &columns, size_t begin)
+{
+    for (size_t i = begin; i < packets.size(); ++i) {
+        const auto &packet = packets[i];
+
+        columns.model[i] = packet.GetModel();
+        columns.side[i] = packet.GetBroadcastedSide();
+        columns.leftBattery[i] = ToBatteryColumn(packet.GetLeftBattery());
+        columns.rightBattery[i] = ToBatteryColumn(packet.GetRightBattery());
+        columns.caseBattery[i] = ToBatteryColumn(packet.GetCaseBattery());
+        columns.leftCharging[i] = packet.IsLeftCharging();
+        columns.rightCharging[i] = packet.IsRightCharging();
+        columns.caseCharging[i] = packet.IsCaseCharging();
+        columns.leftInEar[i] = packet.IsLeftInEar();
+        columns.rightInEar[i] = packet.IsRightInEar();
+        columns.bothInCase[i] = packet.IsBothPodsInCase();
+        columns.lidOpened[i] = packet.IsLidOpened();
+    }
+}
+
+#if defined APD_APPLECP_SSE2
+
+// The vectorized path works on whole bytes, it expects the fields to be laid out like this
+//
+static_assert(Fields::currInEar.offset == Fields::broadcastFrom.offset);
+static_assert(Fields::anotInEar.offset == Fields::broadcastFrom.offset);
+static_assert(Fields::bothInCase.offset == Fields::broadcastFrom.offset);
+static_assert(Fields::anotBattery.offset == Fields::currBattery.offset);
+static_assert(Fields::currBattery.shift == 0 && Fields::currBattery.width == 4);
+static_assert(Fields::anotBattery.shift == 4 && Fields::anotBattery.width == 4);
+static_assert(Fields::caseBattery.shift == 0 && Fields::caseBattery.width == 4);
+static_assert(Fields::currCharging.offset == Fields::caseBattery.offset);
+static_assert(Fields::anotCharging.offset == Fields::caseBattery.offset);
+static_assert(Fields::caseCharging.offset == Fields::caseBattery.offset);
+
+namespace Sse2 {
+
+constexpr size_t kLanes = 16;
+
+// 0xFF in the lanes where the bit is set, 0 elsewhere
+//
+template <Details::Field kField>
+inline __m128i TestBit(__m128i bytes)
+{
+    static_assert(kField.width == 1);
+
+    const auto mask = _mm_set1_epi8(static_cast<char>(1 << kField.shift));
+    return _mm_cmpeq_epi8(_mm_and_si128(bytes, mask), mask);
+}
+
+inline __m128i Select(__m128i condition, __m128i ifTrue, __m128i ifFalse)
+{
+    return _mm_or_si128(_mm_and_si128(condition, ifTrue), _mm_andnot_si128(condition, ifFalse));
+}
+
+inline __m128i LowNibble(__m128i bytes)
+{
+    return _mm_and_si128(bytes, _mm_set1_epi8(0x0F));
+}
+
+inline __m128i HighNibble(__m128i bytes)
+{
+    return _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+}
+
+inline __m128i ToBool(__m128i condition)
+{
+    return _mm_and_si128(condition, _mm_set1_epi8(1));
+}
+
+// [0, 10] to percent, anything else to `kBatteryUnavailable`
+//
+inline __m128i ToBattery(__m128i raw)
+{
+    const auto unavailable = _mm_cmpgt_epi8(raw, _mm_set1_epi8(10));
+    const auto x2 = _mm_add_epi8(raw, raw);
+    const auto x8 = _mm_add_epi8(_mm_add_epi8(x2, x2), _mm_add_epi8(x2, x2));
+    return _mm_or_si128(_mm_add_epi8(x8, x2), unavailable);
+}
+
+inline void Store(std::vector<uint8_t> &column, size_t index, __m128i value)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(column.data() + index), value);
+}
+
+// Gathers the bit-field bytes of 16 packets into vectors, then extracts every field of all of
+// them at once. Returns the number of rows decoded.
+//
+inline size_t DecodeRows(std::span<const AirPods> packets, AirPodsColumns &columns)
+{
+    size_t i = 0;
+
+    for (; i + kLanes <= packets.size(); i += kLanes) {
+        alignas(16) uint8_t status[kLanes], battery[kLanes], charging[kLanes], lid[kLanes];
+
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            const auto &packet = packets[i + lane];
+            const auto data = packet.GetData();
+
+            status[lane] = data[Fields::broadcastFrom.offset];
+            battery[lane] = data[Fields::currBattery.offset];
+            charging[lane] = data[Fields::caseBattery.offset];
+            lid[lane] = data[Fields::lidClosed.offset];
+
+            columns.model[i + lane] = packet.GetModel();
+            columns.side[i + lane] = packet.GetBroadcastedSide();
+        }
+
+        const auto statusBytes = _mm_load_si128(reinterpret_cast<const __m128i *>(status));
+        const auto batteryBytes = _mm_load_si128(reinterpret_cast<const __m128i *>(battery));
+        const auto chargingBytes = _mm_load_si128(reinterpret_cast<const __m128i *>(charging));
+        const auto lidBytes = _mm_load_si128(reinterpret_cast<const __m128i *>(lid));
+
+        const auto left = TestBit<Fields::broadcastFrom>(statusBytes);
+
+        const auto currBattery = ToBattery(LowNibble(batteryBytes));
+        const auto anotBattery = ToBattery(HighNibble(batteryBytes));
+        Store(columns.leftBattery, i, Select(left, currBattery, anotBattery));
+        Store(columns.rightBattery, i, Select(left, anotBattery, currBattery));
+        Store(columns.caseBattery, i, ToBattery(LowNibble(chargingBytes)));
+
+        const auto currCharging = TestBit<Fields::currCharging>(chargingBytes);
+        const auto anotCharging = TestBit<Fields::anotCharging>(chargingBytes);
+        const auto leftCharging = Select(left, currCharging, anotCharging);
+        const auto rightCharging = Select(left, anotCharging, currCharging);
+        Store(columns.leftCharging, i, ToBool(leftCharging));
+        Store(columns.rightCharging, i, ToBool(rightCharging));
+        Store(columns.caseCharging, i, ToBool(TestBit<Fields::caseCharging>(chargingBytes)));
+
+        // See `AirPods::IsLeftInEar`
+        //
+        const auto currInEar = TestBit<Fields::currInEar>(statusBytes);
+        const auto anotInEar = TestBit<Fields::anotInEar>(statusBytes);
+        Store(
+            columns.leftInEar, i,
+            ToBool(_mm_andnot_si128(leftCharging, Select(left, currInEar, anotInEar))));
+        Store(
+            columns.rightInEar, i,
+            ToBool(_mm_andnot_si128(rightCharging, Select(left, anotInEar, currInEar))));
+
+        Store(columns.bothInCase, i, ToBool(TestBit<Fields::bothInCase>(statusBytes)));
+        Store(
+            columns.lidOpened, i,
+            _mm_andnot_si128(TestBit<Fields::lidClosed>(lidBytes), _mm_set1_epi8(1)));
     }
 
-    constexpr uint8_t shouldRemainingLength =
-        sizeof(AirPods) - (offsetof(Header, remainingLength) + sizeof(Header::remainingLength));
+    return i;
+}
+} // namespace Sse2
+#endif
+} // namespace Impl
 
-    Header *packet = (Header *)(data.data());
-    if (packet->packetType != PacketType::ProximityPairing ||
-        packet->remainingLength != shouldRemainingLength)
-    {
+bool AirPods::IsValid(std::span<const uint8_t> data)
+{
+    if (data.size() != kSize) {
         return false;
     }
 
-    return true;
+    const Data packet{data.data(), kSize};
+    return Details::Extract<Fields::packetType>(packet) ==
+               Helper::ToUnderlying(PacketType::ProximityPairing) &&
+           Details::Extract<Fields::remainingLength>(packet) == kSize - sizeof(Header);
 }
 
 Core::AirPods::Model AirPods::GetModel(uint16_t modelId)
@@ -75,91 +270,70 @@ Core::AirPods::Model AirPods::GetModel(uint16_t modelId)
     }
 }
 
-Core::AirPods::Side AirPods::GetBroadcastedSide() const
-{
-    return broadcastFrom == 1 ? Core::AirPods::Side::Left : Core::AirPods::Side::Right;
-}
-
-bool AirPods::IsLeftBroadcasted() const
-{
-    return GetBroadcastedSide() == Core::AirPods::Side::Left;
-}
-
-bool AirPods::IsRightBroadcasted() const
-{
-    return GetBroadcastedSide() == Core::AirPods::Side::Right;
-}
-
-Core::AirPods::Model AirPods::GetModel() const
-{
-    return GetModel(modelId);
-}
-
-Core::AirPods::Battery AirPods::GetLeftBattery() const
+auto AirPods::DecodeExactBatteries(
+    std::span<const uint8_t, Fields::kUnk12Size> decrypted, Core::AirPods::Side broadcastedSide)
+    -> ExactBatteries
 {
-    const auto val = (IsLeftBroadcasted() ? battery.curr : battery.anot);
-    return (val >= 0 && val <= 10) ? val : Core::AirPods::Battery{};
-}
-
-Core::AirPods::Battery AirPods::GetRightBattery() const
-{
-    const auto val = (IsRightBroadcasted() ? battery.curr : battery.anot);
-    return (val >= 0 && val <= 10) ? val : Core::AirPods::Battery{};
-}
-
-Core::AirPods::Battery AirPods::GetCaseBattery() const
-{
-    const auto val = battery.caseBox;
-    return (val >= 0 && val <= 10) ? val : Core::AirPods::Battery{};
-}
+    // The charging bit is also in the clear part of the packet
+    //
+    const auto battery = [](uint8_t value) {
+        const uint8_t percent = value & 0x7F;
+        return percent <= 100 ? Core::AirPods::Battery{percent} : Core::AirPods::Battery{};
+    };
 
-bool AirPods::IsLeftCharging() const
-{
-    return (IsLeftBroadcasted() ? battery.currCharging : battery.anotCharging) != 0;
+    const bool leftBroadcasted = broadcastedSide == Core::AirPods::Side::Left;
+    return ExactBatteries{
+        .left = battery(decrypted[leftBroadcasted ? 1 : 2]),
+        .right = battery(decrypted[leftBroadcasted ? 2 : 1]),
+        .caseBox = battery(decrypted[3]),
+    };
 }
 
-bool AirPods::IsRightCharging() const
+auto AirPods::Desensitize() const -> DesensitizedData
 {
-    return (IsRightBroadcasted() ? battery.currCharging : battery.anotCharging) != 0;
-}
+    DesensitizedData result;
+    std::copy(_data.begin(), _data.end(), result.begin());
 
-bool AirPods::IsBothPodsInCase() const
-{
-    return bothInCase;
-}
+    // This field may be some kind of hash or encrypted payload.
+    // So it may contain personal information about the user.
+    //
+    std::fill_n(result.begin() + Fields::kUnk12Offset, Fields::kUnk12Size, 0);
 
-bool AirPods::IsLidOpened() const
-{
-    return lid.closed == 0;
+    return result;
 }
 
-bool AirPods::IsCaseCharging() const
+void AirPodsColumns::Resize(size_t count)
 {
-    return battery.caseCharging;
+    model.resize(count);
+    side.resize(count);
+    leftBattery.resize(count);
+    rightBattery.resize(count);
+    caseBattery.resize(count);
+    leftCharging.resize(count);
+    rightCharging.resize(count);
+    caseCharging.resize(count);
+    leftInEar.resize(count);
+    rightInEar.resize(count);
+    bothInCase.resize(count);
+    lidOpened.resize(count);
 }
 
-bool AirPods::IsLeftInEar() const
+void DecodeBatch(std::span<const AirPods> packets, AirPodsColumns &columns)
 {
-    // If it's charging, the "ear" will be set in one of the multiple devices, idk why..
-    // so we need to filter it
-    //     vvvvvvvvvvvvvvvvvvvv
-    return !IsLeftCharging() && (IsLeftBroadcasted() ? currInEar : anotInEar);
-}
+    columns.Resize(packets.size());
 
-bool AirPods::IsRightInEar() const
-{
-    return !IsRightCharging() && (IsRightBroadcasted() ? currInEar : anotInEar);
+    size_t decoded = 0;
+#if defined APD_APPLECP_SSE2
+    decoded = Impl::Sse2::DecodeRows(packets, columns);
+#endif
+    Impl::DecodeRows(packets, columns, decoded);
 }
 
-AirPods AirPods::Desensitize() const
+namespace Details {
+void DecodeBatchScalar(std::span<const AirPods> packets, AirPodsColumns &columns)
 {
-    auto result = *this;
-
-    // This field may be some kind of hash or encrypted payload.
-    // So it may contain personal information about the user.
-    //
-    std::memset(result.unk12, 0, sizeof(result.unk12));
-
-    return result;
+    columns.Resize(packets.size());
+    Impl::DecodeRows(packets, columns, 0);
 }
+} // namespace Details
 } // namespace Core::AppleCP
@@ -18,7 +18,11 @@
 
 #pragma once
 
+#include <span>
+#include <array>
 #include <vector>
+#include <optional>
+#include <concepts>
 
 #include "Base.h"
 
@@ -26,8 +30,6 @@
 //
 namespace Core::AppleCP {
 
-#pragma pack(push)
-#pragma pack(1)
 enum class PacketType : uint8_t {
     AirPrint = 0x3,
     AirDrop = 0x5,
@@ -63,9 +65,40 @@ struct Header {
     PacketType packetType;
     uint8_t remainingLength; // Remaining length of this packet
 };
+static_assert(sizeof(Header) == 2);
 
 constexpr uint16_t VendorId = 76;
 
+namespace Details {
+
+// Describes where a field is stored in a packet. Bits are numbered from the least significant
+// one, and a field wider than the rest of its byte continues in the next byte, little-endian.
+//
+struct Field {
+    size_t offset;     // In bytes, from the beginning of the packet
+    uint8_t shift{0};  // In bits, inside the byte at `offset`
+    uint8_t width{8};  // In bits, up to 16
+};
+
+// Reads a field from the raw bytes, so the result does not depend on how a compiler lays out
+// bit-fields or packed structs
+//
+template <Field kField, size_t kExtent>
+constexpr uint16_t Extract(std::span<const uint8_t, kExtent> data)
+{
+    static_assert(kField.width > 0 && kField.shift + kField.width <= 16);
+
+    constexpr size_t kBytes = kField.shift + kField.width > 8 ? 2 : 1;
+    static_assert(kExtent == std::dynamic_extent || kField.offset + kBytes <= kExtent);
+
+    uint32_t value = data[kField.offset];
+    if constexpr (kBytes == 2) {
+        value |= static_cast<uint32_t>(data[kField.offset + 1]) << 8;
+    }
+    return static_cast<uint16_t>((value >> kField.shift) & ((1u << kField.width) - 1));
+}
+} // namespace Details
+
 // About "Flipped":
 //
 //      In other similar projects, you may see a variable called "IsFlipped".
@@ -97,79 +130,250 @@ constexpr uint16_t VendorId = 76;
 //      one earphone is working and the other is charging (lid opened), the Bluetooth device in
 //      both earphones is made discoverable, and the battery of the case is sent and synced.
 //
-class AirPods : Header
+// This is a view of the packet bytes, it does not copy them, so they must outlive it.
+//
+class AirPods
 {
 public:
-    static bool IsValid(const std::vector<uint8_t> &data);
+    constexpr static size_t kSize = 27;
+
+    using Data = std::span<const uint8_t, kSize>;
+    using DesensitizedData = std::array<uint8_t, kSize>;
+
+    // The packet layout, the fields named "unk" are unknown
+    //
+    struct Fields {
+        using Field = Details::Field;
+
+        constexpr static Field packetType{.offset = 0};
+        constexpr static Field remainingLength{.offset = 1};
+        constexpr static Field unk1{.offset = 2};
+        constexpr static Field modelId{.offset = 3, .width = 16};
+
+        constexpr static Field unk4{.offset = 5, .shift = 0, .width = 1};
+        constexpr static Field currInEar{.offset = 5, .shift = 1, .width = 1};
+        constexpr static Field bothInCase{.offset = 5, .shift = 2, .width = 1};
+        constexpr static Field anotInEar{.offset = 5, .shift = 3, .width = 1};
+        constexpr static Field unk6{.offset = 5, .shift = 4, .width = 1};
+        // This advertisement is broadcast from which earphone
+        constexpr static Field broadcastFrom{.offset = 5, .shift = 5, .width = 1};
+        constexpr static Field unk7{.offset = 5, .shift = 6, .width = 1};
+        constexpr static Field unk8{.offset = 5, .shift = 7, .width = 1};
+
+        // Battery remaining [0, 10], otherwise unavailable
+        constexpr static Field currBattery{.offset = 6, .shift = 0, .width = 4};
+        constexpr static Field anotBattery{.offset = 6, .shift = 4, .width = 4};
+        constexpr static Field caseBattery{.offset = 7, .shift = 0, .width = 4};
+        // If it's charging (value != 0)
+        constexpr static Field currCharging{.offset = 7, .shift = 4, .width = 1};
+        constexpr static Field anotCharging{.offset = 7, .shift = 5, .width = 1};
+        constexpr static Field caseCharging{.offset = 7, .shift = 6, .width = 1};
+        constexpr static Field unk9{.offset = 7, .shift = 7, .width = 1};
+
+        // This count increases if the lid opened or closed once, and resets if overflow or no
+        // longer broadcasting advertisements
+        constexpr static Field lidSwitchCount{.offset = 8, .shift = 0, .width = 3};
+        constexpr static Field lidClosed{.offset = 8, .shift = 3, .width = 1};
+        constexpr static Field unk10{.offset = 8, .shift = 4, .width = 4};
+
+        // Untested because I don't have a device other than white
+        constexpr static Field color{.offset = 9};
+        constexpr static Field unk11{.offset = 10};
+
+        // Hash or encrypted payload, 16 bytes
+        constexpr static size_t kUnk12Offset = 11;
+        constexpr static size_t kUnk12Size = 16;
+    };
+    static_assert(Fields::kUnk12Offset + Fields::kUnk12Size == kSize);
+
+    // The batteries in steps of 1% from the decrypted `unk12`, see `GetEncryptedPayload`
+    //
+    struct ExactBatteries {
+        Core::AirPods::Battery left, right, caseBox;
+    };
+
+    static bool IsValid(std::span<const uint8_t> data);
     static Core::AirPods::Model GetModel(uint16_t modelId);
 
-    Core::AirPods::Side GetBroadcastedSide() const;
-    bool IsLeftBroadcasted() const;
-    bool IsRightBroadcasted() const;
+    // Untested with a real key. The layout comes from the community: the byte 0 is unknown, the
+    // bytes 1 to 3 are the batteries of the broadcasting pod, the other pod and the case, with the
+    // highest bit set while charging.
+    //
+    static ExactBatteries DecodeExactBatteries(
+        std::span<const uint8_t, Fields::kUnk12Size> decrypted,
+        Core::AirPods::Side broadcastedSide);
+
+    constexpr explicit AirPods(Data data) : _data{data} {}
+
+    template <Details::Field kField>
+    constexpr uint16_t Get() const
+    {
+        return Details::Extract<kField>(_data);
+    }
+
+    inline Core::AirPods::Side GetBroadcastedSide() const
+    {
+        return Get<Fields::broadcastFrom>() == 1 ? Core::AirPods::Side::Left
+                                                 : Core::AirPods::Side::Right;
+    }
+
+    inline bool IsLeftBroadcasted() const
+    {
+        return Get<Fields::broadcastFrom>() == 1;
+    }
+
+    inline bool IsRightBroadcasted() const
+    {
+        return !IsLeftBroadcasted();
+    }
+
+    inline Core::AirPods::Model GetModel() const
+    {
+        return GetModel(Get<Fields::modelId>());
+    }
+
+    inline Color GetColor() const
+    {
+        return static_cast<Color>(Get<Fields::color>());
+    }
+
+    inline uint8_t GetLidSwitchCount() const
+    {
+        return static_cast<uint8_t>(Get<Fields::lidSwitchCount>());
+    }
+
+    inline Core::AirPods::Battery GetLeftBattery() const
+    {
+        return ToBattery(
+            IsLeftBroadcasted() ? Get<Fields::currBattery>() : Get<Fields::anotBattery>());
+    }
+
+    inline Core::AirPods::Battery GetRightBattery() const
+    {
+        return ToBattery(
+            IsRightBroadcasted() ? Get<Fields::currBattery>() : Get<Fields::anotBattery>());
+    }
 
-    Core::AirPods::Model GetModel() const;
+    inline Core::AirPods::Battery GetCaseBattery() const
+    {
+        return ToBattery(Get<Fields::caseBattery>());
+    }
 
-    Core::AirPods::Battery GetLeftBattery() const;
-    Core::AirPods::Battery GetRightBattery() const;
-    Core::AirPods::Battery GetCaseBattery() const;
+    inline bool IsLeftCharging() const
+    {
+        return (IsLeftBroadcasted() ? Get<Fields::currCharging>()
+                                    : Get<Fields::anotCharging>()) != 0;
+    }
 
-    bool IsLeftCharging() const;
-    bool IsRightCharging() const;
-    bool IsCaseCharging() const;
+    inline bool IsRightCharging() const
+    {
+        return (IsRightBroadcasted() ? Get<Fields::currCharging>()
+                                     : Get<Fields::anotCharging>()) != 0;
+    }
 
-    bool IsBothPodsInCase() const;
-    bool IsLidOpened() const;
+    inline bool IsCaseCharging() const
+    {
+        return Get<Fields::caseCharging>() != 0;
+    }
 
-    bool IsLeftInEar() const;
-    bool IsRightInEar() const;
+    inline bool IsBothPodsInCase() const
+    {
+        return Get<Fields::bothInCase>() != 0;
+    }
+
+    inline bool IsLidOpened() const
+    {
+        return Get<Fields::lidClosed>() == 0;
+    }
+
+    // If it's charging, the "ear" will be set in one of the multiple devices, idk why..
+    // so we need to filter it
+    //
+    inline bool IsLeftInEar() const
+    {
+        return !IsLeftCharging() &&
+               (IsLeftBroadcasted() ? Get<Fields::currInEar>() : Get<Fields::anotInEar>()) != 0;
+    }
+
+    inline bool IsRightInEar() const
+    {
+        return !IsRightCharging() &&
+               (IsRightBroadcasted() ? Get<Fields::currInEar>() : Get<Fields::anotInEar>()) != 0;
+    }
+
+    DesensitizedData Desensitize() const;
+
+    // `unk12` is encrypted with AES-128 by a key of the device, which is only exchanged with the
+    // Apple devices it is paired with, so it has to be supplied by the user
+    //
+    inline std::span<const uint8_t, Fields::kUnk12Size> GetEncryptedPayload() const
+    {
+        return _data.subspan<Fields::kUnk12Offset, Fields::kUnk12Size>();
+    }
 
-    AirPods Desensitize() const;
+    inline Data GetData() const
+    {
+        return _data;
+    }
 
 private:
-    uint8_t unk1[1];
-    uint16_t modelId;
-    struct {
-        uint8_t unk4 : 1;
-        uint8_t currInEar : 1;
-        uint8_t bothInCase : 1;
-        uint8_t anotInEar : 1;
-        uint8_t unk6 : 1;
-        uint8_t broadcastFrom : 1; // This advertisement is broadcast from which earphone.
-        uint8_t unk7 : 1;
-        uint8_t unk8 : 1;
-    };
-    struct {
-        uint8_t curr : 4;         // Battery remaining [0, 10], otherwise unavailable
-        uint8_t anot : 4;         // Battery remaining [0, 10], otherwise unavailable
-        uint8_t caseBox : 4;      // Battery remaining [0, 10], otherwise unavailable
-        uint8_t currCharging : 1; // If it's charging (value != 0)
-        uint8_t anotCharging : 1; // If it's charging (value != 0)
-        uint8_t caseCharging : 1; // If it's charging (value != 0)
-        uint8_t unk9 : 1;
-    } battery;
-    struct {
-        uint8_t switchCount : 3; // This count increases if the lid opened or closed once, and
-                                 // resets if overflow or no longer broadcasting advertisements
-        uint8_t closed : 1;
-        uint8_t unk10 : 4;
-    } lid;
-    Color color; // Untested because I don't have a device other than white
-    uint8_t unk11[1];
-    uint8_t unk12[16]; // Hash or encrypted payload
+    Data _data;
+
+    static inline Core::AirPods::Battery ToBattery(uint16_t value)
+    {
+        return value <= 10 ? value : Core::AirPods::Battery{};
+    }
 };
-static_assert(sizeof(AirPods) == 27);
-#pragma pack(pop)
+
+// Decoded `AirPods` packets stored column by column, one row per packet, for the offline
+// analysis of long captures. The values are the same as the `AirPods` accessors, batteries are in
+// percent like in `Core::AirPods::State`.
+//
+struct AirPodsColumns {
+    constexpr static uint8_t kBatteryUnavailable = 0xFF;
+
+    std::vector<Core::AirPods::Model> model;
+    std::vector<Core::AirPods::Side> side;
+    std::vector<uint8_t> leftBattery, rightBattery, caseBattery; // Or `kBatteryUnavailable`
+    std::vector<uint8_t> leftCharging, rightCharging, caseCharging; // 0 or 1
+    std::vector<uint8_t> leftInEar, rightInEar;                     // 0 or 1
+    std::vector<uint8_t> bothInCase, lidOpened;                     // 0 or 1
+
+    inline size_t size() const
+    {
+        return model.size();
+    }
+
+    void Resize(size_t count);
+
+    bool operator==(const AirPodsColumns &rhs) const = default;
+};
+
+// Decodes `packets` into `columns`, replacing their content. The bit-fields are extracted 16
+// packets at a time with SSE2 where available, otherwise packet by packet.
+//
+void DecodeBatch(std::span<const AirPods> packets, AirPodsColumns &columns);
+
+namespace Details {
+// The packet by packet fallback of `DecodeBatch`, exposed to be compared with it
+//
+void DecodeBatchScalar(std::span<const AirPods> packets, AirPodsColumns &columns);
+} // namespace Details
 
 template <class T>
-concept KindOfACPStruct = std::is_base_of_v<Header, T>;
+concept KindOfACPStruct = requires(std::span<const uint8_t> data) {
+    { T::IsValid(data) } -> std::same_as<bool>;
+    T{typename T::Data{data.data(), T::kSize}};
+};
 
+// Returns a view of `data`, it must outlive the result
+//
 template <KindOfACPStruct T>
-std::optional<T> As(const std::vector<uint8_t> &data)
+std::optional<T> As(std::span<const uint8_t> data)
 {
     if (!T::IsValid(data)) {
         return std::nullopt;
     }
-
-    return *(T *)data.data();
+    return T{typename T::Data{data.data(), T::kSize}};
 }
 } // namespace Core::AppleCP
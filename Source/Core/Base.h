@@ -84,6 +84,10 @@ enum class Model : uint32_t {
 
 enum class Side : uint32_t { Left, Right };
 
+// Estimated from the smoothed RSSI, see `Details::RssiFilter`
+//
+enum class Proximity : uint32_t { Unknown, Immediate, Near, Far };
+
 } // namespace Core::AirPods
 
 template <>
@@ -135,3 +139,18 @@ inline QString Helper::ToString<Core::AirPods::Side>(const Core::AirPods::Side &
         return "Unknown";
     }
 }
+
+template <>
+inline QString Helper::ToString<Core::AirPods::Proximity>(const Core::AirPods::Proximity &value)
+{
+    switch (value) {
+    case Core::AirPods::Proximity::Immediate:
+        return "Immediate";
+    case Core::AirPods::Proximity::Near:
+        return "Near";
+    case Core::AirPods::Proximity::Far:
+        return "Far";
+    default:
+        return "Unknown";
+    }
+}
@@ -22,15 +22,18 @@
     #include "Bluetooth_win.h"
 #endif
 
+#include "Bluetooth_replay.h"
+
 template <>
-inline QString Helper::ToString<Core::Bluetooth::AdvertisementWatcher::ReceivedData>(
-    const Core::Bluetooth::AdvertisementWatcher::ReceivedData &value)
+inline QString Helper::ToString<Core::Bluetooth::AdvertisementReceivedData>(
+    const Core::Bluetooth::AdvertisementReceivedData &value)
 {
     QString manufacturerData;
 
-    for (const auto &keyValue : value.manufacturerDataMap) {
-        manufacturerData +=
-            QString{"CompanyId: %1 Bytes: %2"}.arg(keyValue.first).arg(ToString(keyValue.second));
+    for (const auto &section : value.manufacturerData) {
+        manufacturerData += QString{"CompanyId: %1 Bytes: %2"}
+                                .arg(section.companyId)
+                                .arg(ToString(std::span<const uint8_t>{section.data}));
     }
 
     return QString{"rssi: %1 address: %3\nmanufacturerData: %4"}
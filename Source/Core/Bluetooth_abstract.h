@@ -18,8 +18,13 @@
 
 #pragma once
 
+#include <span>
+#include <atomic>
+#include <chrono>
+#include <optional>
 #include <functional>
 
+#include "Metrics.h"
 #include "../Helper.h"
 
 namespace Core::Bluetooth {
@@ -71,18 +76,86 @@ public:
     virtual std::optional<ConcreteDeviceT> FindDevice(uint64_t address) const = 0;
 };
 
-template <class Derived>
+} // namespace Details
+
+struct ManufacturerData {
+    // The payload of a legacy advertising PDU is at most 31 bytes, a manufacturer specific
+    // section will never be larger than it
+    //
+    constexpr static size_t kMaxSize = 31;
+
+    uint16_t companyId{};
+    Helper::StaticVector<uint8_t, kMaxSize> data;
+};
+
+// A manufacturer data section matches the filter if all the specified fields are equal.
+//
+struct ManufacturerDataFilter {
+    uint16_t companyId{};
+    std::optional<uint8_t> packetType; // The first byte of the data
+    std::optional<size_t> length;
+
+    inline bool Match(uint16_t dataCompanyId, std::span<const uint8_t> data) const
+    {
+        if (dataCompanyId != companyId) {
+            return false;
+        }
+        if (length.has_value() && data.size() != length.value()) {
+            return false;
+        }
+        if (packetType.has_value() && (data.empty() || data[0] != packetType.value())) {
+            return false;
+        }
+        return true;
+    }
+};
+
+// Shared by all the advertisement watcher implementations, so the consumers don't care where
+// the packets come from.
+//
+// Stored inline and never allocates, so it's cheap to construct for every packet received,
+// even if most of them are not what we want.
+//
+struct AdvertisementReceivedData {
+    using Timestamp = std::chrono::system_clock::time_point;
+
+    constexpr static size_t kMaxManufacturerDataCount = 8;
+
+    int16_t rssi{};
+    Timestamp timestamp;
+    uint64_t address{};
+    Helper::StaticVector<ManufacturerData, kMaxManufacturerDataCount> manufacturerData;
+
+    inline std::optional<std::span<const uint8_t>> GetManufacturerData(uint16_t companyId) const
+    {
+        for (const auto &section : manufacturerData) {
+            if (section.companyId == companyId) {
+                return std::span<const uint8_t>{section.data};
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+namespace Details {
+
+// Not a template, so the consumers are able to hold any implementation, e.g. `AirPods::Manager`
+// replaying a capture instead of listening to the platform
+//
 class AdvertisementWatcherAbstract
 {
 public:
     enum class State { Started, Stopped };
 
-    struct ReceivedData {
-        int16_t rssi{};
-        typename Derived::Timestamp timestamp;
-        uint64_t address{};
-        std::map<uint16_t, std::vector<uint8_t>> manufacturerDataMap;
+    constexpr static size_t kMaxFilterCount = 4;
+
+    struct Statistics {
+        uint64_t received{0};   // Packets reported by the platform
+        uint64_t filtered{0};   // Packets dropped by the filters, never copied or dispatched
+        uint64_t dispatched{0}; // Packets passed to the `CbReceived` callbacks
     };
+
+    using ReceivedData = AdvertisementReceivedData;
     using FnReceived = std::function<void(const ReceivedData &)>;
     using FnStateChanged = std::function<void(State, const std::optional<std::string> &)>;
 
@@ -100,9 +173,67 @@ public:
     virtual bool Start() = 0;
     virtual bool Stop() = 0;
 
+    // Only the manufacturer data sections matching any of the filters will be kept, and packets
+    // without any kept section will be dropped without invoking `CbReceived`. An empty filter
+    // list keeps everything.
+    //
+    // The filters are read from the receiving thread without locking, so they must be set
+    // before calling `Start()`.
+    //
+    inline bool SetFilters(std::span<const ManufacturerDataFilter> filters)
+    {
+        return _filters.assign(filters);
+    }
+
+    inline Statistics GetStatistics() const
+    {
+        return Statistics{
+            .received = _received.load(std::memory_order_relaxed),
+            .filtered = _filtered.load(std::memory_order_relaxed),
+            .dispatched = _dispatched.load(std::memory_order_relaxed),
+        };
+    }
+
+protected:
+    inline bool IsFilterEnabled() const
+    {
+        return !_filters.empty();
+    }
+
+    inline bool IsDesiredManufacturerData(uint16_t companyId, std::span<const uint8_t> data) const
+    {
+        if (_filters.empty()) {
+            return true;
+        }
+
+        return std::any_of(_filters.begin(), _filters.end(), [&](const auto &filter) {
+            return filter.Match(companyId, data);
+        });
+    }
+
+    inline void CountReceived()
+    {
+        _received.fetch_add(1, std::memory_order_relaxed);
+        Metrics::Increment(Metrics::Counter::WatcherReceived);
+    }
+
+    inline void CountFiltered()
+    {
+        _filtered.fetch_add(1, std::memory_order_relaxed);
+        Metrics::Increment(Metrics::Counter::WatcherFiltered);
+    }
+
+    inline void CountDispatched()
+    {
+        _dispatched.fetch_add(1, std::memory_order_relaxed);
+        Metrics::Increment(Metrics::Counter::WatcherDispatched);
+    }
+
 private:
     Helper::Callback<FnReceived> _cbReceived;
     Helper::Callback<FnStateChanged> _cbStateChanged;
+    Helper::StaticVector<ManufacturerDataFilter, kMaxFilterCount> _filters;
+    std::atomic<uint64_t> _received{0}, _filtered{0}, _dispatched{0};
 };
 } // namespace Details
 } // namespace Core::Bluetooth
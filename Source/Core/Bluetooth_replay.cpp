@@ -0,0 +1,376 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Bluetooth_replay.h"
+
+#include <charconv>
+
+#include "../Assert.h"
+#include "../Logger.h"
+
+namespace Core::Bluetooth {
+
+namespace Impl {
+
+inline std::string_view NextToken(std::string_view &str)
+{
+    const auto begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+        str = {};
+        return {};
+    }
+    str.remove_prefix(begin);
+
+    const auto end = std::min(str.find_first_of(" \t\r"), str.size());
+    const auto token = str.substr(0, end);
+    str.remove_prefix(end);
+    return token;
+}
+
+template <class T>
+inline std::optional<T> ParseNumber(std::string_view str, int base)
+{
+    T value{};
+    const auto end = str.data() + str.size();
+    const auto [ptr, error] = std::from_chars(str.data(), end, value, base);
+    if (str.empty() || error != std::errc{} || ptr != end) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// The watcher replaying on the current thread, if any
+//
+thread_local const ReplayAdvertisementWatcher *tReplayingWatcher{nullptr};
+
+template <class T>
+inline void AppendNumber(std::string &result, T value, int base)
+{
+    char buffer[32];
+    const auto [ptr, error] = std::to_chars(std::begin(buffer), std::end(buffer), value, base);
+    result.append(buffer, ptr);
+}
+
+} // namespace Impl
+
+ReplayAdvertisementWatcher::ReplayAdvertisementWatcher(
+    std::filesystem::path captureFile, double speed, Helper::Scheduler *virtualScheduler)
+    : _captureFile{std::move(captureFile)}, _speed{speed}, _virtualScheduler{virtualScheduler}
+{
+    APD_ASSERT(_virtualScheduler == nullptr || _virtualScheduler->IsVirtual());
+}
+
+ReplayAdvertisementWatcher::~ReplayAdvertisementWatcher()
+{
+    // The replay thread can't be joined from itself, it would be left running on a destroyed
+    // watcher
+    //
+    APD_ASSERT(!IsReplayThread());
+    Stop();
+}
+
+bool ReplayAdvertisementWatcher::Start()
+{
+    // The running replay thread would have to be replaced while it is still running
+    //
+    if (IsReplayThread()) {
+        LOG(Warn, "Replay AdvWatcher can't be restarted from its own callbacks.");
+        return false;
+    }
+
+    Stop();
+
+    std::unique_ptr<Capture::Reader> reader;
+    std::ifstream file;
+
+    if (Capture::IsCaptureFile(_captureFile)) {
+        reader = std::make_unique<Capture::Reader>();
+        if (!reader->Open(_captureFile)) {
+            return false;
+        }
+    }
+    else {
+        file.open(_captureFile);
+        if (!file.is_open()) {
+            LOG(Warn, "Open capture file failed. Path: '{}'", _captureFile.string());
+            return false;
+        }
+    }
+
+    _stop = false;
+    _finished = false;
+    _startTime = Clock::now();
+    _firstTimestamp.reset();
+    if (_virtualScheduler != nullptr) {
+        _virtualStartTime = _virtualScheduler->Now();
+    }
+
+    LOG(Info, "Replay AdvWatcher start succeeded. Path: '{}', Binary: {}, Speed: {}, Virtual: {}",
+        _captureFile.string(), reader != nullptr, _speed, _virtualScheduler != nullptr);
+    CbStateChanged().Invoke(State::Started, std::nullopt);
+
+    if (reader != nullptr) {
+        _thread = std::thread{&ReplayAdvertisementWatcher::BinaryThread, this, std::move(reader)};
+    }
+    else {
+        _thread = std::thread{&ReplayAdvertisementWatcher::TextThread, this, std::move(file)};
+    }
+    return true;
+}
+
+bool ReplayAdvertisementWatcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{_conVarMutex};
+        _stop = true;
+    }
+    _conVar.notify_all();
+
+    Join();
+    return true;
+}
+
+void ReplayAdvertisementWatcher::Wait()
+{
+    std::unique_lock<std::mutex> lock{_conVarMutex};
+    _conVar.wait(lock, [this] { return _finished.load(); });
+}
+
+auto ReplayAdvertisementWatcher::ParseLine(std::string_view line) -> std::optional<ReceivedData>
+{
+    ReceivedData result;
+
+    const auto timestamp = Impl::ParseNumber<int64_t>(Impl::NextToken(line), 10);
+    const auto address = Impl::ParseNumber<uint64_t>(Impl::NextToken(line), 16);
+    const auto rssi = Impl::ParseNumber<int16_t>(Impl::NextToken(line), 10);
+    if (!timestamp.has_value() || !address.has_value() || !rssi.has_value()) {
+        return std::nullopt;
+    }
+
+    result.timestamp = ReceivedData::Timestamp{std::chrono::duration_cast<
+        ReceivedData::Timestamp::duration>(std::chrono::microseconds{timestamp.value()})};
+    result.address = address.value();
+    result.rssi = rssi.value();
+
+    for (auto token = Impl::NextToken(line); !token.empty(); token = Impl::NextToken(line)) {
+        const auto colon = token.find(':');
+        if (colon == std::string_view::npos) {
+            return std::nullopt;
+        }
+
+        const auto companyId = Impl::ParseNumber<uint16_t>(token.substr(0, colon), 16);
+        const auto hex = token.substr(colon + 1);
+        if (!companyId.has_value() || hex.size() % 2 != 0 ||
+            hex.size() / 2 > ManufacturerData::kMaxSize)
+        {
+            return std::nullopt;
+        }
+
+        auto section = result.manufacturerData.emplace_back();
+        if (section == nullptr) {
+            return std::nullopt;
+        }
+
+        section->companyId = companyId.value();
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            const auto byte = Impl::ParseNumber<uint8_t>(hex.substr(i, 2), 16);
+            if (!byte.has_value()) {
+                return std::nullopt;
+            }
+            section->data.push_back(byte.value());
+        }
+    }
+
+    return result;
+}
+
+std::string ReplayAdvertisementWatcher::FormatLine(const ReceivedData &data)
+{
+    std::string result;
+
+    Impl::AppendNumber(
+        result,
+        std::chrono::duration_cast<std::chrono::microseconds>(data.timestamp.time_since_epoch())
+            .count(),
+        10);
+    result += ' ';
+    Impl::AppendNumber(result, data.address, 16);
+    result += ' ';
+    Impl::AppendNumber(result, data.rssi, 10);
+
+    for (const auto &section : data.manufacturerData) {
+        result += ' ';
+        Impl::AppendNumber(result, section.companyId, 16);
+        result += ':';
+        for (uint8_t byte : section.data) {
+            constexpr auto kDigits = "0123456789abcdef";
+            result += kDigits[byte >> 4];
+            result += kDigits[byte & 0xF];
+        }
+    }
+
+    return result;
+}
+
+bool ReplayAdvertisementWatcher::IsReplayThread() const
+{
+    return Impl::tReplayingWatcher == this;
+}
+
+// Stopping from the callbacks leaves the thread to exit by itself, it's joined by the next
+// `Start()` or by the destructor
+//
+void ReplayAdvertisementWatcher::Join()
+{
+    if (_thread.joinable() && !IsReplayThread()) {
+        _thread.join();
+    }
+}
+
+void ReplayAdvertisementWatcher::TextThread(std::ifstream file)
+{
+    Impl::tReplayingWatcher = this;
+
+    std::string line;
+    size_t lineNumber = 0, packetCount = 0;
+
+    while (!_stop && std::getline(file, line)) {
+        ++lineNumber;
+
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line.front() == '#') {
+            continue;
+        }
+
+        auto optData = ParseLine(line);
+        if (!optData.has_value()) {
+            LOG(Warn, "Invalid line in capture file, skip it. Line: {}", lineNumber);
+            continue;
+        }
+
+        if (!WaitForReplayTime(optData->timestamp)) {
+            break;
+        }
+
+        Dispatch(optData.value());
+        ++packetCount;
+    }
+
+    Finish(packetCount);
+}
+
+void ReplayAdvertisementWatcher::BinaryThread(std::unique_ptr<Capture::Reader> reader)
+{
+    Impl::tReplayingWatcher = this;
+
+    size_t packetCount = 0;
+
+    for (const auto &record : *reader) {
+        if (_stop) {
+            break;
+        }
+
+        ReceivedData data;
+        data.rssi = record.rssi;
+        data.timestamp = record.GetTimestamp();
+        data.address = record.addressHash;
+
+        auto section = data.manufacturerData.emplace_back();
+        section->companyId = AppleCP::VendorId;
+        section->data.assign(record.GetPayload());
+
+        if (!WaitForReplayTime(data.timestamp)) {
+            break;
+        }
+
+        Dispatch(data);
+        ++packetCount;
+    }
+
+    Finish(packetCount);
+}
+
+bool ReplayAdvertisementWatcher::WaitForReplayTime(const ReceivedData::Timestamp &timestamp)
+{
+    if (!_firstTimestamp.has_value()) {
+        _firstTimestamp = timestamp;
+    }
+    const auto recordedOffset = timestamp - _firstTimestamp.value();
+
+    // Fire the virtual timers that were due before this packet was received
+    //
+    if (_virtualScheduler != nullptr) {
+        _virtualScheduler->AdvanceTo(
+            _virtualStartTime + std::chrono::duration_cast<Clock::duration>(recordedOffset));
+    }
+
+    if (_speed <= 0) {
+        return !_stop;
+    }
+
+    // Keep the recorded interval between packets
+    //
+    const auto offset = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>{recordedOffset} / _speed);
+
+    std::unique_lock<std::mutex> lock{_conVarMutex};
+    return !_conVar.wait_until(lock, _startTime + offset, [this] { return _stop.load(); });
+}
+
+void ReplayAdvertisementWatcher::Finish(size_t packetCount)
+{
+    LOG(Info, "Replay AdvWatcher finished. Packets: {}, Stopped: {}", packetCount, _stop.load());
+
+    {
+        std::lock_guard<std::mutex> lock{_conVarMutex};
+        _finished = true;
+    }
+    _conVar.notify_all();
+
+    CbStateChanged().Invoke(State::Stopped, std::nullopt);
+}
+
+void ReplayAdvertisementWatcher::Dispatch(const ReceivedData &data)
+{
+    CountReceived();
+
+    if (!IsFilterEnabled()) {
+        CountDispatched();
+        CbReceived().Invoke(data);
+        return;
+    }
+
+    ReceivedData filteredData;
+    filteredData.rssi = data.rssi;
+    filteredData.timestamp = data.timestamp;
+    filteredData.address = data.address;
+
+    for (const auto &section : data.manufacturerData) {
+        if (IsDesiredManufacturerData(section.companyId, section.data)) {
+            filteredData.manufacturerData.push_back(section);
+        }
+    }
+
+    if (filteredData.manufacturerData.empty()) {
+        CountFiltered();
+        return;
+    }
+
+    CountDispatched();
+    CbReceived().Invoke(filteredData);
+}
+} // namespace Core::Bluetooth
@@ -0,0 +1,114 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <string_view>
+#include <condition_variable>
+
+#include "../Helper.h"
+#include "Bluetooth_abstract.h"
+#include "Capture.h"
+
+namespace Benchmark {
+struct WatcherAccess;
+} // namespace Benchmark
+
+namespace Core::Bluetooth {
+
+// Replays a capture file recorded from real devices, so the whole advertisement processing
+// pipeline can be driven without any Bluetooth hardware, even on platforms we don't support yet.
+// The app replays one instead of listening to Bluetooth with `--replay`.
+//
+// The capture file is a text file, each line is a received packet:
+//
+//      <timestamp> <address> <rssi> <company id>:<data> [<company id>:<data> ...]
+//
+//      timestamp   Microseconds since the Unix epoch, in decimal.
+//      address     The Bluetooth address, in hexadecimal.
+//      rssi        The signal strength in dBm, in decimal.
+//      company id  The company ID of a manufacturer data section, in hexadecimal.
+//      data        The bytes of a manufacturer data section, in hexadecimal without separators.
+//
+// Empty lines and lines starting with '#' are ignored.
+//
+// Binary capture files written by `Capture::Recorder` are also accepted, they are detected by
+// the file header. Each record is replayed as an Apple manufacturer data section, and the
+// address is the hashed one stored in the record.
+//
+class ReplayAdvertisementWatcher final
+    : public Details::AdvertisementWatcherAbstract
+{
+public:
+    // `speed` is the playback rate relative to the recorded timing, e.g. `2.0` replays twice as
+    // fast as recorded. `0` replays as fast as possible.
+    //
+    // If `virtualScheduler` is given, it is advanced to the recorded time of each packet before
+    // the packet is dispatched, so the timers it drives follow the capture whatever the speed.
+    //
+    explicit ReplayAdvertisementWatcher(
+        std::filesystem::path captureFile, double speed = 1.0,
+        Helper::Scheduler *virtualScheduler = nullptr);
+    ~ReplayAdvertisementWatcher();
+
+    // The callbacks run on the replay thread. They may call `Stop()`, but `Start()` fails there,
+    // and the watcher must not be destroyed from them.
+    //
+    bool Start() override;
+    bool Stop() override;
+
+    // Blocks until the whole file has been replayed or `Stop()` is called.
+    //
+    void Wait();
+
+    static std::optional<ReceivedData> ParseLine(std::string_view line);
+    static std::string FormatLine(const ReceivedData &data);
+
+private:
+    friend struct ::Benchmark::WatcherAccess;
+
+    std::filesystem::path _captureFile;
+    double _speed;
+    Helper::Scheduler *_virtualScheduler;
+
+    using Clock = std::chrono::steady_clock;
+
+    std::thread _thread;
+    std::atomic<bool> _stop{false}, _finished{true};
+    std::mutex _conVarMutex;
+    std::condition_variable _conVar;
+
+    // Only accessed by the replay thread
+    Clock::time_point _startTime, _virtualStartTime;
+    std::optional<ReceivedData::Timestamp> _firstTimestamp;
+
+    bool IsReplayThread() const;
+    void Join();
+    void TextThread(std::ifstream file);
+    void BinaryThread(std::unique_ptr<Capture::Reader> reader);
+    bool WaitForReplayTime(const ReceivedData::Timestamp &timestamp);
+    void Dispatch(const ReceivedData &data);
+    void Finish(size_t packetCount);
+};
+} // namespace Core::Bluetooth
@@ -20,6 +20,7 @@
 
 #include "../Logger.h"
 #include "Debug.h"
+#include "Trace.h"
 #include "OS/Windows.h"
 
 namespace Core::Bluetooth {
@@ -329,10 +330,13 @@ bool AdvertisementWatcher::Stop()
 
 void AdvertisementWatcher::OnReceived(const BluetoothLEAdvertisementReceivedEventArgs &args)
 {
+    CountReceived();
+
     ReceivedData receivedData;
 
     receivedData.rssi = args.RawSignalStrengthInDBm();
-    receivedData.timestamp = args.Timestamp();
+    receivedData.timestamp = std::chrono::time_point_cast<ReceivedData::Timestamp::duration>(
+        winrt::clock::to_sys(args.Timestamp()));
     receivedData.address = args.BluetoothAddress();
 
     const auto &manufacturerDataArray = args.Advertisement().ManufacturerData();
@@ -341,19 +345,51 @@ void AdvertisementWatcher::OnReceived(const BluetoothLEAdvertisementReceivedEven
         const auto companyId = manufacturerData.CompanyId();
         const auto &data = manufacturerData.Data();
 
-        std::vector<uint8_t> stdData(data.data(), data.data() + data.Length());
+        std::span<const uint8_t> bytes{data.data(), data.Length()};
 
 #if defined APD_DEBUG
         auto overrideAdv = DebugConfig::GetInstance().GetOverrideAdv();
         if (overrideAdv.has_value()) {
-            stdData = std::move(overrideAdv.value());
-            LOG(Trace, "Adv override: {}", Helper::ToString(stdData));
+            bytes = overrideAdv.value();
+            LOG(Trace, "Adv override: {}", Helper::ToString(bytes));
         }
 #endif
 
-        receivedData.manufacturerDataMap.try_emplace(companyId, std::move(stdData));
+        if (!IsDesiredManufacturerData(companyId, bytes)) {
+            continue;
+        }
+
+        // Keep the first one if a company ID appears more than once
+        //
+        if (receivedData.GetManufacturerData(companyId).has_value()) {
+            continue;
+        }
+
+        if (bytes.size() > ManufacturerData::kMaxSize) {
+            APD_TRACE(ManufacturerDataTooLarge, companyId, static_cast<uint32_t>(bytes.size()));
+            continue;
+        }
+
+        auto section = receivedData.manufacturerData.emplace_back();
+        if (section == nullptr) {
+            APD_TRACE(ManufacturerDataTooMany);
+            break;
+        }
+
+        section->companyId = companyId;
+        section->data.assign(bytes);
     }
 
+    if (IsFilterEnabled() && receivedData.manufacturerData.empty()) {
+        CountFiltered();
+        return;
+    }
+
+    CountDispatched();
+    APD_TRACE(
+        AdvDispatched, receivedData.address, receivedData.rssi,
+        static_cast<uint8_t>(receivedData.manufacturerData.size()));
+
     std::lock_guard<std::mutex> lock{_mutex};
     CbReceived().Invoke(receivedData);
 }
@@ -108,11 +108,9 @@ std::optional<Device> FindDevice(uint64_t address);
 } // namespace DeviceManager
 
 class AdvertisementWatcher final
-    : public Details::AdvertisementWatcherAbstract<AdvertisementWatcher>
+    : public Details::AdvertisementWatcherAbstract
 {
 public:
-    using Timestamp = winrt::Windows::Foundation::DateTime;
-
     explicit AdvertisementWatcher();
     ~AdvertisementWatcher();
 
@@ -0,0 +1,283 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Capture.h"
+
+#include <cstring>
+
+#if defined APD_OS_WIN
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include "../Logger.h"
+
+namespace Core::Capture {
+
+bool IsCaptureFile(const std::filesystem::path &path)
+{
+    std::ifstream file{path, std::ios::binary};
+
+    FileHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return false;
+    }
+    return std::memcmp(header.magic, FileHeader{}.magic, sizeof(header.magic)) == 0;
+}
+
+//////////////////////////////////////////////////
+// Recorder
+//
+
+Recorder::~Recorder()
+{
+    Close();
+}
+
+bool Recorder::Open(const std::filesystem::path &path)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    if (_file.is_open()) {
+        _opened.store(false, std::memory_order_relaxed);
+        DoFlush();
+        _file.close();
+    }
+
+    _file.open(path, std::ios::binary | std::ios::trunc);
+    if (!_file.is_open()) {
+        LOG(Warn, "Open capture file for recording failed. Path: '{}'", path.string());
+        return false;
+    }
+
+    FileHeader header;
+    header.recordSize = sizeof(Record);
+    _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    _buffer.clear();
+    _buffer.reserve(kBufferedRecordCount);
+    _opened.store(true, std::memory_order_relaxed);
+
+    LOG(Info, "Capture recorder opened. Path: '{}'", path.string());
+    return true;
+}
+
+void Recorder::Close()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    if (_file.is_open()) {
+        _opened.store(false, std::memory_order_relaxed);
+        DoFlush();
+        _file.close();
+    }
+}
+
+bool Recorder::IsOpened() const
+{
+    return _opened.load(std::memory_order_relaxed);
+}
+
+bool Recorder::Write(
+    const Timestamp &timestamp, uint64_t address, int16_t rssi, std::span<const uint8_t> payload)
+{
+    // Checked without locking first, as it's called for every packet even if nothing is recorded
+    //
+    if (!_opened.load(std::memory_order_relaxed) || payload.size() != sizeof(Record::payload)) {
+        return false;
+    }
+
+    Record record{
+        .timestamp =
+            std::chrono::duration_cast<std::chrono::microseconds>(timestamp.time_since_epoch())
+                .count(),
+        .addressHash = HashAddress(address),
+        .rssi = rssi,
+    };
+    std::memcpy(record.payload, payload.data(), sizeof(record.payload));
+
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    if (!_file.is_open()) {
+        return false;
+    }
+
+    _buffer.push_back(record);
+    return true;
+}
+
+void Recorder::Flush()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    DoFlush();
+}
+
+void Recorder::FlushIfFull()
+{
+    if (!_opened.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (_buffer.size() >= kBufferedRecordCount) {
+        DoFlush();
+    }
+}
+
+void Recorder::DoFlush()
+{
+    if (_buffer.empty() || !_file.is_open()) {
+        return;
+    }
+
+    _file.write(
+        reinterpret_cast<const char *>(_buffer.data()), _buffer.size() * sizeof(Record));
+    _file.flush();
+    _buffer.clear();
+}
+
+//////////////////////////////////////////////////
+// Reader
+//
+
+Reader::~Reader()
+{
+    Close();
+}
+
+bool Reader::Open(const std::filesystem::path &path)
+{
+    Close();
+
+#if defined APD_OS_WIN
+    _file = CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+        _file = nullptr;
+        LOG(Warn, "Open capture file failed. Path: '{}'", path.string());
+        return false;
+    }
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(_file, &fileSize) ||
+        fileSize.QuadPart < static_cast<LONGLONG>(sizeof(FileHeader)))
+    {
+        LOG(Warn, "Capture file is too small. Path: '{}'", path.string());
+        Close();
+        return false;
+    }
+    _size = static_cast<size_t>(fileSize.QuadPart);
+
+    _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping == nullptr) {
+        LOG(Warn, "CreateFileMappingW() failed. LastError: {}", GetLastError());
+        Close();
+        return false;
+    }
+
+    _view = static_cast<const uint8_t *>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (_view == nullptr) {
+        LOG(Warn, "MapViewOfFile() failed. LastError: {}", GetLastError());
+        Close();
+        return false;
+    }
+#else
+    _file = open(path.c_str(), O_RDONLY);
+    if (_file == -1) {
+        LOG(Warn, "Open capture file failed. Path: '{}'", path.string());
+        return false;
+    }
+
+    struct stat fileStat {};
+    if (fstat(_file, &fileStat) != 0 ||
+        fileStat.st_size < static_cast<off_t>(sizeof(FileHeader)))
+    {
+        LOG(Warn, "Capture file is too small. Path: '{}'", path.string());
+        Close();
+        return false;
+    }
+    _size = static_cast<size_t>(fileStat.st_size);
+
+    void *view = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+    if (view == MAP_FAILED) {
+        LOG(Warn, "mmap() failed. errno: {}", errno);
+        Close();
+        return false;
+    }
+    madvise(view, _size, MADV_SEQUENTIAL);
+    _view = static_cast<const uint8_t *>(view);
+#endif
+
+    const auto &header = *reinterpret_cast<const FileHeader *>(_view);
+    if (std::memcmp(header.magic, FileHeader{}.magic, sizeof(header.magic)) != 0 ||
+        header.version != kVersion || header.recordSize != sizeof(Record))
+    {
+        LOG(Warn, "Invalid capture file header. Version: {}, RecordSize: {}", header.version,
+            header.recordSize);
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void Reader::Close()
+{
+#if defined APD_OS_WIN
+    if (_view != nullptr) {
+        UnmapViewOfFile(_view);
+    }
+    if (_mapping != nullptr) {
+        CloseHandle(_mapping);
+        _mapping = nullptr;
+    }
+    if (_file != nullptr) {
+        CloseHandle(_file);
+        _file = nullptr;
+    }
+#else
+    if (_view != nullptr) {
+        munmap(const_cast<uint8_t *>(_view), _size);
+    }
+    if (_file != -1) {
+        close(_file);
+        _file = -1;
+    }
+#endif
+
+    _view = nullptr;
+    _size = 0;
+}
+
+std::span<const Record> Reader::GetRecords() const
+{
+    if (_view == nullptr) {
+        return {};
+    }
+
+    // A partially written record at the end is ignored
+    //
+    const auto count = (_size - sizeof(FileHeader)) / sizeof(Record);
+    return {reinterpret_cast<const Record *>(_view + sizeof(FileHeader)), count};
+}
+} // namespace Core::Capture
@@ -0,0 +1,154 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <bit>
+#include <span>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+#include "AppleCP.h"
+#include "Bluetooth_abstract.h"
+
+// A compact binary format to record the AirPods advertisements we received, so they can be kept
+// for a long time and replayed at a high speed later.
+//
+// The file is a `FileHeader` followed by a sequence of fixed-size `Record`s, all the fields are
+// stored in the host (little-endian) order.
+//
+namespace Core::Capture {
+
+using Timestamp = Bluetooth::AdvertisementReceivedData::Timestamp;
+
+constexpr inline uint32_t kVersion = 1;
+
+// The records are written and mapped as they are in memory, without any byte swapping
+//
+static_assert(std::endian::native == std::endian::little);
+
+struct FileHeader {
+    char magic[4]{'A', 'P', 'D', 'C'};
+    uint16_t version{kVersion};
+    uint16_t recordSize{};
+    uint8_t reserved[8]{};
+};
+static_assert(sizeof(FileHeader) == 16);
+
+struct Record {
+    int64_t timestamp;    // Microseconds since the Unix epoch
+    uint64_t addressHash; // The real address is not stored, see `HashAddress`
+    int16_t rssi;
+    uint8_t payload[AppleCP::AirPods::kSize];
+    uint8_t reserved[3];
+
+    inline Timestamp GetTimestamp() const
+    {
+        return Timestamp{std::chrono::duration_cast<Timestamp::duration>(
+            std::chrono::microseconds{timestamp})};
+    }
+
+    inline std::span<const uint8_t> GetPayload() const
+    {
+        return payload;
+    }
+};
+static_assert(sizeof(Record) == 48);
+static_assert(std::is_trivially_copyable_v<Record>);
+
+// A stable hash on all platforms, unlike `std::hash`
+//
+constexpr uint64_t HashAddress(uint64_t address)
+{
+    // splitmix64 finalizer
+    address = (address ^ (address >> 30)) * 0xBF58476D1CE4E5B9;
+    address = (address ^ (address >> 27)) * 0x94D049BB133111EB;
+    return address ^ (address >> 31);
+}
+
+bool IsCaptureFile(const std::filesystem::path &path);
+
+class Recorder : Helper::NonCopyable
+{
+public:
+    Recorder() = default;
+    ~Recorder();
+
+    bool Open(const std::filesystem::path &path);
+    void Close();
+    bool IsOpened() const;
+
+    // The payload should be desensitized by the caller, see `AppleCP::AirPods::Desensitize`.
+    //
+    // Returns false before building the record if no file is opened. The record is only
+    // buffered, it's written to the file by `Flush` or `FlushIfFull`, so the caller is able to do
+    // the I/O out of its own lock.
+    //
+    bool Write(
+        const Timestamp &timestamp, uint64_t address, int16_t rssi,
+        std::span<const uint8_t> payload);
+    void Flush();
+    void FlushIfFull();
+
+private:
+    constexpr static size_t kBufferedRecordCount = 256;
+
+    std::atomic<bool> _opened{false};
+    std::mutex _mutex;
+    std::ofstream _file;
+    std::vector<Record> _buffer;
+
+    void DoFlush();
+};
+
+// Maps the whole file into memory, the records are accessed directly without copying.
+//
+class Reader : Helper::NonCopyable
+{
+public:
+    Reader() = default;
+    ~Reader();
+
+    bool Open(const std::filesystem::path &path);
+    void Close();
+
+    std::span<const Record> GetRecords() const;
+
+    inline auto begin() const
+    {
+        return GetRecords().begin();
+    }
+
+    inline auto end() const
+    {
+        return GetRecords().end();
+    }
+
+private:
+    const uint8_t *_view{nullptr};
+    size_t _size{0};
+#if defined APD_OS_WIN
+    void *_file{nullptr}, *_mapping{nullptr};
+#else
+    int _file{-1};
+#endif
+};
+} // namespace Core::Capture
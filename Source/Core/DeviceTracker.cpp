@@ -0,0 +1,417 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "DeviceTracker.h"
+
+#include "StateManager.h"
+#include "../Assert.h"
+
+namespace Core::AirPods::Details {
+
+DeviceTracker::DeviceTracker() : _slots(kCapacity)
+{
+    _byAddress.reserve(kCapacity * 2);
+    _byFingerprint.reserve(kCapacity);
+    Clear();
+}
+
+auto DeviceTracker::Lookup(
+    const Advertisement &adv, Timestamp now, std::optional<DeviceId> preferred)
+    -> std::optional<Match>
+{
+    const auto address = adv.GetAddress();
+
+    const auto ownedSide = [&](const Device &owner) -> std::optional<Side> {
+        if (owner.address.left == address) {
+            return Side::Left;
+        }
+        if (owner.address.right == address) {
+            return Side::Right;
+        }
+        return std::nullopt;
+    };
+
+    // An address not seen for a long time may belong to another device by now
+    //
+    const auto expire = [&](uint32_t index, Side side) {
+        const auto &owner = _slots[index].device;
+        const auto seen = side == Side::Left ? owner.addressSeen.left : owner.addressSeen.right;
+        if (now - seen <= kAddressTimeout) {
+            return false;
+        }
+        ++_statistics.addressesExpired;
+        EraseAddress(index, side);
+        return true;
+    };
+
+    // Most packets come from the preferred device, check its addresses before hashing anything
+    //
+    const auto device = preferred.has_value() ? GetDevice(preferred.value()) : nullptr;
+    if (device != nullptr) {
+        if (const auto side = ownedSide(*device);
+            side.has_value() && !expire(preferred->slot, side.value()))
+        {
+            ++_statistics.addressHits;
+            return Match{.id = preferred.value(), .byAddress = true};
+        }
+    }
+
+    if (const auto iter = _byAddress.find(address); iter != _byAddress.end()) {
+        const auto index = iter->second;
+        const auto side = ownedSide(_slots[index].device);
+        APD_ASSERT(side.has_value());
+
+        if (!expire(index, side.value())) {
+            ++_statistics.addressHits;
+            return Match{.id = {index, _slots[index].generation}, .byAddress = true};
+        }
+    }
+
+    const auto fingerprint = Fingerprint(adv);
+
+    if (device != nullptr && device->fingerprint == fingerprint) {
+        ++_statistics.fingerprintHits;
+        return Match{.id = preferred.value()};
+    }
+
+    if (const auto iter = _byFingerprint.find(fingerprint); iter != _byFingerprint.end()) {
+        ++_statistics.fingerprintHits;
+        return Match{.id = {iter->second, _slots[iter->second].generation}};
+    }
+
+    return std::nullopt;
+}
+
+auto DeviceTracker::Record(const Advertisement &adv, Timestamp now, std::optional<DeviceId> id)
+    -> DeviceId
+{
+    uint32_t index = kNull;
+    if (id.has_value() && Get(id.value()) != nullptr) {
+        index = id->slot;
+        Unlink(index);
+    }
+    else {
+        ++_statistics.created;
+        index = Allocate();
+    }
+    LinkMostRecent(index);
+
+    const auto &advState = adv.GetAdvState();
+    auto &device = _slots[index].device;
+
+    SetAddress(index, advState.side, adv.GetAddress(), now);
+    SetFingerprint(index, Fingerprint(adv));
+
+    auto &addressSeen =
+        advState.side == Side::Left ? device.addressSeen.left : device.addressSeen.right;
+    addressSeen = now;
+
+    device.model = advState.model;
+    device.rssi = adv.GetRssi();
+    if (device.packetCount == 0) {
+        device.firstSeen = now;
+    }
+    device.lastSeen = now;
+    ++device.packetCount;
+
+    return DeviceId{index, _slots[index].generation};
+}
+
+void DeviceTracker::Link(DeviceId from, DeviceId to)
+{
+    const auto source = Get(from), target = Get(to);
+    if (source == nullptr || target == nullptr || from == to) {
+        return;
+    }
+
+    for (const auto side : {Side::Left, Side::Right}) {
+        const auto &address =
+            side == Side::Left ? source->device.address.left : source->device.address.right;
+        if (!address.has_value()) {
+            continue;
+        }
+
+        const auto &seen = side == Side::Left ? source->device.addressSeen.left
+                                              : source->device.addressSeen.right;
+        auto &targetSeen = side == Side::Left ? target->device.addressSeen.left
+                                              : target->device.addressSeen.right;
+        targetSeen = seen;
+
+        // Taken from `from` by `SetAddress`
+        //
+        const auto since = side == Side::Left ? source->device.addressSince.left
+                                              : source->device.addressSince.right;
+        SetAddress(to.slot, side, address.value(), since);
+    }
+
+    ++_statistics.linked;
+    Unlink(from.slot);
+    Release(from.slot);
+}
+
+void DeviceTracker::Touch(DeviceId id, const Advertisement &adv, Timestamp now)
+{
+    auto slot = Get(id);
+    if (slot == nullptr) {
+        return;
+    }
+
+    Unlink(id.slot);
+    LinkMostRecent(id.slot);
+
+    auto &device = slot->device;
+    auto &addressSeen = adv.GetAdvState().side == Side::Left ? device.addressSeen.left
+                                                             : device.addressSeen.right;
+    addressSeen = now;
+
+    device.rssi = adv.GetRssi();
+    device.lastSeen = now;
+    ++device.packetCount;
+}
+
+void DeviceTracker::SetScore(DeviceId id, float score)
+{
+    if (auto slot = Get(id); slot != nullptr) {
+        slot->device.score = score;
+    }
+}
+
+void DeviceTracker::Pin(DeviceId id)
+{
+    if (auto slot = Get(id); slot != nullptr) {
+        slot->pinned = true;
+    }
+}
+
+void DeviceTracker::Unpin(DeviceId id)
+{
+    if (auto slot = Get(id); slot != nullptr) {
+        slot->pinned = false;
+    }
+}
+
+auto DeviceTracker::GetDevice(DeviceId id) const -> const Device *
+{
+    if (id.slot >= _slots.size()) {
+        return nullptr;
+    }
+
+    const auto &slot = _slots[id.slot];
+    return slot.used && slot.generation == id.generation ? &slot.device : nullptr;
+}
+
+auto DeviceTracker::GetStatistics() const -> Statistics
+{
+    return _statistics;
+}
+
+void DeviceTracker::Clear()
+{
+    _byAddress.clear();
+    _byFingerprint.clear();
+
+    _mostRecent = _leastRecent = kNull;
+    _free = kNull;
+    for (uint32_t index = 0; index < _slots.size(); ++index) {
+        auto &slot = _slots[index];
+        if (slot.used) {
+            ++slot.generation;
+        }
+        slot.used = false;
+        slot.pinned = false;
+        slot.prev = kNull;
+        slot.next = _free;
+        _free = index;
+    }
+    _statistics.size = 0;
+}
+
+uint64_t DeviceTracker::Fingerprint(const Advertisement &adv)
+{
+    const auto &advState = adv.GetAdvState();
+
+    const auto battery = [](const Battery &value) -> uint64_t {
+        return value.Available() ? value.Value() : 0xFF;
+    };
+
+    return (static_cast<uint64_t>(advState.model) << 24) |
+           (battery(advState.pods.left.battery) << 16) |
+           (battery(advState.pods.right.battery) << 8) | battery(advState.caseBox.battery);
+}
+
+auto DeviceTracker::Get(DeviceId id) -> Slot *
+{
+    return GetDevice(id) != nullptr ? &_slots[id.slot] : nullptr;
+}
+
+uint32_t DeviceTracker::Allocate()
+{
+    if (_free == kNull) {
+        // Evict the least recently seen device, skipping the pinned one
+        //
+        auto index = _leastRecent;
+        while (index != kNull && _slots[index].pinned) {
+            index = _slots[index].prev;
+        }
+        APD_ASSERT(index != kNull);
+
+        ++_statistics.evicted;
+        Unlink(index);
+        Release(index);
+    }
+
+    const auto index = _free;
+    auto &slot = _slots[index];
+    _free = slot.next;
+
+    slot.device = Device{};
+    slot.used = true;
+    slot.pinned = false;
+    slot.prev = slot.next = kNull;
+    ++_statistics.size;
+
+    return index;
+}
+
+void DeviceTracker::Release(uint32_t index)
+{
+    auto &slot = _slots[index];
+
+    const auto eraseIfOwned = [&](auto &map, const auto &key) {
+        if (const auto iter = map.find(key); iter != map.end() && iter->second == index) {
+            map.erase(iter);
+        }
+    };
+    if (slot.device.address.left.has_value()) {
+        eraseIfOwned(_byAddress, slot.device.address.left.value());
+    }
+    if (slot.device.address.right.has_value()) {
+        eraseIfOwned(_byAddress, slot.device.address.right.value());
+    }
+    eraseIfOwned(_byFingerprint, slot.device.fingerprint);
+
+    ++slot.generation;
+    slot.used = false;
+    slot.pinned = false;
+    slot.prev = kNull;
+    slot.next = _free;
+    _free = index;
+    --_statistics.size;
+}
+
+void DeviceTracker::Unlink(uint32_t index)
+{
+    auto &slot = _slots[index];
+
+    if (slot.prev != kNull) {
+        _slots[slot.prev].next = slot.next;
+    }
+    else if (_mostRecent == index) {
+        _mostRecent = slot.next;
+    }
+
+    if (slot.next != kNull) {
+        _slots[slot.next].prev = slot.prev;
+    }
+    else if (_leastRecent == index) {
+        _leastRecent = slot.prev;
+    }
+
+    slot.prev = slot.next = kNull;
+}
+
+void DeviceTracker::LinkMostRecent(uint32_t index)
+{
+    auto &slot = _slots[index];
+
+    slot.prev = kNull;
+    slot.next = _mostRecent;
+    if (_mostRecent != kNull) {
+        _slots[_mostRecent].prev = index;
+    }
+    _mostRecent = index;
+    if (_leastRecent == kNull) {
+        _leastRecent = index;
+    }
+}
+
+// An address belongs to one device only, and a device keeps the latest address of each side.
+// `since` is the time of the first packet with a new address, unless it is taken from another
+// device, which has been using it for longer.
+//
+void DeviceTracker::SetAddress(uint32_t index, Side side, AddressType address, Timestamp since)
+{
+    auto &device = _slots[index].device;
+    auto &current = side == Side::Left ? device.address.left : device.address.right;
+    if (current == address) {
+        return;
+    }
+
+    EraseAddress(index, side);
+
+    // Steal the address from the device that had it
+    //
+    if (const auto [iter, inserted] = _byAddress.try_emplace(address, index); !inserted) {
+        auto &previous = _slots[iter->second].device;
+        since = previous.GetAddressSince(address).value_or(since);
+        for (auto *owned : {&previous.address.left, &previous.address.right}) {
+            if (*owned == address) {
+                owned->reset();
+            }
+        }
+        iter->second = index;
+    }
+
+    current = address;
+    (side == Side::Left ? device.addressSince.left : device.addressSince.right) = since;
+}
+
+void DeviceTracker::EraseAddress(uint32_t index, Side side)
+{
+    auto &device = _slots[index].device;
+    auto &current = side == Side::Left ? device.address.left : device.address.right;
+    if (!current.has_value()) {
+        return;
+    }
+
+    if (const auto iter = _byAddress.find(current.value());
+        iter != _byAddress.end() && iter->second == index)
+    {
+        _byAddress.erase(iter);
+    }
+    current.reset();
+}
+
+// Several devices may share a fingerprint, it points to the last one which got it
+//
+void DeviceTracker::SetFingerprint(uint32_t index, uint64_t fingerprint)
+{
+    auto &device = _slots[index].device;
+    if (device.fingerprint == fingerprint && device.packetCount != 0) {
+        return;
+    }
+
+    if (const auto iter = _byFingerprint.find(device.fingerprint);
+        iter != _byFingerprint.end() && iter->second == index)
+    {
+        _byFingerprint.erase(iter);
+    }
+    device.fingerprint = fingerprint;
+    _byFingerprint.insert_or_assign(fingerprint, index);
+}
+} // namespace Core::AirPods::Details
@@ -0,0 +1,174 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+
+#include "Base.h"
+#include "../Helper.h"
+
+namespace Core::AirPods::Details {
+
+class Advertisement;
+
+// Keeps a bounded table of the devices in range, so the packets of the other AirPods around can
+// be told apart from ours in O(1) instead of being compared with our last advertisements.
+//
+// A device is found by the address of the packet first. AirPods rotate their addresses, so if the
+// address is unknown, it is found by a fingerprint of its behavior, which is its model and
+// batteries. These rarely change and do not depend on the side broadcasting.
+//
+// An address not seen for `kAddressTimeout` is forgotten when it is looked up, since AirPods only
+// keep an address for a while. The least recently seen device is evicted when the table is full,
+// except the pinned one.
+//
+// When the caller finds out a device with a new address is one it already knows, `Link` merges
+// them, so the new address replaces the old one and the rotation is resolved in O(1).
+//
+class DeviceTracker
+{
+public:
+    using AddressType = uint64_t;
+    using Timestamp = Helper::Scheduler::TimePoint;
+
+    constexpr static size_t kCapacity = 64;
+    constexpr static std::chrono::seconds kAddressTimeout{60};
+
+    // Stays valid until the device is evicted, it is not reused after that
+    //
+    struct DeviceId {
+        uint32_t slot{0};
+        uint32_t generation{0};
+
+        bool operator==(const DeviceId &rhs) const = default;
+    };
+
+    struct Device {
+        Model model{Model::Unknown};
+        Helper::Sides<std::optional<AddressType>> address;
+        Helper::Sides<Timestamp> addressSeen;
+        Helper::Sides<Timestamp> addressSince; // The first packet with the address
+        uint64_t fingerprint{0};
+        uint64_t packetCount{0};
+        int16_t rssi{0};
+        Timestamp firstSeen{}, lastSeen{};
+
+        // How likely it is the device we are bound to, see `IdentityScorer`
+        //
+        float score{0.f};
+
+        // Empty if `address` is not one of the device
+        //
+        inline std::optional<Timestamp> GetAddressSince(AddressType address) const
+        {
+            if (this->address.left == address) {
+                return addressSince.left;
+            }
+            if (this->address.right == address) {
+                return addressSince.right;
+            }
+            return std::nullopt;
+        }
+    };
+
+    struct Match {
+        DeviceId id;
+        bool byAddress{false};
+    };
+
+    struct Statistics {
+        uint64_t addressHits{0};
+        uint64_t fingerprintHits{0};
+        uint64_t addressesExpired{0};
+        uint64_t linked{0};
+        uint64_t created{0};
+        uint64_t evicted{0};
+        size_t size{0};
+    };
+
+    DeviceTracker();
+
+    // Finds the device broadcasting `adv`. If the address is unknown and `preferred` has the
+    // same fingerprint, it is returned, so the device we are bound to wins over the others
+    // looking the same.
+    //
+    std::optional<Match>
+    Lookup(const Advertisement &adv, Timestamp now, std::optional<DeviceId> preferred = {});
+
+    // Records `adv` as a packet of `id`, or of a new device if `id` is empty or no longer valid.
+    // The address of the packet is taken from the device that had it.
+    //
+    DeviceId Record(const Advertisement &adv, Timestamp now, std::optional<DeviceId> id = {});
+
+    // Moves the addresses of `from` to `to`, replacing the ones `to` had on the same sides, and
+    // forgets `from`
+    //
+    void Link(DeviceId from, DeviceId to);
+
+    // Records `adv` as a packet of `id` with the same bytes as its last one, so only the times and
+    // the RSSI are updated
+    //
+    void Touch(DeviceId id, const Advertisement &adv, Timestamp now);
+
+    void SetScore(DeviceId id, float score);
+
+    void Pin(DeviceId id);
+    void Unpin(DeviceId id);
+
+    const Device *GetDevice(DeviceId id) const;
+    Statistics GetStatistics() const;
+    void Clear();
+
+    static uint64_t Fingerprint(const Advertisement &adv);
+
+private:
+    constexpr static uint32_t kNull = std::numeric_limits<uint32_t>::max();
+
+    struct Slot {
+        Device device;
+        uint32_t generation{0};
+        bool used{false};
+        bool pinned{false};
+
+        // The LRU list of the used slots, or the free list
+        //
+        uint32_t prev{kNull}, next{kNull};
+    };
+
+    std::vector<Slot> _slots;
+    std::unordered_map<AddressType, uint32_t> _byAddress;
+    std::unordered_map<uint64_t, uint32_t> _byFingerprint;
+    uint32_t _mostRecent{kNull}, _leastRecent{kNull}, _free{kNull};
+    Statistics _statistics;
+
+    Slot *Get(DeviceId id);
+    uint32_t Allocate();
+    void Release(uint32_t index);
+    void Unlink(uint32_t index);
+    void LinkMostRecent(uint32_t index);
+    void SetAddress(uint32_t index, Side side, AddressType address, Timestamp since);
+    void EraseAddress(uint32_t index, Side side);
+    void SetFingerprint(uint32_t index, uint64_t fingerprint);
+};
+} // namespace Core::AirPods::Details
@@ -20,6 +20,7 @@
 
 #include <Functiondiscoverykeys_devpkey.h>
 
+#include "Metrics.h"
 #include "../Utils.h"
 #include "../Logger.h"
 
@@ -511,6 +512,7 @@ auto GetAvailablePrograms()
 
 void Controller::Play()
 {
+    Metrics::ScopedTimer timer{Metrics::Histogram::MediaPlayTime};
     std::lock_guard<std::mutex> lock{_mutex};
 
     if (_pausedPrograms.empty()) {
@@ -521,9 +523,11 @@ void Controller::Play()
     for (const auto &program : _pausedPrograms) {
         if (!program->Play()) {
             LOG(Warn, L"Failed to play media. Program name: {}", program->GetProgramName());
+            Metrics::Increment(Metrics::Counter::MediaFailed);
         }
         else {
             LOG(Trace, L"Media played. Program name: {}", program->GetProgramName());
+            Metrics::Increment(Metrics::Counter::MediaPlayed);
         }
     }
 
@@ -532,6 +536,7 @@ void Controller::Play()
 
 void Controller::Pause()
 {
+    Metrics::ScopedTimer timer{Metrics::Histogram::MediaPauseTime};
     std::lock_guard<std::mutex> lock{_mutex};
 
     auto programs = Details::GetAvailablePrograms();
@@ -540,9 +545,11 @@ void Controller::Pause()
         if (program->IsPlaying()) {
             if (!program->Pause()) {
                 LOG(Warn, L"Failed to pause media. Program name: {}", program->GetProgramName());
+                Metrics::Increment(Metrics::Counter::MediaFailed);
             }
             else {
                 LOG(Trace, L"Media paused. Program name: {}", program->GetProgramName());
+                Metrics::Increment(Metrics::Counter::MediaPaused);
                 _pausedPrograms.emplace_back(std::move(program));
             }
         }
@@ -0,0 +1,94 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "IdentityScorer.h"
+
+#include <cmath>
+#include <cstdlib>
+
+#include "StateManager.h"
+
+namespace Core::AirPods::Details {
+
+IdentityScorer::IdentityScorer(const Parameters &parameters) : _parameters{parameters} {}
+
+float IdentityScorer::Score(
+    const Advertisement &adv, const Reference &reference, bool concurrent) const
+{
+    const auto &p = _parameters;
+
+    float result = concurrent ? p.concurrent : 0.f;
+
+    const auto last = reference.sameSide != nullptr ? reference.sameSide : reference.anotherSide;
+    if (last == nullptr) {
+        return result;
+    }
+
+    const auto &advState = adv.GetAdvState();
+    const auto &lastState = last->GetAdvState();
+
+    // Nothing else is worth comparing between two models
+    //
+    if (advState.model != lastState.model) {
+        return result + p.modelMismatch;
+    }
+
+    result += advState.color == lastState.color ? p.colorMatch : p.colorMismatch;
+
+    // Batteries are in percent, in steps of 10
+    //
+    const auto battery = [&](const Battery &curr, const Battery &prev) {
+        if (!curr.Available() || !prev.Available()) {
+            return 0.f;
+        }
+        const auto steps =
+            std::abs(static_cast<int>(curr.Value()) - static_cast<int>(prev.Value())) / 10;
+        return steps == 0 ? p.batterySame : steps == 1 ? p.batteryStep : p.batteryJump;
+    };
+    result += battery(advState.pods.left.battery, lastState.pods.left.battery);
+    result += battery(advState.pods.right.battery, lastState.pods.right.battery);
+    result += battery(advState.caseBox.battery, lastState.caseBox.battery);
+
+    const auto charging = [&](bool curr, bool prev) {
+        return curr == prev ? p.chargingMatch : p.chargingMismatch;
+    };
+    result += charging(advState.pods.left.isCharging, lastState.pods.left.isCharging);
+    result += charging(advState.pods.right.isCharging, lastState.pods.right.isCharging);
+    result += charging(advState.caseBox.isCharging, lastState.caseBox.isCharging);
+
+    // It is a 3-bit counter
+    //
+    const auto lidCountDiff = (advState.lidSwitchCount - lastState.lidSwitchCount) & 0b111;
+    result += lidCountDiff <= 1 ? p.lidCountMatch : p.lidCountMismatch;
+
+    // The signal of the same side is expected to be the closest
+    //
+    const auto rssiDiff = static_cast<int16_t>(
+        std::abs(adv.GetRssi() - reference.rssi.value_or(static_cast<float>(last->GetRssi()))));
+    if (rssiDiff <= p.rssiClose) {
+        result += p.rssiCloseScore;
+    }
+    else if (rssiDiff > p.rssiImpossible) {
+        result += p.rssiImpossibleScore;
+    }
+    else if (rssiDiff > p.rssiFar) {
+        result += p.rssiFarScore;
+    }
+    return result;
+}
+} // namespace Core::AirPods::Details
@@ -0,0 +1,109 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <algorithm>
+
+namespace Core::AirPods::Details {
+
+class Advertisement;
+
+// Tells how likely an advertisement is broadcast from the device we are bound to. Each field is
+// compared with our last advertisements and gives a log-likelihood ratio, they are summed as if
+// they were independent. Positive evidence is for our device, negative for another one.
+//
+// No single field decides, so a packet with a rotated address and a battery step is still ours,
+// while a neighbor with the same batteries is told apart by the others. The caller accumulates
+// the evidence of each candidate device over its packets, which costs O(1) per packet.
+//
+class IdentityScorer
+{
+public:
+    struct Parameters {
+        // The score of a device never seen before, most of the devices around are not ours
+        //
+        float prior{-4.f};
+
+        // A candidate is taken as ours at or above `acceptAbove`. At or below `ignoreBelow` it is
+        // known as another device and its packets are no longer scored. Accumulated scores are
+        // bounded by `saturation`, so a long history can still be outweighed.
+        //
+        float acceptAbove{4.f};
+        float ignoreBelow{-12.f};
+        float saturation{16.f};
+
+        float modelMismatch{-20.f};
+        float colorMatch{0.5f}, colorMismatch{-8.f};
+
+        // Per battery, by the number of steps of 10% it moved
+        //
+        float batterySame{1.f}, batteryStep{0.25f}, batteryJump{-4.f};
+
+        float chargingMatch{0.25f}, chargingMismatch{-0.5f};
+
+        // The lid switch counter stays or counts up by one between two packets of a device
+        //
+        float lidCountMatch{0.5f}, lidCountMismatch{-1.f};
+
+        int16_t rssiClose{10}, rssiFar{30}, rssiImpossible{50};
+        float rssiCloseScore{1.f}, rssiFarScore{-2.f}, rssiImpossibleScore{-8.f};
+
+        // Our device kept broadcasting from the same side with its previous address after the
+        // candidate showed up, so they are two devices at the same time
+        //
+        float concurrent{-12.f};
+    };
+
+    // Our last advertisements, any of them may be missing. The RSSI is compared with `rssi` if
+    // there is a smoothed one, with the RSSI of the last advertisement otherwise.
+    //
+    struct Reference {
+        const Advertisement *sameSide{nullptr};
+        const Advertisement *anotherSide{nullptr};
+        std::optional<float> rssi;
+    };
+
+    IdentityScorer() = default;
+    explicit IdentityScorer(const Parameters &parameters);
+
+    // The evidence of a single packet, 0 if there is nothing to compare with
+    //
+    float Score(const Advertisement &adv, const Reference &reference, bool concurrent) const;
+
+    inline float Accumulate(float score, float evidence) const
+    {
+        return std::clamp(score + evidence, -_parameters.saturation, _parameters.saturation);
+    }
+
+    inline const Parameters &GetParameters() const
+    {
+        return _parameters;
+    }
+
+    inline void SetParameters(const Parameters &parameters)
+    {
+        _parameters = parameters;
+    }
+
+private:
+    Parameters _parameters;
+};
+} // namespace Core::AirPods::Details
@@ -0,0 +1,133 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Metrics.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace Core::Metrics {
+
+namespace Details {
+
+inline std::string RenderValue(uint64_t value, Unit unit)
+{
+    if (unit != Unit::Nanoseconds || value < 1'000) {
+        return std::to_string(value) + (unit == Unit::Nanoseconds ? "ns" : "");
+    }
+
+    // 3 significant digits are more than the histograms are able to tell
+    //
+    constexpr std::array<std::string_view, 3> kUnits{"us", "ms", "s"};
+
+    auto scaled = static_cast<double>(value) / 1'000;
+    size_t unitIndex = 0;
+    while (scaled >= 1'000 && unitIndex + 1 < kUnits.size()) {
+        scaled /= 1'000;
+        ++unitIndex;
+    }
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3g", scaled);
+    return buffer + std::string{kUnits[unitIndex]};
+}
+
+} // namespace Details
+
+double HistogramSnapshot::Mean() const
+{
+    return count == 0 ? 0 : static_cast<double>(sum) / static_cast<double>(count);
+}
+
+uint64_t HistogramSnapshot::Percentile(double percentile) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    const auto rank = std::max<uint64_t>(
+        static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100 * count)), 1);
+
+    uint64_t accumulated = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        accumulated += buckets[i];
+        if (accumulated >= rank) {
+            const auto upperBound =
+                i + 1 < buckets.size() ? Details::GetBucketLowerBound(i + 1) - 1 : max;
+            return std::min(upperBound, max);
+        }
+    }
+    return max;
+}
+
+Snapshot TakeSnapshot()
+{
+    Snapshot result;
+
+    for (size_t i = 0; i < result.counters.size(); ++i) {
+        result.counters[i] = Details::gCounters[i].value.load(std::memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < result.histograms.size(); ++i) {
+        const auto &cells = Details::gHistograms[i];
+        auto &histogram = result.histograms[i];
+
+        // The count is summed from the buckets, so the percentiles are consistent with it
+        //
+        for (size_t j = 0; j < histogram.buckets.size(); ++j) {
+            histogram.buckets[j] = cells.buckets[j].load(std::memory_order_relaxed);
+            histogram.count += histogram.buckets[j];
+        }
+        histogram.sum = cells.sum.load(std::memory_order_relaxed);
+        histogram.max = cells.max.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+std::string Render(const Snapshot &snapshot)
+{
+    std::string result;
+
+    for (size_t i = 0; i < kCounters.size(); ++i) {
+        result += std::string{kCounters[i].name} + ": " + std::to_string(snapshot.counters[i]);
+        result += '\n';
+    }
+
+    for (size_t i = 0; i < kHistograms.size(); ++i) {
+        const auto &info = kHistograms[i];
+        const auto &histogram = snapshot.histograms[i];
+        if (histogram.count == 0) {
+            continue;
+        }
+
+        const auto render = [&](uint64_t value) { return Details::RenderValue(value, info.unit); };
+
+        result += std::string{info.name} + ": count " + std::to_string(histogram.count) +
+                  ", mean " + render(static_cast<uint64_t>(histogram.Mean())) + ", p50 " +
+                  render(histogram.Percentile(50)) + ", p90 " + render(histogram.Percentile(90)) +
+                  ", p99 " + render(histogram.Percentile(99)) + ", max " + render(histogram.max);
+        result += '\n';
+    }
+
+    if (!result.empty()) {
+        result.pop_back();
+    }
+    return result;
+}
+
+} // namespace Core::Metrics
@@ -0,0 +1,333 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <bit>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <algorithm>
+#include <string_view>
+
+#include "../Helper.h"
+
+// A process-wide registry of counters and latency histograms, to see where the advertisements go
+// and how long handling them takes.
+//
+// The metrics are declared statically below. Incrementing a counter is a relaxed atomic add on an
+// entry of a fixed array, without locking, looking up or allocating anything, so it's cheap enough
+// for the paths running for every packet. Reading the clock is not, the timings of those paths are
+// sampled with `SampledTimer`. Any thread may take a snapshot at any time. A snapshot is not
+// atomic as a whole, the metrics recorded while it's taken may be partly included.
+//
+namespace Core::Metrics {
+
+enum class Counter : uint16_t {
+    WatcherReceived,
+    WatcherFiltered,
+    WatcherDispatched,
+
+    ManagerQueueFull,
+    ManagerDisconnected,
+
+    AdvNoAppleData,
+    AdvWrongSize,
+    AdvNotProximityPairing,
+
+    StateAccepted,
+    StateDuplicates,
+    StateRejectedRssi,
+    StateRejectedScore,
+    StateIgnored,
+    StateOutliers,
+    StateDecrypted,
+    StateDecryptionMismatched,
+    StateRotations,
+    StateChanged,
+
+    MediaPaused,
+    MediaPlayed,
+    MediaFailed,
+
+    _Max
+};
+
+enum class Histogram : uint16_t {
+    StateBatchSize,
+    StateBatchTime,
+    StateUpdateTime,
+    StateRotationLatency,
+
+    MediaPauseTime,
+    MediaPlayTime,
+
+    GuiUpdateTime,
+
+    _Max
+};
+
+enum class Unit : uint8_t { Count, Nanoseconds };
+
+struct CounterInfo {
+    std::string_view name;
+    std::string_view description;
+};
+
+struct HistogramInfo {
+    std::string_view name;
+    std::string_view description;
+    Unit unit;
+};
+
+// clang-format off
+constexpr inline std::array<CounterInfo, Helper::ToUnderlying(Counter::_Max)> kCounters{{
+    {"watcher.received", "Advertisements reported by the platform"},
+    {"watcher.filtered", "Advertisements dropped by the manufacturer data filters"},
+    {"watcher.dispatched", "Advertisements passed to the callbacks"},
+
+    {"manager.queue_full", "Advertisements dropped because the queue was full"},
+    {"manager.disconnected", "Dropped because the bound device is disconnected"},
+
+    {"adv.no_apple_data", "Not desired, no manufacturer data from Apple"},
+    {"adv.wrong_size", "Not desired, the data from Apple has another size"},
+    {"adv.not_proximity_pairing", "Not desired, not a proximity pairing packet"},
+
+    {"state.accepted", "Advertisements accepted as from the bound device"},
+    {"state.duplicates", "Accepted, same bytes as the last one of the side"},
+    {"state.rejected_rssi", "Rejected, the RSSI is less than the limit"},
+    {"state.rejected_score", "Rejected, not scored high enough to be from the bound device"},
+    {"state.ignored", "Ignored, from a device known to be another one"},
+    {"state.outliers", "RSSI rejected by the filter of the bound device"},
+    {"state.decrypted", "Accepted advertisements decrypted with the key"},
+    {"state.decryption_mismatched", "Decrypted batteries not matching the clear ones"},
+    {"state.rotations", "Address changes of the bound device"},
+    {"state.changed", "State changes emitted"},
+
+    {"media.paused", "Media programs paused"},
+    {"media.played", "Media programs resumed"},
+    {"media.failed", "Media programs failed to be paused or resumed"},
+}};
+
+constexpr inline std::array<HistogramInfo, Helper::ToUnderlying(Histogram::_Max)> kHistograms{{
+    {"state.batch_size", "Advertisements per `StateManager::OnAdvBatch` call, sampled",
+     Unit::Count},
+    {"state.batch_time", "Time of `StateManager::OnAdvBatch`, sampled", Unit::Nanoseconds},
+    {"state.update_time", "Time of `StateManager::UpdateState`, sampled", Unit::Nanoseconds},
+    {"state.rotation_latency", "First packet with a new address to the accepted one",
+     Unit::Nanoseconds},
+
+    {"media.pause_time", "Time of `GlobalMedia::Controller::Pause`", Unit::Nanoseconds},
+    {"media.play_time", "Time of `GlobalMedia::Controller::Play`", Unit::Nanoseconds},
+
+    {"gui.update_time", "Time of `MainWindow::UpdateState`", Unit::Nanoseconds},
+}};
+// clang-format on
+
+namespace Details {
+
+// The histograms are log-linear like HDR histograms: each power of 2 is split into
+// `kSubBucketCount` linear buckets, so a value is known within 12.5% whatever its magnitude,
+// with a fixed number of buckets covering the whole range of `uint64_t`.
+//
+constexpr inline size_t kSubBucketBits = 3;
+constexpr inline size_t kSubBucketCount = size_t{1} << kSubBucketBits;
+constexpr inline size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBucketCount;
+
+constexpr size_t GetBucketIndex(uint64_t value)
+{
+    if (value < kSubBucketCount) {
+        return static_cast<size_t>(value);
+    }
+
+    const auto shift = static_cast<size_t>(std::bit_width(value)) - 1 - kSubBucketBits;
+    return (shift + 1) * kSubBucketCount +
+           static_cast<size_t>((value >> shift) & (kSubBucketCount - 1));
+}
+
+constexpr uint64_t GetBucketLowerBound(size_t index)
+{
+    if (index < kSubBucketCount) {
+        return index;
+    }
+
+    const auto shift = index / kSubBucketCount - 1;
+    return (kSubBucketCount + index % kSubBucketCount) << shift;
+}
+
+static_assert(GetBucketIndex(std::numeric_limits<uint64_t>::max()) == kBucketCount - 1);
+static_assert(GetBucketLowerBound(GetBucketIndex(1000)) == 960);
+
+constexpr inline size_t kCacheLineSize = 64;
+
+// On its own cache line, the counters are incremented from the Bluetooth thread and from the
+// thread consuming the advertisements
+//
+struct alignas(kCacheLineSize) CounterCell {
+    std::atomic<uint64_t> value{0};
+};
+
+struct alignas(kCacheLineSize) HistogramCells {
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets{};
+};
+
+inline std::array<CounterCell, Helper::ToUnderlying(Counter::_Max)> gCounters{};
+inline std::array<HistogramCells, Helper::ToUnderlying(Histogram::_Max)> gHistograms{};
+
+// The calls left until the next sampled one, for each histogram
+//
+inline thread_local std::array<uint32_t, Helper::ToUnderlying(Histogram::_Max)> tSampleCountdowns{};
+
+} // namespace Details
+
+inline void Increment(Counter counter, uint64_t count = 1)
+{
+    Details::gCounters[Helper::ToUnderlying(counter)].value.fetch_add(
+        count, std::memory_order_relaxed);
+}
+
+inline void Record(Histogram histogram, uint64_t value)
+{
+    auto &cells = Details::gHistograms[Helper::ToUnderlying(histogram)];
+
+    cells.buckets[Details::GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    cells.sum.fetch_add(value, std::memory_order_relaxed);
+
+    auto max = cells.max.load(std::memory_order_relaxed);
+    while (value > max) {
+        if (cells.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+}
+
+template <class Rep, class Period>
+inline void Record(Histogram histogram, std::chrono::duration<Rep, Period> duration)
+{
+    const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+    Record(histogram, static_cast<uint64_t>(std::max<int64_t>(nanoseconds.count(), 0)));
+}
+
+// Records the time from its construction to its destruction
+//
+class ScopedTimer : Helper::NonCopyable
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    inline explicit ScopedTimer(Histogram histogram)
+        : _histogram{histogram}, _start{Clock::now()}
+    {
+    }
+
+    inline ~ScopedTimer()
+    {
+        Record(_histogram, Clock::now() - _start);
+    }
+
+private:
+    Histogram _histogram;
+    Clock::time_point _start;
+};
+
+// 1 of this many calls of a sampled path on a thread is timed
+//
+constexpr inline uint32_t kSampleInterval = 64;
+
+// Like `ScopedTimer`, but only reads the clock for 1 of `kSampleInterval` constructions for the
+// histogram on the current thread, the others cost a decrement
+//
+class SampledTimer : Helper::NonCopyable
+{
+public:
+    using Clock = ScopedTimer::Clock;
+
+    inline explicit SampledTimer(Histogram histogram) : _histogram{histogram}
+    {
+        auto &countdown = Details::tSampleCountdowns[Helper::ToUnderlying(histogram)];
+        if (countdown != 0) [[likely]] {
+            --countdown;
+            return;
+        }
+        countdown = kSampleInterval - 1;
+        _sampling = true;
+        _start = Clock::now();
+    }
+
+    inline ~SampledTimer()
+    {
+        if (_sampling) [[unlikely]] {
+            Record(_histogram, Clock::now() - _start);
+        }
+    }
+
+    // Whether this call is timed, so other values of the call can be sampled with it
+    //
+    inline bool IsSampling() const
+    {
+        return _sampling;
+    }
+
+private:
+    Histogram _histogram;
+    bool _sampling{false};
+    Clock::time_point _start;
+};
+
+struct HistogramSnapshot {
+    uint64_t count{0};
+    uint64_t sum{0};
+    uint64_t max{0};
+    std::array<uint64_t, Details::kBucketCount> buckets{};
+
+    double Mean() const;
+
+    // The upper bound of the bucket holding the value at `percentile` (0-100), so it's at most
+    // 12.5% above the real one
+    //
+    uint64_t Percentile(double percentile) const;
+};
+
+struct Snapshot {
+    std::array<uint64_t, Helper::ToUnderlying(Counter::_Max)> counters{};
+    std::array<HistogramSnapshot, Helper::ToUnderlying(Histogram::_Max)> histograms{};
+
+    inline uint64_t Get(Counter counter) const
+    {
+        return counters[Helper::ToUnderlying(counter)];
+    }
+
+    inline const HistogramSnapshot &Get(Histogram histogram) const
+    {
+        return histograms[Helper::ToUnderlying(histogram)];
+    }
+};
+
+// Lock-free, it may be called from any thread
+//
+Snapshot TakeSnapshot();
+
+// A line for each metric, the histograms without any value are skipped
+//
+std::string Render(const Snapshot &snapshot);
+
+} // namespace Core::Metrics
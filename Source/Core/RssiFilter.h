@@ -0,0 +1,103 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "Base.h"
+
+namespace Core::AirPods::Details {
+
+// Smooths the RSSI of one side with a one-dimensional Kalman filter. The RSSI is modeled as a
+// random walk drifting by `kProcessNoise` per packet, measured with `kMeasurementNoise`.
+//
+// A measurement further than `kOutlierSigma` standard deviations from the estimate is rejected,
+// only the uncertainty grows. So a single packet received through a wall does not move the
+// estimate, while a few in a row widen the gate enough to follow a real move.
+//
+// It is 8 bytes, so the filters of both sides take a fraction of a cache line and an update is a
+// handful of float operations.
+//
+class RssiFilter
+{
+public:
+    constexpr static float kProcessNoise = 2.f;      // dB² per packet
+    constexpr static float kMeasurementNoise = 16.f; // dB², about 4 dB of noise
+    constexpr static float kOutlierSigma = 3.f;
+
+    // Lower bounds of the smoothed RSSI of each proximity band
+    //
+    constexpr static float kImmediateAbove = -55.f;
+    constexpr static float kNearAbove = -70.f;
+
+    // Returns false if the measurement is rejected as an outlier
+    //
+    inline bool Update(int16_t rssi)
+    {
+        if (!Available()) {
+            _estimate = rssi;
+            _variance = kMeasurementNoise;
+            return true;
+        }
+
+        _variance += kProcessNoise;
+
+        const float innovation = rssi - _estimate;
+        const float innovationVariance = _variance + kMeasurementNoise;
+        if (innovation * innovation > kOutlierSigma * kOutlierSigma * innovationVariance) {
+            return false;
+        }
+
+        const float gain = _variance / innovationVariance;
+        _estimate += gain * innovation;
+        _variance -= gain * _variance;
+        return true;
+    }
+
+    inline void Reset()
+    {
+        _estimate = _variance = 0.f;
+    }
+
+    inline bool Available() const
+    {
+        return _variance > 0.f;
+    }
+
+    inline float Estimate() const
+    {
+        return _estimate;
+    }
+
+    inline Proximity GetProximity() const
+    {
+        if (!Available()) {
+            return Proximity::Unknown;
+        }
+        return _estimate >= kImmediateAbove ? Proximity::Immediate
+               : _estimate >= kNearAbove    ? Proximity::Near
+                                            : Proximity::Far;
+    }
+
+private:
+    float _estimate{0.f};
+    float _variance{0.f}; // 0 until the first measurement
+};
+static_assert(sizeof(RssiFilter) == 8);
+} // namespace Core::AirPods::Details
@@ -104,6 +104,15 @@ void OnApply_device_address(const Fields &newFields)
     ApdApp->GetMainWindow()->GetApdMgr().OnBoundDeviceAddressChanged(newFields.device_address);
 }
 
+void OnApply_device_encryption_key(const Fields &newFields)
+{
+    LOG(Info, "OnApply_device_encryption_key: {}",
+        LogSensitiveData(newFields.device_encryption_key));
+
+    ApdApp->GetMainWindow()->GetApdMgr().OnEncryptionKeyChanged(
+        newFields.device_encryption_key);
+}
+
 void OnApply_tray_icon_battery(const Fields &newFields)
 {
     LOG(Info, "OnApply_tray_icon_battery: {}", newFields.tray_icon_battery);
@@ -50,6 +50,9 @@ enum class LoadResult : uint32_t { AbiIncompatible, NoAbiField, Successful };
     callback(uint64_t, device_address, {0},                                                        \
         Impl::OnApply(&OnApply_device_address),                                                    \
         Impl::Sensitive{})                                                                         \
+    callback(QString, device_encryption_key, {},                                                   \
+        Impl::OnApply(&OnApply_device_encryption_key),                                             \
+        Impl::Sensitive{})                                                                         \
     callback(TrayIconBatteryBehavior, tray_icon_battery, {TrayIconBatteryBehavior::Disable},       \
         Impl::OnApply(&OnApply_tray_icon_battery))                                                 \
     callback(TaskbarStatusBehavior, battery_on_taskbar, {TaskbarStatusBehavior::Disable},          \
@@ -213,6 +216,7 @@ void OnApply_low_audio_latency(const Fields &newFields);
 void OnApply_automatic_ear_detection(const Fields &newFields);
 void OnApply_rssi_min(const Fields &newFields);
 void OnApply_device_address(const Fields &newFields);
+void OnApply_device_encryption_key(const Fields &newFields);
 void OnApply_tray_icon_battery(const Fields &newFields);
 void OnApply_battery_on_taskbar(const Fields &newFields);
 
@@ -0,0 +1,807 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "StateManager.h"
+
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#include "Metrics.h"
+#include "../Helper.h"
+#include "../Logger.h"
+#include "../Assert.h"
+
+namespace Core::AirPods {
+
+//
+// PackedState
+//
+
+namespace Details::Impl {
+
+constexpr uint64_t kBatteryAvailable = 0x80;
+
+inline uint64_t PackBattery(const Battery &battery)
+{
+    if (!battery.Available()) {
+        return 0;
+    }
+    return kBatteryAvailable | std::min<Battery::ValueType>(battery.Value(), 100);
+}
+
+inline Battery UnpackBattery(uint64_t bits)
+{
+    return (bits & kBatteryAvailable) != 0 ? Battery{static_cast<Battery::ValueType>(bits & 0x7F)}
+                                           : Battery{};
+}
+
+template <PackedState::Field field>
+constexpr uint64_t GetField(uint64_t word)
+{
+    constexpr auto mask = Helper::ToUnderlying(field);
+    return (word & mask) >> std::countr_zero(mask);
+}
+
+template <PackedState::Field field>
+constexpr uint64_t PutField(uint64_t value)
+{
+    constexpr auto mask = Helper::ToUnderlying(field);
+    return (value << std::countr_zero(mask)) & mask;
+}
+} // namespace Details::Impl
+
+PackedState::PackedState(const State &state)
+{
+    using namespace Details::Impl;
+    static_assert(Helper::ToUnderlying(Model::_Max) <= 0xFF);
+
+    _word = kHasValue | PutField<Field::Model>(Helper::ToUnderlying(state.model)) |
+            PutField<Field::LeftBattery>(PackBattery(state.pods.left.battery)) |
+            PutField<Field::RightBattery>(PackBattery(state.pods.right.battery)) |
+            PutField<Field::CaseBattery>(PackBattery(state.caseBox.battery)) |
+            PutField<Field::LeftCharging>(state.pods.left.isCharging) |
+            PutField<Field::RightCharging>(state.pods.right.isCharging) |
+            PutField<Field::CaseCharging>(state.caseBox.isCharging) |
+            PutField<Field::LeftInEar>(state.pods.left.isInEar) |
+            PutField<Field::RightInEar>(state.pods.right.isInEar) |
+            PutField<Field::BothPodsInCase>(state.caseBox.isBothPodsInCase) |
+            PutField<Field::LidOpened>(state.caseBox.isLidOpened);
+}
+
+State PackedState::Unpack() const
+{
+    using namespace Details::Impl;
+
+    State state;
+    state.model = static_cast<Model>(GetField<Field::Model>(_word));
+    state.pods.left.battery = UnpackBattery(GetField<Field::LeftBattery>(_word));
+    state.pods.right.battery = UnpackBattery(GetField<Field::RightBattery>(_word));
+    state.caseBox.battery = UnpackBattery(GetField<Field::CaseBattery>(_word));
+    state.pods.left.isCharging = GetField<Field::LeftCharging>(_word) != 0;
+    state.pods.right.isCharging = GetField<Field::RightCharging>(_word) != 0;
+    state.caseBox.isCharging = GetField<Field::CaseCharging>(_word) != 0;
+    state.pods.left.isInEar = GetField<Field::LeftInEar>(_word) != 0;
+    state.pods.right.isInEar = GetField<Field::RightInEar>(_word) != 0;
+    state.caseBox.isBothPodsInCase = GetField<Field::BothPodsInCase>(_word) != 0;
+    state.caseBox.isLidOpened = GetField<Field::LidOpened>(_word) != 0;
+    return state;
+}
+
+namespace Details {
+
+namespace Impl {
+
+// Not meant to be strong, only cheap enough to reject different packets before comparing bytes.
+// The 27 bytes are loaded as 4 words, the last one overlapping the third.
+//
+inline uint64_t HashPayload(AppleCP::AirPods::Data data)
+{
+    static_assert(AppleCP::AirPods::kSize > 16 && AppleCP::AirPods::kSize <= 32);
+
+    const auto load = [&](size_t offset) {
+        uint64_t word;
+        std::memcpy(&word, data.data() + offset, sizeof(word));
+        return word;
+    };
+
+    constexpr uint64_t kMultiplier = 0x9E3779B97F4A7C15;
+    uint64_t hash = 0;
+    for (size_t offset : {size_t{0}, size_t{8}, size_t{16}, AppleCP::AirPods::kSize - 8}) {
+        hash = (hash ^ load(offset)) * kMultiplier;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+} // namespace Impl
+
+//
+// Advertisement
+//
+
+bool Advertisement::IsDesiredAdv(const Bluetooth::AdvertisementReceivedData &data)
+{
+    auto manufacturerData = data.GetManufacturerData(AppleCP::VendorId);
+    if (!manufacturerData.has_value()) {
+        Metrics::Increment(Metrics::Counter::AdvNoAppleData);
+        return false;
+    }
+
+    if (manufacturerData->size() != AppleCP::AirPods::kSize) {
+        Metrics::Increment(Metrics::Counter::AdvWrongSize);
+        return false;
+    }
+
+    if (!AppleCP::AirPods::IsValid(manufacturerData.value())) {
+        Metrics::Increment(Metrics::Counter::AdvNotProximityPairing);
+        return false;
+    }
+
+    return true;
+}
+
+Advertisement::Advertisement(const Bluetooth::AdvertisementReceivedData &data)
+    : _rssi{data.rssi}, _timestamp{data.timestamp}, _address{data.address}
+{
+    auto manufacturerData = data.GetManufacturerData(AppleCP::VendorId);
+    APD_ASSERT(manufacturerData.has_value());
+
+    // Decoded in place from the received bytes
+    //
+    const auto optProtocol = AppleCP::As<AppleCP::AirPods>(manufacturerData.value());
+    APD_ASSERT(optProtocol.has_value());
+    const auto &protocol = optProtocol.value();
+
+    _desensitizedData = protocol.Desensitize();
+
+    static_assert(AppleCP::AirPods::Fields::kUnk12Size == Aes::kBlockSize);
+    std::ranges::copy(protocol.GetEncryptedPayload(), _encryptedPayload.begin());
+
+    _payloadHash = Impl::HashPayload(protocol.GetData());
+
+    // Store state
+    //
+
+    _state.model = protocol.GetModel();
+    _state.side = protocol.GetBroadcastedSide();
+    _state.color = protocol.GetColor();
+    _state.lidSwitchCount = protocol.GetLidSwitchCount();
+
+    _state.pods.left.battery = protocol.GetLeftBattery();
+    _state.pods.left.isCharging = protocol.IsLeftCharging();
+    _state.pods.left.isInEar = protocol.IsLeftInEar();
+
+    _state.pods.right.battery = protocol.GetRightBattery();
+    _state.pods.right.isCharging = protocol.IsRightCharging();
+    _state.pods.right.isInEar = protocol.IsRightInEar();
+
+    _state.caseBox.battery = protocol.GetCaseBattery();
+    _state.caseBox.isCharging = protocol.IsCaseCharging();
+
+    _state.caseBox.isBothPodsInCase = protocol.IsBothPodsInCase();
+    _state.caseBox.isLidOpened = protocol.IsLidOpened();
+
+    if (_state.pods.left.battery.Available()) {
+        _state.pods.left.battery = _state.pods.left.battery.Value() * 10;
+    }
+    if (_state.pods.right.battery.Available()) {
+        _state.pods.right.battery = _state.pods.right.battery.Value() * 10;
+    }
+    if (_state.caseBox.battery.Available()) {
+        _state.caseBox.battery = _state.caseBox.battery.Value() * 10;
+    }
+}
+
+int16_t Advertisement::GetRssi() const
+{
+    return _rssi;
+}
+
+auto Advertisement::GetTimestamp() const -> const TimestampType &
+{
+    return _timestamp;
+}
+
+auto Advertisement::GetAddress() const -> AddressType
+{
+    return _address;
+}
+
+auto Advertisement::GetDesensitizedData() const -> const DesensitizedData &
+{
+    return _desensitizedData;
+}
+
+auto Advertisement::GetAdvState() const -> const AdvState &
+{
+    return _state;
+}
+
+bool Advertisement::IsSamePacket(const Advertisement &rhs) const
+{
+    // The hash rejects almost all the different ones before comparing the bytes
+    //
+    return _payloadHash == rhs._payloadHash && _address == rhs._address &&
+           _encryptedPayload == rhs._encryptedPayload &&
+           _desensitizedData == rhs._desensitizedData;
+}
+
+auto Advertisement::GetEncryptedPayload() const -> const Aes::Block &
+{
+    return _encryptedPayload;
+}
+
+bool Advertisement::ApplyDecryptedPayload(const Aes::Block &decrypted)
+{
+    const auto exact = AppleCP::AirPods::DecodeExactBatteries(decrypted, _state.side);
+
+    // The clear ones are in steps of 10%
+    //
+    const auto isClose = [](const Battery &exactBattery, const Battery &battery) {
+        return exactBattery.Available() == battery.Available() &&
+               (!battery.Available() ||
+                std::abs(static_cast<int>(exactBattery.Value()) -
+                         static_cast<int>(battery.Value())) <= 10);
+    };
+
+    if (!isClose(exact.left, _state.pods.left.battery) ||
+        !isClose(exact.right, _state.pods.right.battery) ||
+        !isClose(exact.caseBox, _state.caseBox.battery))
+    {
+        return false;
+    }
+
+    _state.pods.left.battery = exact.left;
+    _state.pods.right.battery = exact.right;
+    _state.caseBox.battery = exact.caseBox;
+    return true;
+}
+
+//
+// StateManager
+//
+
+StateManager::StateManager(Helper::Scheduler &scheduler)
+    : _scheduler{scheduler}, _expiryTimer{scheduler}
+{
+    _expiryTimer.StartOneShot([this] { OnExpiryTimer(); });
+}
+
+// The timer is fired by the thread of the scheduler shared with the others, and its callback
+// resets the members declared after it. They are destroyed before the timer, so it must be
+// stopped first.
+//
+StateManager::~StateManager()
+{
+    _expiryTimer.Stop();
+}
+
+std::optional<PackedState> StateManager::GetCurrentState() const
+{
+    const auto state = _currentState.load(std::memory_order_acquire);
+    return state.HasValue() ? std::optional{state} : std::nullopt;
+}
+
+auto StateManager::GetSignal() const -> Helper::Sides<std::optional<Signal>>
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    const auto signal = [](const RssiFilter &filter) -> std::optional<Signal> {
+        if (!filter.Available()) {
+            return std::nullopt;
+        }
+        return Signal{.rssi = filter.Estimate(), .proximity = filter.GetProximity()};
+    };
+    return {.left = signal(_rssiFilter.left), .right = signal(_rssiFilter.right)};
+}
+
+auto StateManager::GetStatistics() const -> Statistics
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    auto result = _statistics;
+    result.tracker = _tracker.GetStatistics();
+    return result;
+}
+
+bool StateManager::OnAdvReceived(Advertisement adv)
+{
+    return OnAdvBatch({&adv, 1}) != 0;
+}
+
+size_t StateManager::OnAdvBatch(std::span<Advertisement> advs)
+{
+    Metrics::SampledTimer timer{Metrics::Histogram::StateBatchTime};
+    if (timer.IsSampling()) {
+        Metrics::Record(Metrics::Histogram::StateBatchSize, advs.size());
+    }
+
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    ++_statistics.batches;
+
+    const auto now = _scheduler.Now();
+
+    // With a key, the payloads are decrypted ahead chunk by chunk, so the blocks are decrypted in
+    // parallel. Only the accepted ones are used.
+    //
+    constexpr size_t kChunkSize = 16;
+    std::array<Aes::Block, kChunkSize> decrypted;
+
+    size_t acceptedCount = 0, duplicateCount = 0;
+    for (size_t begin = 0; begin < advs.size(); begin += kChunkSize) {
+        const auto chunk = advs.subspan(begin, std::min(kChunkSize, advs.size() - begin));
+
+        if (_decryptor.has_value()) {
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                decrypted[i] = chunk[i].GetEncryptedPayload();
+            }
+            _decryptor->Decrypt(std::span{decrypted}.first(chunk.size()));
+        }
+
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            auto &adv = chunk[i];
+            if (IsDuplicateAdv(adv)) {
+                const bool reordered = ChangesPrecedence(adv, now);
+                if (RefreshAdv(adv, now)) {
+                    ++acceptedCount;
+                    duplicateCount += !reordered;
+                }
+                continue;
+            }
+
+            if (!AcceptAdv(adv, now)) {
+                continue;
+            }
+
+            if (_decryptor.has_value()) {
+                if (adv.ApplyDecryptedPayload(decrypted[i])) {
+                    ++_statistics.decrypted;
+                    Metrics::Increment(Metrics::Counter::StateDecrypted);
+                }
+                else {
+                    ++_statistics.decryptionMismatched;
+                    Metrics::Increment(Metrics::Counter::StateDecryptionMismatched);
+                }
+            }
+
+            ++acceptedCount;
+            UpdateAdv(std::move(adv), now);
+        }
+    }
+
+    // Nothing to rebuild if all of them are duplicates, see `ChangesPrecedence`
+    //
+    if (acceptedCount == duplicateCount) {
+        return acceptedCount;
+    }
+
+    auto optUpdateEvent = UpdateState();
+    lock.unlock();
+
+    if (optUpdateEvent.has_value()) {
+        Metrics::Increment(Metrics::Counter::StateChanged);
+        _cbStateChanged.Invoke(optUpdateEvent.value());
+    }
+    return acceptedCount;
+}
+
+void StateManager::Disconnect()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    LOG(Info, "StateManager: Disconnect.");
+    const bool disconnected = ResetAll();
+    lock.unlock();
+
+    if (disconnected) {
+        _cbDisconnected.Invoke();
+    }
+}
+
+void StateManager::OnRssiMinChanged(int16_t rssiMin)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    _rssiMin = rssiMin;
+}
+
+void StateManager::OnEncryptionKeyChanged(const std::optional<Aes::Key> &key)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+
+    if (key.has_value()) {
+        _decryptor.emplace(key.value());
+        LOG(Info, "StateManager: Encryption key set. AES-NI: {}",
+            _decryptor->IsHardwareAccelerated());
+    }
+    else {
+        _decryptor.reset();
+    }
+}
+
+void StateManager::OnIdentityParametersChanged(const IdentityScorer::Parameters &parameters)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    _scorer.SetParameters(parameters);
+}
+
+// The first device heard is bound. After that, the packets from one of its addresses are
+// accepted directly, any other packet is from a candidate: a device never seen, one known by the
+// tracker, or one looking the same as ours with a new address. Its score accumulates the
+// evidence of each of its packets, and the packet is accepted once the score is high enough.
+// So a rotated address of ours is taken over after a packet or two, while the other devices
+// around sink below `ignoreBelow` and are no longer scored.
+//
+bool StateManager::AcceptAdv(const Advertisement &adv, Timestamp now)
+{
+    const auto match = _tracker.Lookup(adv, now, _boundDevice);
+
+    // Our own packets are compared with the limit after smoothing, so a single weak one does not
+    // drop a valid advertisement
+    //
+    if (_boundDevice.has_value() && match.has_value() && match->byAddress &&
+        match->id == _boundDevice.value())
+    {
+        if (!AcceptRssi(adv)) {
+            return false;
+        }
+        _tracker.Record(adv, now, _boundDevice);
+        ++_statistics.accepted;
+        Metrics::Increment(Metrics::Counter::StateAccepted);
+        return true;
+    }
+
+    // Too weak to be ours, don't let it take a place in the tracker
+    //
+    if (adv.GetRssi() < _rssiMin) {
+        LOG(Warn,
+            "AcceptAdv returns false. Reason: RSSI is less than the limit. curr: '{}' min: '{}'",
+            adv.GetRssi(), _rssiMin);
+        ++_statistics.rejected;
+        Metrics::Increment(Metrics::Counter::StateRejectedRssi);
+        return false;
+    }
+
+    if (!_boundDevice.has_value()) {
+        _boundDevice = _tracker.Record(
+            adv, now, match.has_value() ? std::optional{match->id} : std::nullopt);
+        _tracker.Pin(_boundDevice.value());
+        AcceptRssi(adv);
+        ++_statistics.accepted;
+        Metrics::Increment(Metrics::Counter::StateAccepted);
+        return true;
+    }
+
+    const auto candidate = match.has_value() && match->id != _boundDevice.value()
+                               ? std::optional{match->id}
+                               : std::nullopt;
+    const auto device = candidate.has_value() ? _tracker.GetDevice(candidate.value()) : nullptr;
+    const auto &parameters = _scorer.GetParameters();
+
+    auto score = device != nullptr ? device->score : parameters.prior;
+    if (score <= parameters.ignoreBelow) {
+        _tracker.Record(adv, now, candidate);
+        ++_statistics.ignored;
+        Metrics::Increment(Metrics::Counter::StateIgnored);
+        return false;
+    }
+
+    // The candidate may have been tracked for long before its address changed, this packet is the
+    // first one with its address if the candidate was found by fingerprint
+    //
+    std::optional<Timestamp> addressSince;
+    if (device != nullptr) {
+        addressSince = device->GetAddressSince(adv.GetAddress()).value_or(now);
+    }
+
+    score = _scorer.Accumulate(score, ScoreAdv(adv, addressSince));
+
+    if (score >= parameters.acceptAbove) {
+        const auto side = adv.GetAdvState().side;
+        const auto bound = _tracker.GetDevice(_boundDevice.value());
+        const auto &lastAddress = side == Side::Left ? bound->address.left : bound->address.right;
+
+        // Otherwise it is the first packet we get from this side
+        //
+        if (lastAddress.has_value()) {
+            const auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(
+                addressSince.has_value() ? now - addressSince.value()
+                                         : Timestamp::duration::zero());
+
+            ++_statistics.rotations;
+            Metrics::Increment(Metrics::Counter::StateRotations);
+            _statistics.rotationLatencyTotal += latency;
+            _statistics.rotationLatencyMax = std::max(_statistics.rotationLatencyMax, latency);
+            Metrics::Record(Metrics::Histogram::StateRotationLatency, latency);
+
+            LOG(Info,
+                "Address of side '{}' changed, but it is still the same device. score: '{}' "
+                "latency: '{}ms'",
+                Helper::ToString(side), score, latency.count());
+        }
+
+        if (candidate.has_value()) {
+            _tracker.Link(candidate.value(), _boundDevice.value());
+        }
+        AcceptRssi(adv);
+        _tracker.Record(adv, now, _boundDevice);
+        ++_statistics.accepted;
+        Metrics::Increment(Metrics::Counter::StateAccepted);
+        return true;
+    }
+
+    LOG(Warn, "This adv may not be broadcast from the device we desire. score: '{}'", score);
+    _tracker.SetScore(_tracker.Record(adv, now, candidate), score);
+    ++_statistics.rejected;
+    Metrics::Increment(Metrics::Counter::StateRejectedScore);
+    return false;
+}
+
+// AirPods repeat the same advertisement many times per second. A byte-identical copy of the last
+// one of its side, from the same address, can't change the fields of the side.
+//
+bool StateManager::IsDuplicateAdv(const Advertisement &adv) const
+{
+    const auto &lastAdv = adv.GetAdvState().side == Side::Left ? _adv.left : _adv.right;
+    return lastAdv.has_value() && lastAdv->first.IsSamePacket(adv);
+}
+
+// A duplicate can't change the fields of its side, but refreshing it may make its side the newer
+// one, which `UpdateState` picks the fields available on both sides from. The state has to be
+// rebuilt then, unless both sides agree on those fields.
+//
+bool StateManager::ChangesPrecedence(const Advertisement &adv, Timestamp now) const
+{
+    if (!_adv.left.has_value() || !_adv.right.has_value()) {
+        return false;
+    }
+
+    const bool leftBroadcasted = adv.GetAdvState().side == Side::Left;
+    const bool leftPicked = _adv.left->second > _adv.right->second;
+    const bool leftPickedAfter = leftBroadcasted ? now > _adv.right->second
+                                                 : _adv.left->second > now;
+    if (leftPicked == leftPickedAfter) {
+        return false;
+    }
+
+    const auto &left = _adv.left->first.GetAdvState();
+    const auto &right = _adv.right->first.GetAdvState();
+
+    return (left.model != Model::Unknown && right.model != Model::Unknown &&
+            left.model != right.model) ||
+           (left.pods.left.battery.Available() && right.pods.left.battery.Available() &&
+            left.pods.left != right.pods.left) ||
+           (left.pods.right.battery.Available() && right.pods.right.battery.Available() &&
+            left.pods.right != right.pods.right) ||
+           (left.caseBox.battery.Available() && right.caseBox.battery.Available() &&
+            left.caseBox != right.caseBox);
+}
+
+// Only the timers and the RSSI are refreshed for a duplicate
+//
+bool StateManager::RefreshAdv(const Advertisement &adv, Timestamp now)
+{
+    if (!_boundDevice.has_value() || !AcceptRssi(adv)) {
+        return false;
+    }
+
+    const auto side = adv.GetAdvState().side;
+    _tracker.Touch(_boundDevice.value(), adv, now);
+    _expiryTimer.Arm(kExpiryTimeout);
+
+    auto &lastAdv = side == Side::Left ? _adv.left : _adv.right;
+    lastAdv->second = now;
+
+    ++_statistics.accepted;
+    Metrics::Increment(Metrics::Counter::StateAccepted);
+    ++_statistics.duplicates;
+    Metrics::Increment(Metrics::Counter::StateDuplicates);
+    return true;
+}
+
+// Feeds the filter of the side, an outlier is not compared with the limit
+//
+bool StateManager::AcceptRssi(const Advertisement &adv)
+{
+    auto &filter = adv.GetAdvState().side == Side::Left ? _rssiFilter.left : _rssiFilter.right;
+    if (!filter.Update(adv.GetRssi())) {
+        ++_statistics.outliers;
+        Metrics::Increment(Metrics::Counter::StateOutliers);
+        return true;
+    }
+
+    if (filter.Estimate() < _rssiMin) {
+        LOG(Warn,
+            "AcceptRssi returns false. Reason: Smoothed RSSI is less than the limit. curr: '{}' "
+            "min: '{}'",
+            filter.Estimate(), _rssiMin);
+        ++_statistics.rejected;
+        Metrics::Increment(Metrics::Counter::StateRejectedRssi);
+        return false;
+    }
+    return true;
+}
+
+float StateManager::ScoreAdv(
+    const Advertisement &adv, std::optional<Timestamp> candidateSince) const
+{
+    const auto &lastAdv = adv.GetAdvState().side == Side::Left ? _adv.left : _adv.right;
+    const auto &lastAnotherAdv = adv.GetAdvState().side == Side::Left ? _adv.right : _adv.left;
+
+    const auto &filter =
+        adv.GetAdvState().side == Side::Left ? _rssiFilter.left : _rssiFilter.right;
+
+    const bool concurrent = candidateSince.has_value() && lastAdv.has_value() &&
+                            lastAdv->second > candidateSince.value();
+
+    return _scorer.Score(
+        adv,
+        {
+            .sameSide = lastAdv.has_value() ? &lastAdv->first : nullptr,
+            .anotherSide = lastAnotherAdv.has_value() ? &lastAnotherAdv->first : nullptr,
+            .rssi = filter.Available() ? std::optional{filter.Estimate()} : std::nullopt,
+        },
+        concurrent);
+}
+
+void StateManager::UpdateAdv(Advertisement adv, Timestamp now)
+{
+    // Lock-free unless the timer is idle, the expiry is checked lazily in `OnExpiryTimer`
+    //
+    _expiryTimer.Arm(kExpiryTimeout);
+
+    const auto &advState = adv.GetAdvState();
+
+    if (advState.side == Side::Left) {
+        _adv.left = std::make_pair(std::move(adv), now);
+    }
+    else if (advState.side == Side::Right) {
+        _adv.right = std::make_pair(std::move(adv), now);
+    }
+}
+
+auto StateManager::UpdateState() -> std::optional<UpdateEvent>
+{
+    Metrics::SampledTimer timer{Metrics::Histogram::StateUpdateTime};
+
+    Helper::Sides<std::pair<Advertisement::AdvState, Timestamp>> cachedAdvState;
+
+    if (_adv.left.has_value()) {
+        cachedAdvState.left = std::make_pair(_adv.left->first.GetAdvState(), _adv.left->second);
+    }
+    if (_adv.right.has_value()) {
+        cachedAdvState.right = std::make_pair(_adv.right->first.GetAdvState(), _adv.right->second);
+    }
+
+    State newState;
+
+#define PICK_SIDE(available_condition_with_field)                                                  \
+    [&]() -> decltype(auto) {                                                                      \
+        const Helper::Sides<bool> available = {                                                    \
+            .left = cachedAdvState.left.first.available_condition_with_field,                      \
+            .right = cachedAdvState.right.first.available_condition_with_field,                    \
+        };                                                                                         \
+        if (available.left && available.right) {                                                   \
+            return cachedAdvState.left.second > cachedAdvState.right.second                        \
+                       ? cachedAdvState.left.first                                                 \
+                       : cachedAdvState.right.first;                                               \
+        }                                                                                          \
+        else {                                                                                     \
+            return available.left ? cachedAdvState.left.first : cachedAdvState.right.first;        \
+        }                                                                                          \
+    }()
+
+    newState.model = PICK_SIDE(model != Model::Unknown).model;
+    newState.pods.left = std::move(PICK_SIDE(pods.left.battery.Available()).pods.left);
+    newState.pods.right = std::move(PICK_SIDE(pods.right.battery.Available()).pods.right);
+    newState.caseBox = std::move(PICK_SIDE(caseBox.battery.Available()).caseBox);
+
+#undef PICK_SIDE
+
+    const PackedState packedState{newState};
+    const auto oldState = _currentState.load(std::memory_order_relaxed);
+    if (packedState == oldState) {
+        return std::nullopt;
+    }
+
+    _currentState.store(packedState, std::memory_order_release);
+    return UpdateEvent{.oldState = oldState, .newState = packedState};
+}
+
+bool StateManager::ResetAll()
+{
+    const bool wasAvailable = _currentState.load(std::memory_order_relaxed).HasValue();
+
+    _adv.left.reset();
+    _adv.right.reset();
+    _rssiFilter.left.Reset();
+    _rssiFilter.right.Reset();
+    _currentState.store(PackedState{}, std::memory_order_release);
+
+    // Let the next accepted device be bound. The scores of the tracked devices are relative to
+    // the bound one, so they are forgotten as well.
+    //
+    _boundDevice.reset();
+    _tracker.Clear();
+
+    return wasAvailable;
+}
+
+// Fires when the oldest side may have expired. Sides that are still fresh re-arm the timer for
+// their exact expiry. Packets only move the expiry without waking anything up, so while
+// advertisements keep coming it fires about once per `kExpiryTimeout`, and not at all once the
+// device is lost.
+//
+void StateManager::OnExpiryTimer()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    const auto now = _scheduler.Now();
+    std::optional<Timestamp> nextExpiry;
+
+    for (const auto side : {Side::Left, Side::Right}) {
+        const auto &adv = side == Side::Left ? _adv.left : _adv.right;
+        if (!adv.has_value()) {
+            continue;
+        }
+
+        const auto expiry = adv->second + kExpiryTimeout;
+        if (expiry <= now) {
+            DoStateReset(side);
+        }
+        else if (!nextExpiry.has_value() || expiry < nextExpiry.value()) {
+            nextExpiry = expiry;
+        }
+    }
+
+    if (nextExpiry.has_value()) {
+        _expiryTimer.Arm(std::chrono::ceil<std::chrono::milliseconds>(nextExpiry.value() - now));
+        return;
+    }
+
+    const bool disconnected = DoLost();
+    lock.unlock();
+
+    if (disconnected) {
+        _cbDisconnected.Invoke();
+    }
+}
+
+bool StateManager::DoLost()
+{
+    if (_currentState.load(std::memory_order_relaxed).HasValue()) {
+        LOG(Info, "StateManager: Device is lost.");
+    }
+    return ResetAll();
+}
+
+void StateManager::DoStateReset(Side side)
+{
+    auto &adv = side == Side::Left ? _adv.left : _adv.right;
+    if (adv.has_value()) {
+        LOG(Info, "StateManager: DoStateReset called. Side: {}", Helper::ToString(side));
+        adv.reset();
+    }
+
+    auto &filter = side == Side::Left ? _rssiFilter.left : _rssiFilter.right;
+    filter.Reset();
+}
+} // namespace Details
+} // namespace Core::AirPods
@@ -0,0 +1,353 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <span>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <functional>
+
+#include "Bluetooth_abstract.h"
+#include "Aes.h"
+#include "AppleCP.h"
+#include "DeviceTracker.h"
+#include "IdentityScorer.h"
+#include "RssiFilter.h"
+#include "../Helper.h"
+
+namespace Benchmark {
+struct StateManagerAccess;
+} // namespace Benchmark
+
+namespace Core::AirPods {
+
+//
+// Structures
+//
+
+namespace Details {
+
+struct BasicState {
+    Battery battery;
+    bool isCharging{false};
+
+    bool operator==(const BasicState &rhs) const = default;
+};
+} // namespace Details
+
+struct PodState : Details::BasicState {
+    bool isInEar{false};
+
+    bool operator==(const PodState &rhs) const = default;
+};
+
+struct CaseState : Details::BasicState {
+    bool isBothPodsInCase{false};
+    bool isLidOpened{false};
+
+    bool operator==(const CaseState &rhs) const = default;
+};
+
+struct PodsState {
+    PodState left, right;
+
+    bool operator==(const PodsState &rhs) const = default;
+};
+
+// The display name is not part of the state, it only changes with the bound device and the model,
+// see `Manager::GetDisplayName`
+//
+struct State {
+    Model model{Model::Unknown};
+    PodsState pods;
+    CaseState caseBox;
+
+    bool operator==(const State &rhs) const = default;
+};
+
+// `State` packed in a single word, which is how it is kept and handed between threads. Two of them
+// are compared with one integer compare, published with an atomic store, and the fields changed
+// between them are the bits set in their XOR. A default constructed one has no value.
+//
+class PackedState
+{
+public:
+    // The bits of each field in the word. A battery is its value in percent, with the high bit set
+    // if it is available.
+    //
+    enum class Field : uint64_t {
+        Model = 0xFFull << 0,
+        LeftBattery = 0xFFull << 8,
+        RightBattery = 0xFFull << 16,
+        CaseBattery = 0xFFull << 24,
+        LeftCharging = 1ull << 32,
+        RightCharging = 1ull << 33,
+        CaseCharging = 1ull << 34,
+        LeftInEar = 1ull << 35,
+        RightInEar = 1ull << 36,
+        BothPodsInCase = 1ull << 37,
+        LidOpened = 1ull << 38,
+    };
+
+    class Changes
+    {
+    public:
+        constexpr explicit Changes(uint64_t bits) : _bits{bits} {}
+
+        constexpr bool Contains(Field field) const
+        {
+            return (_bits & Helper::ToUnderlying(field)) != 0;
+        }
+
+        constexpr bool Empty() const
+        {
+            return _bits == 0;
+        }
+
+    private:
+        uint64_t _bits;
+    };
+
+    PackedState() = default;
+    explicit PackedState(const State &state);
+
+    State Unpack() const;
+
+    constexpr bool HasValue() const
+    {
+        return (_word & kHasValue) != 0;
+    }
+
+    constexpr uint64_t GetWord() const
+    {
+        return _word;
+    }
+
+    constexpr Changes Diff(PackedState rhs) const
+    {
+        return Changes{_word ^ rhs._word};
+    }
+
+    bool operator==(const PackedState &rhs) const = default;
+
+private:
+    constexpr static uint64_t kHasValue = 1ull << 63;
+
+    uint64_t _word{0};
+};
+static_assert(sizeof(PackedState) == sizeof(uint64_t));
+static_assert(std::atomic<PackedState>::is_always_lock_free);
+
+//
+// Classes
+//
+
+namespace Details {
+
+// Only the fields we need are extracted from `ReceivedData`, so it is cheap to construct.
+// It's move-only to make sure it is constructed once and then handed off between stages.
+//
+class Advertisement
+{
+public:
+    using AddressType = decltype(Bluetooth::AdvertisementReceivedData::address);
+    using TimestampType = decltype(Bluetooth::AdvertisementReceivedData::timestamp);
+    using DesensitizedData = AppleCP::AirPods::DesensitizedData;
+
+    // The fields only used to tell devices apart are not part of the public state
+    //
+    struct AdvState : AirPods::State {
+        Side side;
+        AppleCP::Color color{AppleCP::Color::White};
+        uint8_t lidSwitchCount{0};
+    };
+
+    static bool IsDesiredAdv(const Bluetooth::AdvertisementReceivedData &data);
+
+    Advertisement(const Bluetooth::AdvertisementReceivedData &data);
+
+    Advertisement(const Advertisement &rhs) = delete;
+    Advertisement(Advertisement &&rhs) noexcept = default;
+
+    Advertisement &operator=(const Advertisement &rhs) = delete;
+    Advertisement &operator=(Advertisement &&rhs) noexcept = default;
+
+    int16_t GetRssi() const;
+    const TimestampType &GetTimestamp() const;
+    AddressType GetAddress() const;
+    const DesensitizedData &GetDesensitizedData() const;
+    const AdvState &GetAdvState() const;
+    const Aes::Block &GetEncryptedPayload() const;
+
+    // Whether both are the same bytes from the same address, the RSSI and timestamp may differ
+    //
+    bool IsSamePacket(const Advertisement &rhs) const;
+
+    // Replaces the batteries with the exact ones decrypted from the payload. They must be close to
+    // the ones in the clear, otherwise the key is wrong, nothing is changed and it returns false.
+    //
+    bool ApplyDecryptedPayload(const Aes::Block &decrypted);
+
+private:
+    int16_t _rssi{};
+    TimestampType _timestamp{};
+    AddressType _address{};
+    DesensitizedData _desensitizedData;
+    Aes::Block _encryptedPayload;
+    uint64_t _payloadHash{};
+    AdvState _state;
+};
+
+// AirPods use Random Non-resolvable device addresses for privacy reasons. This means we
+// can't "Remember" the user's AirPods by any device property. Instead, the devices around are
+// tracked by their recent addresses, and a new address is linked to the device we are bound to
+// once its packets are scored as ours, see `DeviceTracker` and `IdentityScorer`.
+//
+class StateManager
+{
+public:
+    // `oldState` has no value if the device was not available before
+    //
+    struct UpdateEvent {
+        PackedState oldState;
+        PackedState newState;
+    };
+
+    struct Statistics {
+        uint64_t accepted{0};
+        uint64_t rejected{0}; // Too weak, or not scored high enough to be ours
+        uint64_t ignored{0};  // From a device known to be another one
+        uint64_t outliers{0}; // RSSI rejected by the filter of the bound device
+        uint64_t duplicates{0}; // Accepted, same bytes as the last one of the side
+
+        // Accepted advertisements decrypted with the key, or not matching their clear batteries
+        //
+        uint64_t decrypted{0};
+        uint64_t decryptionMismatched{0};
+
+        // Address changes of the bound device, and the time from the first packet with the new
+        // address to the one accepted
+        //
+        uint64_t rotations{0};
+        std::chrono::milliseconds rotationLatencyTotal{0};
+        std::chrono::milliseconds rotationLatencyMax{0};
+
+        uint64_t batches{0};
+        DeviceTracker::Statistics tracker;
+    };
+
+    // The smoothed signal of a side of the bound device
+    //
+    struct Signal {
+        float rssi{0.f};
+        Proximity proximity{Proximity::Unknown};
+    };
+
+    using FnStateChanged = std::function<void(const UpdateEvent &)>;
+    using FnDisconnected = std::function<void()>;
+
+    // Timestamps and expiry follow `scheduler`, pass a virtual one to replay a capture faster
+    // than real time
+    //
+    explicit StateManager(Helper::Scheduler &scheduler = Helper::Scheduler::GetReal());
+    ~StateManager();
+
+    // The callbacks are invoked without holding the internal lock. `CbStateChanged` is invoked
+    // on the thread calling `OnAdvReceived`, `CbDisconnected` may also be invoked on the timer
+    // thread, or the thread advancing a virtual scheduler, when the device is lost.
+    //
+    inline auto &CbStateChanged()
+    {
+        return _cbStateChanged;
+    }
+    inline auto &CbDisconnected()
+    {
+        return _cbDisconnected;
+    }
+
+    // Lock-free, it may be called from any thread
+    //
+    std::optional<PackedState> GetCurrentState() const;
+
+    // These take the internal lock
+    //
+    Helper::Sides<std::optional<Signal>> GetSignal() const;
+    Statistics GetStatistics() const;
+
+    bool OnAdvReceived(Advertisement adv);
+
+    // Takes the lock once for a burst of advertisements and emits at most one state change.
+    // They are validated in order, so the newest valid one of each side wins. The valid ones
+    // are moved from. Returns the number of accepted advertisements.
+    //
+    size_t OnAdvBatch(std::span<Advertisement> advs);
+    void Disconnect();
+
+    void OnRssiMinChanged(int16_t rssiMin);
+    void OnIdentityParametersChanged(const IdentityScorer::Parameters &parameters);
+
+    // With a key, the batteries are decrypted from the advertisements in steps of 1%
+    //
+    void OnEncryptionKeyChanged(const std::optional<Aes::Key> &key);
+
+private:
+    friend struct ::Benchmark::StateManagerAccess;
+
+    using Timestamp = Helper::Scheduler::TimePoint;
+
+    // A side is reset if it has not been advertised for this long, and the device is lost once
+    // both sides are reset
+    //
+    constexpr static std::chrono::seconds kExpiryTimeout{10};
+
+    mutable std::mutex _mutex;
+
+    Helper::Callback<FnStateChanged> _cbStateChanged;
+    Helper::Callback<FnDisconnected> _cbDisconnected;
+    Helper::Scheduler &_scheduler;
+    Helper::Timer _expiryTimer;
+    Helper::Sides<std::optional<std::pair<Advertisement, Timestamp>>> _adv;
+    Helper::Sides<RssiFilter> _rssiFilter;
+    DeviceTracker _tracker;
+    IdentityScorer _scorer;
+    std::optional<Aes::Decryptor> _decryptor;
+    std::optional<DeviceTracker::DeviceId> _boundDevice; // Pinned in the tracker
+    std::atomic<PackedState> _currentState; // Written with `_mutex` held
+    int16_t _rssiMin{std::numeric_limits<int16_t>::max()};
+    Statistics _statistics;
+
+    bool AcceptAdv(const Advertisement &adv, Timestamp now);
+    bool AcceptRssi(const Advertisement &adv);
+    bool IsDuplicateAdv(const Advertisement &adv) const;
+    bool ChangesPrecedence(const Advertisement &adv, Timestamp now) const;
+    bool RefreshAdv(const Advertisement &adv, Timestamp now);
+    float ScoreAdv(const Advertisement &adv, std::optional<Timestamp> candidateSince) const;
+    void UpdateAdv(Advertisement adv, Timestamp now);
+    std::optional<UpdateEvent> UpdateState();
+    bool ResetAll();
+
+    void OnExpiryTimer();
+    bool DoLost();
+    void DoStateReset(Side side);
+};
+} // namespace Details
+} // namespace Core::AirPods
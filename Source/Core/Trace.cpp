@@ -0,0 +1,482 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include "Trace.h"
+
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <condition_variable>
+
+#include "Capture.h"
+#include "../Logger.h"
+
+namespace Core::Trace {
+namespace Details {
+
+constexpr auto kDrainInterval = std::chrono::milliseconds{500};
+
+inline const EventInfo *GetEventInfo(uint64_t event)
+{
+    return event < kEvents.size() ? &kEvents[event] : nullptr;
+}
+
+inline size_t GetArgSize(ArgType type)
+{
+    switch (type) {
+    case ArgType::UInt8:
+        return 1;
+    case ArgType::UInt16:
+    case ArgType::Int16:
+        return 2;
+    case ArgType::UInt32:
+        return 4;
+    default:
+        return 8;
+    }
+}
+
+inline int64_t GetWallTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+inline void AppendVarint(std::vector<uint8_t> &output, uint64_t value)
+{
+    while (value >= 0x80) {
+        output.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<uint8_t>(value));
+}
+
+inline std::optional<uint64_t> ReadVarint(std::span<const uint8_t> &input)
+{
+    uint64_t result = 0;
+    for (size_t i = 0; i < input.size() && i < 10; ++i) {
+        result |= static_cast<uint64_t>(input[i] & 0x7F) << (i * 7);
+        if ((input[i] & 0x80) == 0) {
+            input = input.subspan(i + 1);
+            return result;
+        }
+    }
+    return std::nullopt;
+}
+
+// The addresses are hashed here, not on the hot path
+//
+inline uint64_t StoredArg(ArgType type, uint64_t value)
+{
+    return type == ArgType::Address ? Capture::HashAddress(value) : value;
+}
+
+// Drains the rings of all threads into the file periodically
+//
+class Writer : Helper::NonCopyable
+{
+public:
+    static Writer &GetInstance()
+    {
+        static Writer instance;
+        return instance;
+    }
+
+    ~Writer()
+    {
+        Close();
+    }
+
+    bool Open(const std::filesystem::path &path)
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        DoClose(lock);
+
+        _file.open(path, std::ios::binary | std::ios::trunc);
+        if (!_file.is_open()) {
+            LOG(Warn, "Open trace file failed. Path: '{}'", path.string());
+            return false;
+        }
+
+        const FileHeader header;
+        _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        // Events left from a previous file are discarded, the deltas start over
+        //
+        for (auto &state : _states) {
+            Entry entry;
+            while (state.buffer->TryPop(entry)) {
+            }
+            state.lastTicks = 0;
+            state.lastDropped = state.buffer->GetDroppedCount();
+        }
+        WriteBlock(kNoThread, {});
+
+        _stop = false;
+        _thread = std::thread{&Writer::ThreadProc, this};
+        gOpened.store(true, std::memory_order_release);
+
+        LOG(Info, "Trace file opened. Path: '{}'", path.string());
+        return true;
+    }
+
+    void Close()
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        DoClose(lock);
+    }
+
+    void Flush()
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (_file.is_open()) {
+            Drain();
+        }
+    }
+
+    ThreadBuffer *Acquire()
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        for (auto &state : _states) {
+            bool expected = false;
+            if (state.buffer->owned.compare_exchange_strong(expected, true)) {
+                return state.buffer;
+            }
+        }
+
+        if (_states.size() >= kMaxThreads) {
+            return nullptr;
+        }
+
+        // Never freed, the lease of a thread exiting after the static destructors still gives
+        // its ring back
+        //
+        auto &state = _states.emplace_back(ThreadState{.buffer = new ThreadBuffer});
+        state.buffer->owned.store(true);
+        return state.buffer;
+    }
+
+private:
+    constexpr static uint32_t kNoThread = std::numeric_limits<uint32_t>::max();
+
+    struct ThreadState {
+        ThreadBuffer *buffer;
+        uint64_t lastTicks{0};
+        uint64_t lastDropped{0};
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop{false};
+    std::thread _thread;
+    std::ofstream _file;
+    std::vector<ThreadState> _states; // Never shrinks, the rings are reused by new threads
+    std::vector<uint8_t> _encoded;
+
+    void DoClose(std::unique_lock<std::mutex> &lock)
+    {
+        if (!_file.is_open()) {
+            return;
+        }
+
+        gOpened.store(false, std::memory_order_release);
+
+        _stop = true;
+        _cv.notify_all();
+        lock.unlock();
+        _thread.join();
+        lock.lock();
+
+        Drain();
+        WriteBlock(kNoThread, {});
+        _file.close();
+
+        LOG(Info, "Trace file closed.");
+    }
+
+    void ThreadProc()
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        while (!_cv.wait_for(lock, kDrainInterval, [this] { return _stop; })) {
+            Drain();
+        }
+    }
+
+    void Drain()
+    {
+        for (uint32_t index = 0; index < _states.size(); ++index) {
+            auto &state = _states[index];
+            _encoded.clear();
+
+            Entry entry;
+            while (state.buffer->TryPop(entry)) {
+                Encode(state, entry);
+            }
+
+            const auto dropped = state.buffer->GetDroppedCount();
+            if (dropped != state.lastDropped) {
+                Encode(
+                    state, Entry{
+                               .ticks = state.lastTicks,
+                               .args = {dropped - state.lastDropped},
+                               .event = Event::Dropped,
+                           });
+                state.lastDropped = dropped;
+            }
+
+            if (!_encoded.empty()) {
+                WriteBlock(index, _encoded);
+            }
+        }
+        _file.flush();
+    }
+
+    void Encode(ThreadState &state, const Entry &entry)
+    {
+        const auto &info = kEvents[Helper::ToUnderlying(entry.event)];
+
+        AppendVarint(_encoded, Helper::ToUnderlying(entry.event));
+        AppendVarint(_encoded, entry.ticks - state.lastTicks);
+        state.lastTicks = entry.ticks;
+
+        for (size_t i = 0; i < info.argCount; ++i) {
+            const auto value = StoredArg(info.args[i], entry.args[i]);
+            const auto bytes = reinterpret_cast<const uint8_t *>(&value);
+            _encoded.insert(_encoded.end(), bytes, bytes + GetArgSize(info.args[i]));
+        }
+    }
+
+    void WriteBlock(uint32_t thread, std::span<const uint8_t> events)
+    {
+        const BlockHeader header{
+            .wallTime = GetWallTime(),
+            .ticks = ReadTicks(),
+            .thread = thread,
+            .size = static_cast<uint32_t>(events.size()),
+        };
+        _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        _file.write(reinterpret_cast<const char *>(events.data()), events.size());
+    }
+};
+
+// Gives the ring back when its thread exits
+//
+class ThreadBufferLease
+{
+public:
+    inline ~ThreadBufferLease()
+    {
+        if (tBuffer != nullptr) {
+            tBuffer->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+ThreadBuffer *AcquireThreadBuffer()
+{
+    thread_local ThreadBufferLease lease;
+
+    tBuffer = Writer::GetInstance().Acquire();
+    return tBuffer;
+}
+
+void LogText(Event event, std::span<const uint64_t> args)
+{
+    const auto &info = kEvents[Helper::ToUnderlying(event)];
+
+    std::array<uint64_t, kMaxArgs> stored{};
+    for (size_t i = 0; i < args.size(); ++i) {
+        stored[i] = StoredArg(info.args[i], args[i]);
+    }
+    LOG(Trace, "{}", Render(event, std::span{stored}.first(args.size())));
+}
+} // namespace Details
+
+bool Open(const std::filesystem::path &path)
+{
+    return Details::Writer::GetInstance().Open(path);
+}
+
+void Close()
+{
+    Details::Writer::GetInstance().Close();
+}
+
+void Flush()
+{
+    Details::Writer::GetInstance().Flush();
+}
+
+std::optional<std::vector<DecodedEvent>> Decode(const std::filesystem::path &path)
+{
+    std::ifstream file{path, std::ios::binary};
+
+    FileHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, FileHeader{}.magic, sizeof(header.magic)) != 0 ||
+        header.version != kVersion)
+    {
+        LOG(Warn, "Not a trace file of version {}. Path: '{}'", kVersion, path.string());
+        return std::nullopt;
+    }
+
+    struct RawEvent {
+        uint64_t ticks;
+        uint32_t thread;
+        Event event;
+        std::array<uint64_t, kMaxArgs> args;
+    };
+
+    std::vector<RawEvent> rawEvents;
+    std::vector<BlockHeader> samples;
+    std::vector<uint64_t> lastTicks;
+    std::vector<uint8_t> bytes;
+
+    BlockHeader block;
+    while (file.read(reinterpret_cast<char *>(&block), sizeof(block))) {
+        samples.push_back(block);
+
+        bytes.resize(block.size);
+        if (!file.read(reinterpret_cast<char *>(bytes.data()), bytes.size())) {
+            LOG(Warn, "The trace file is truncated, the last block is ignored.");
+            break;
+        }
+        if (block.size == 0) {
+            continue;
+        }
+        if (block.thread >= kMaxThreads) {
+            LOG(Warn, "The trace file is corrupted.");
+            return std::nullopt;
+        }
+        if (block.thread >= lastTicks.size()) {
+            lastTicks.resize(block.thread + 1, 0);
+        }
+
+        std::span<const uint8_t> input{bytes};
+        while (!input.empty()) {
+            const auto event = Details::ReadVarint(input);
+            const auto info = event.has_value() ? Details::GetEventInfo(event.value()) : nullptr;
+            const auto delta = info != nullptr ? Details::ReadVarint(input) : std::nullopt;
+            if (!delta.has_value()) {
+                LOG(Warn, "The trace file is corrupted or from a newer version.");
+                return std::nullopt;
+            }
+
+            auto &rawEvent = rawEvents.emplace_back(RawEvent{
+                .ticks = lastTicks[block.thread] += delta.value(),
+                .thread = block.thread,
+                .event = static_cast<Event>(event.value()),
+                .args = {},
+            });
+
+            for (size_t i = 0; i < info->argCount; ++i) {
+                const auto size = Details::GetArgSize(info->args[i]);
+                if (input.size() < size) {
+                    LOG(Warn, "The trace file is corrupted.");
+                    return std::nullopt;
+                }
+                std::memcpy(&rawEvent.args[i], input.data(), size);
+                input = input.subspan(size);
+
+                if (info->args[i] == ArgType::Int16) {
+                    rawEvent.args[i] = static_cast<uint64_t>(
+                        static_cast<int64_t>(static_cast<int16_t>(rawEvent.args[i])));
+                }
+            }
+        }
+    }
+
+    // The ticks are converted with the rate between the first and the last samples
+    //
+    double ticksPerMicrosecond = 0.0;
+    if (samples.size() >= 2 && samples.back().wallTime > samples.front().wallTime) {
+        ticksPerMicrosecond =
+            static_cast<double>(samples.back().ticks - samples.front().ticks) /
+            static_cast<double>(samples.back().wallTime - samples.front().wallTime);
+    }
+
+    std::vector<DecodedEvent> result;
+    result.reserve(rawEvents.size());
+
+    for (const auto &rawEvent : rawEvents) {
+        int64_t wallTime = samples.empty() ? 0 : samples.front().wallTime;
+        if (ticksPerMicrosecond > 0.0) {
+            wallTime += static_cast<int64_t>(
+                static_cast<double>(static_cast<int64_t>(rawEvent.ticks - samples.front().ticks)) /
+                ticksPerMicrosecond);
+        }
+
+        result.push_back(DecodedEvent{
+            .timestamp = std::chrono::system_clock::time_point{std::chrono::duration_cast<
+                std::chrono::system_clock::duration>(std::chrono::microseconds{wallTime})},
+            .thread = rawEvent.thread,
+            .event = rawEvent.event,
+            .args = rawEvent.args,
+        });
+    }
+
+    std::ranges::stable_sort(result, {}, &DecodedEvent::timestamp);
+    return result;
+}
+
+std::string Render(Event event, std::span<const uint64_t> args)
+{
+    const auto info = Details::GetEventInfo(Helper::ToUnderlying(event));
+    if (info == nullptr) {
+        return "Unknown event " + std::to_string(Helper::ToUnderlying(event));
+    }
+
+    const auto renderArg = [](ArgType type, uint64_t value) {
+        switch (type) {
+        case ArgType::Int16:
+            return std::to_string(static_cast<int16_t>(value));
+        case ArgType::Bytes: {
+            constexpr std::string_view kDigits = "0123456789abcdef";
+            std::string result;
+            for (size_t i = 0; i < sizeof(value); ++i) {
+                const auto byte = static_cast<uint8_t>(value >> (i * 8));
+                result += i == 0 ? "" : " ";
+                result += kDigits[byte >> 4];
+                result += kDigits[byte & 0xF];
+            }
+            return result;
+        }
+        default:
+            return std::to_string(value);
+        }
+    };
+
+    std::string result;
+    size_t argIndex = 0;
+    for (size_t i = 0; i < info->format.size(); ++i) {
+        if (info->format.substr(i, 2) == "{}" && argIndex < args.size()) {
+            result += renderArg(info->args[argIndex], args[argIndex]);
+            ++argIndex;
+            ++i;
+        }
+        else {
+            result += info->format[i];
+        }
+    }
+    return result;
+}
+} // namespace Core::Trace
@@ -0,0 +1,308 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <bit>
+#include <span>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <string_view>
+
+#if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+    #define APD_TRACE_RDTSC
+    #if defined _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
+
+#include "../Helper.h"
+#include "../Logger.h"
+
+// A binary trace channel for the hot paths, where formatting a log line for every packet would
+// cost more than handling the packet itself.
+//
+// A call site records the ID of a static format and its raw arguments into a ring of its own
+// thread, which only takes a few nanoseconds. A background thread drains the rings into a compact
+// file, which is rendered to text offline by `ApdTraceDecoder`, see `Tools/TraceDecoder.cpp`.
+// When no trace file is opened, the events are formatted and logged at the trace level instead,
+// so `--trace` still shows them.
+//
+// The file is a `FileHeader` followed by `BlockHeader`s, each followed by the encoded events of a
+// thread. All the fields are stored in the host (little-endian) order.
+//
+namespace Core::Trace {
+
+// The values are stored in the files, only append new ones
+//
+enum class Event : uint16_t {
+    Dropped = 0,
+    AdvDispatched = 1,
+    ManufacturerDataTooLarge = 2,
+    ManufacturerDataTooMany = 3,
+    AdvQueueFull = 4,
+    AirPodsAdvReceived = 5,
+
+    _Max
+};
+
+// `Address` is a raw Bluetooth address, it is hashed with `Capture::HashAddress` before being
+// stored or logged. `Bytes` are 8 raw bytes, see `LoadBytes`.
+//
+enum class ArgType : uint8_t { UInt8, UInt16, UInt32, UInt64, Int16, Address, Bytes };
+
+constexpr inline size_t kMaxArgs = 4;
+
+struct EventInfo {
+    std::string_view format; // Each "{}" is replaced by the next argument
+    uint8_t argCount;
+    std::array<ArgType, kMaxArgs> args;
+};
+
+// clang-format off
+constexpr inline std::array<EventInfo, Helper::ToUnderlying(Event::_Max)> kEvents{{
+    {"Trace: {} events dropped, the buffer of the thread was full.",
+     1, {ArgType::UInt64}},
+    {"Advertisement dispatched. Address Hash: {}, RSSI: {}, Sections: {}",
+     3, {ArgType::Address, ArgType::Int16, ArgType::UInt8}},
+    {"Manufacturer data too large, ignore it. CompanyId: {}, Size: {}",
+     2, {ArgType::UInt16, ArgType::UInt32}},
+    {"Too many manufacturer data sections, ignore the rest.",
+     0, {}},
+    {"Advertisement queue is full, dropped. Address Hash: {}, RSSI: {}",
+     2, {ArgType::Address, ArgType::Int16}},
+    {"AirPods advertisement received. Data: {} {}, Address Hash: {}, RSSI: {}",
+     4, {ArgType::Bytes, ArgType::Bytes, ArgType::Address, ArgType::Int16}},
+}};
+// clang-format on
+
+constexpr inline uint32_t kVersion = 1;
+
+// The headers and the arguments are copied to the file byte for byte, and the decoder reads them
+// back the same way, so a big-endian host would produce files nobody else could decode
+//
+static_assert(std::endian::native == std::endian::little);
+
+struct FileHeader {
+    char magic[4]{'A', 'P', 'D', 'T'};
+    uint16_t version{kVersion};
+    uint8_t reserved[10]{};
+};
+static_assert(sizeof(FileHeader) == 16);
+
+// The clock of the events is sampled with the wall clock at each block, the decoder converts
+// between them. An event is its varint ID, the varint delta of its ticks from the previous event
+// of the same thread, then its arguments with the sizes of their types.
+//
+struct BlockHeader {
+    int64_t wallTime; // Microseconds since the Unix epoch
+    uint64_t ticks;
+    uint32_t thread;
+    uint32_t size; // Bytes of the events following
+};
+static_assert(sizeof(BlockHeader) == 24);
+static_assert(std::is_trivially_copyable_v<BlockHeader>);
+
+// The events of the threads beyond this number alive at the same time are not recorded
+//
+constexpr inline uint32_t kMaxThreads = 1024;
+
+// Starts recording to `path`, the previous file is closed. Thread-safe.
+//
+bool Open(const std::filesystem::path &path);
+void Close();
+
+// Writes the recorded events now instead of waiting for the background thread
+//
+void Flush();
+
+struct DecodedEvent {
+    std::chrono::system_clock::time_point timestamp;
+    uint32_t thread;
+    Event event;
+    std::array<uint64_t, kMaxArgs> args;
+};
+
+// Reads the whole file, the events are ordered by time
+//
+std::optional<std::vector<DecodedEvent>> Decode(const std::filesystem::path &path);
+
+std::string Render(Event event, std::span<const uint64_t> args);
+
+// Up to 8 bytes from `offset` for an argument of type `Bytes`, the missing ones are zero
+//
+inline uint64_t LoadBytes(std::span<const uint8_t> bytes, size_t offset)
+{
+    uint64_t result = 0;
+    if (offset < bytes.size()) {
+        const auto size = std::min(sizeof(result), bytes.size() - offset);
+        std::memcpy(&result, bytes.data() + offset, size);
+    }
+    return result;
+}
+
+namespace Details {
+
+struct Entry {
+    uint64_t ticks;
+    std::array<uint64_t, kMaxArgs> args;
+    Event event;
+};
+
+// The ring of a thread, only pushed by that thread and only popped by the writer thread. Unlike
+// `Helper::SpscRing`, pushing never wakes up the consumer, which polls them periodically.
+//
+class ThreadBuffer : Helper::NonCopyable
+{
+public:
+    constexpr static size_t kCapacity = 1024;
+
+    inline bool TryPush(const Entry &entry)
+    {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == kCapacity) {
+            _dropped.store(
+                _dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        _storage[tail % kCapacity] = entry;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    inline bool TryPop(Entry &entry)
+    {
+        const auto head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        entry = _storage[head % kCapacity];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    inline uint64_t GetDroppedCount() const
+    {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    // Taken by a thread until it exits, then reused by the next one
+    //
+    std::atomic<bool> owned{false};
+
+private:
+    constexpr static size_t kCacheLineSize = 64;
+
+    alignas(kCacheLineSize) std::atomic<size_t> _head{0};
+    alignas(kCacheLineSize) std::atomic<size_t> _tail{0};
+    std::atomic<uint64_t> _dropped{0};
+    std::array<Entry, kCapacity> _storage{};
+};
+
+inline std::atomic<bool> gOpened{false};
+inline thread_local ThreadBuffer *tBuffer{nullptr};
+
+// nullptr when `kMaxThreads` threads already hold a ring
+//
+ThreadBuffer *AcquireThreadBuffer();
+void LogText(Event event, std::span<const uint64_t> args);
+
+// The time stamp counter is much cheaper to read than the clocks of the OS, it is converted to
+// the wall time when decoding
+//
+inline uint64_t ReadTicks()
+{
+#if defined APD_TRACE_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+template <class T>
+inline uint64_t ToArg(T value)
+{
+    static_assert(std::is_integral_v<T> || std::is_enum_v<T>);
+    if constexpr (std::is_enum_v<T>) {
+        return static_cast<uint64_t>(Helper::ToUnderlying(value));
+    }
+    else if constexpr (std::is_signed_v<T>) {
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    }
+    else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+inline bool IsActive()
+{
+    if (gOpened.load(std::memory_order_relaxed)) {
+        return true;
+    }
+    if constexpr (Logger::Details::IsCompiledIn<Logger::Details::Level::Trace>()) {
+        return Logger::Details::ShouldLog<Logger::Details::Level::Trace>();
+    }
+    else {
+        return false;
+    }
+}
+
+template <Event kEvent, class... Args>
+inline void Record(Args... args)
+{
+    static_assert(sizeof...(Args) == kEvents[Helper::ToUnderlying(kEvent)].argCount);
+
+    Entry entry{.args = {ToArg(args)...}, .event = kEvent};
+
+    if (!gOpened.load(std::memory_order_relaxed)) {
+        LogText(kEvent, std::span{entry.args}.first(sizeof...(Args)));
+        return;
+    }
+
+    auto buffer = tBuffer;
+    if (buffer == nullptr) [[unlikely]] {
+        buffer = AcquireThreadBuffer();
+        if (buffer == nullptr) {
+            return;
+        }
+    }
+
+    entry.ticks = ReadTicks();
+    buffer->TryPush(entry);
+}
+} // namespace Details
+} // namespace Core::Trace
+
+// The arguments are only evaluated if the event is recorded or logged, see `Core::Trace`
+//
+#define APD_TRACE(event, ...)                                                                      \
+    do {                                                                                           \
+        if (Core::Trace::Details::IsActive()) {                                                    \
+            Core::Trace::Details::Record<Core::Trace::Event::event>(__VA_ARGS__);                  \
+        }                                                                                          \
+    } while (false)
@@ -377,14 +377,17 @@ AsyncChecker::~AsyncChecker()
 
 void AsyncChecker::Start()
 {
-    // clang-format off
-    _timer.Start(kInterval, [this] { Checker(); }, true);
-    // clang-format on
+    // The check blocks on the network, so it runs on its own thread instead of a `Helper::Timer`
+    //
+    _worker.Start(kInterval, [this] {
+        Checker();
+        return true;
+    });
 }
 
 void AsyncChecker::Stop()
 {
-    _timer.Stop();
+    _worker.Stop();
 }
 
 void AsyncChecker::Checker()
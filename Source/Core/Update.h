@@ -68,7 +68,7 @@ private:
     constexpr static auto kInterval = 1h;
 
     FnCallback _callback;
-    Helper::Timer _timer;
+    Helper::ConWorker _worker;
     bool _isFirst = true;
 
     void Checker();
@@ -29,6 +29,8 @@
 
 #include <Config.h>
 #include "Utils.h"
+#include "Assert.h"
+#include "Logger.h"
 
 constexpr auto kStackTraceFileName = "StackTrace.log";
 
@@ -53,6 +55,8 @@ void Initialize()
     // Delete the last StackTrace log file, if any
     //
     workspace.remove(kStackTraceFileName);
+
+    Assert::SetHandler([](const std::string &content) { FatalError(content, true); });
 }
 } // namespace Error
 
@@ -60,6 +64,11 @@ void Initialize()
 {
     Error::Impl::WriteStackTraceFile();
 
+    // The message box may never be closed, so the lines before the error are written first
+    //
+    LOG(Critical, "{}", content);
+    Logger::FlushBeforeAbort();
+
 #if !defined APD_OS_WIN
     #error "Need to port."
 #endif
@@ -27,6 +27,7 @@
 #include "../Error.h"
 #include "../Application.h"
 #include "../Core/AppleCP.h"
+#include "../Core/Metrics.h"
 #include "SelectWindow.h"
 
 using namespace std::chrono_literals;
@@ -192,7 +193,7 @@ NewVersionAction NewVersionMessageBox(
 
 MainWindow::MainWindow(QWidget *parent) : QDialog{parent}
 {
-    qRegisterMetaType<Core::AirPods::State>("Core::AirPods::State");
+    qRegisterMetaType<Core::AirPods::PackedState>("Core::AirPods::PackedState");
     qRegisterMetaType<Core::Update::ReleaseInfo>("Core::Update::ReleaseInfo");
 
     _videoWidget = new VideoWidget{this};
@@ -246,15 +247,18 @@ MainWindow::MainWindow(QWidget *parent) : QDialog{parent}
     _updateChecker.Start();
 }
 
-void MainWindow::UpdateState(const Core::AirPods::State &state)
+void MainWindow::UpdateState(Core::AirPods::PackedState state, const QString &displayName)
 {
     LOG(Info, "MainWindow::UpdateState");
 
+    Core::Metrics::ScopedTimer timer{Core::Metrics::Histogram::GuiUpdateTime};
+
     _status = Status::Updating;
-    _cachedState = state;
+    _cachedState = state.Unpack();
+    _displayName = displayName;
     Repaint();
-    ApdApp->GetTrayIcon()->UpdateState(state);
-    ApdApp->GetTaskbarStatus()->UpdateState(state);
+    ApdApp->GetTrayIcon()->UpdateState(_cachedState.value(), _displayName);
+    ApdApp->GetTaskbarStatus()->UpdateState(_cachedState.value());
 }
 
 void MainWindow::Available()
@@ -588,7 +592,7 @@ void MainWindow::Repaint()
 
     const auto &state = _cachedState.value();
 
-    _ui.deviceLabel->setText(state.displayName);
+    _ui.deviceLabel->setText(_displayName);
 
     SetAnimation(state.model);
 
@@ -55,7 +55,7 @@ public:
         return _apdMgr;
     }
 
-    void UpdateState(const Core::AirPods::State &state);
+    void UpdateState(Core::AirPods::PackedState state, const QString &displayName);
     void Available();
     void Unavailable();
     void Disconnect();
@@ -64,7 +64,7 @@ public:
     void AskUserUpdate(const Core::Update::ReleaseInfo &releaseInfo);
 
 Q_SIGNALS:
-    void UpdateStateSafely(const Core::AirPods::State &state);
+    void UpdateStateSafely(Core::AirPods::PackedState state, const QString &displayName);
     void AvailableSafely();
     void UnavailableSafely();
     void DisconnectSafely();
@@ -96,6 +96,7 @@ private:
     ButtonAction _buttonAction{ButtonAction::NoButton};
     Status _status{Status::Unavailable};
     std::optional<Core::AirPods::State> _cachedState;
+    QString _displayName;
     bool _isVisible{false};
     bool _isAnimationPlaying{false};
 
@@ -54,10 +54,11 @@ TrayIcon::TrayIcon()
     _tray->show();
 }
 
-void TrayIcon::UpdateState(const Core::AirPods::State &state)
+void TrayIcon::UpdateState(const Core::AirPods::State &state, const QString &displayName)
 {
     _status = Status::Updating;
     _airPodsState = state;
+    _displayName = displayName;
     Repaint();
 }
 
@@ -111,7 +112,7 @@ void TrayIcon::Repaint()
         }
         const auto &state = _airPodsState.value();
 
-        toolTipContent += state.displayName;
+        toolTipContent += _displayName.value_or(QString{});
 
         const auto strLeft{tr("Left")}, strRight{tr("Right")}, strCase{tr("Case")},
             strCharging{tr("charging")};
@@ -52,7 +52,7 @@ public:
         return _tray->toolTip();
     }
 
-    void UpdateState(const Core::AirPods::State &state);
+    void UpdateState(const Core::AirPods::State &state, const QString &displayName);
     void Unavailable();
     void Disconnect();
     void Unbind();
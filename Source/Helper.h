@@ -18,9 +18,15 @@
 
 #pragma once
 
+#include <span>
+#include <map>
+#include <array>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
 #include <vector>
 #include <chrono>
+#include <optional>
 #include <thread>
 #include <future>
 #include <functional>
@@ -114,7 +120,7 @@ using MemberPointerType = typename Impl::MemberPointerType<T>::Type;
 template <class T>
 inline bool IsFutureReady(const std::future<T> &future)
 {
-    return future.wait_for(0s) == std::future_status::ready;
+    return future.wait_for(std::chrono::seconds{0}) == std::future_status::ready;
 }
 
 //////////////////////////////////////////////////
@@ -123,14 +129,14 @@ template <class T>
 QString ToString(const T &value);
 
 template <>
-inline QString ToString<std::vector<uint8_t>>(const std::vector<uint8_t> &value)
+inline QString ToString<std::span<const uint8_t>>(const std::span<const uint8_t> &value)
 {
     QString result;
 
     size_t bytesSize = value.size();
 
     for (size_t i = 0; i < bytesSize; ++i) {
-        result += QString::number(value.at(i), 16).rightJustified(2, '0');
+        result += QString::number(value[i], 16).rightJustified(2, '0');
 
         if (i + 1 != bytesSize) {
             result += ' ';
@@ -140,6 +146,12 @@ inline QString ToString<std::vector<uint8_t>>(const std::vector<uint8_t> &value)
     return result;
 }
 
+template <>
+inline QString ToString<std::vector<uint8_t>>(const std::vector<uint8_t> &value)
+{
+    return ToString(std::span<const uint8_t>{value});
+}
+
 template <>
 inline QString ToString<Qt::ApplicationState>(const Qt::ApplicationState &value)
 {
@@ -168,6 +180,234 @@ struct Sides {
 
 //////////////////////////////////////////////////
 
+// A vector with a fixed inline capacity, it never allocates memory from the heap.
+//
+// Inserting into a full container is not an error, the insertion functions return `false` and
+// the container remains unchanged. The caller decides whether to drop the value or not.
+//
+template <class T, size_t kCapacity>
+class StaticVector
+{
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    StaticVector() = default;
+
+    inline StaticVector(std::span<const T> values)
+    {
+        assign(values);
+    }
+
+    inline bool assign(std::span<const T> values)
+    {
+        if (values.size() > kCapacity) {
+            return false;
+        }
+        std::copy(values.begin(), values.end(), _storage.begin());
+        _size = values.size();
+        return true;
+    }
+
+    inline bool push_back(T value)
+    {
+        if (full()) {
+            return false;
+        }
+        _storage[_size++] = std::move(value);
+        return true;
+    }
+
+    template <class... Args>
+    inline T *emplace_back(Args &&...args)
+    {
+        if (full()) {
+            return nullptr;
+        }
+        auto &element = _storage[_size++];
+        element = T{std::forward<Args>(args)...};
+        return &element;
+    }
+
+    inline void clear()
+    {
+        _size = 0;
+    }
+
+    constexpr static size_t capacity()
+    {
+        return kCapacity;
+    }
+
+    inline size_t size() const
+    {
+        return _size;
+    }
+
+    inline bool empty() const
+    {
+        return _size == 0;
+    }
+
+    inline bool full() const
+    {
+        return _size == kCapacity;
+    }
+
+    inline T *data()
+    {
+        return _storage.data();
+    }
+
+    inline const T *data() const
+    {
+        return _storage.data();
+    }
+
+    inline iterator begin()
+    {
+        return data();
+    }
+
+    inline iterator end()
+    {
+        return data() + _size;
+    }
+
+    inline const_iterator begin() const
+    {
+        return data();
+    }
+
+    inline const_iterator end() const
+    {
+        return data() + _size;
+    }
+
+    inline T &operator[](size_t index)
+    {
+        return _storage[index];
+    }
+
+    inline const T &operator[](size_t index) const
+    {
+        return _storage[index];
+    }
+
+private:
+    std::array<T, kCapacity> _storage{};
+    size_t _size{0};
+};
+
+//////////////////////////////////////////////////
+
+// A bounded lock-free queue for exactly one producer thread and one consumer thread.
+//
+// The producer never blocks, pushing into a full ring fails and the caller decides what to do
+// with the value. The consumer can block in `Wait` until there is something to pop or the ring
+// is closed.
+//
+template <class T, size_t kCapacity>
+class SpscRing : NonCopyable
+{
+    static_assert(kCapacity != 0 && (kCapacity & (kCapacity - 1)) == 0);
+
+public:
+    //
+    // Producer
+    //
+
+    inline bool TryPush(const T &value)
+    {
+        const auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == kCapacity) {
+            return false;
+        }
+
+        _storage[tail & kIndexMask] = value;
+        _tail.store(tail + 1, std::memory_order_release);
+
+        Signal();
+        return true;
+    }
+
+    //
+    // Consumer
+    //
+
+    inline bool TryPop(T &value)
+    {
+        const auto head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(_storage[head & kIndexMask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns `false` if the ring is closed, otherwise there is at least one value to pop
+    //
+    inline bool Wait()
+    {
+        while (true) {
+            const auto signal = _signal.load(std::memory_order_acquire);
+            if (_closed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (!empty()) {
+                return true;
+            }
+            _signal.wait(signal, std::memory_order_acquire);
+        }
+    }
+
+    //
+    // Any thread
+    //
+
+    // Wakes up the consumer, `Wait` returns `false` from now on
+    //
+    inline void Close()
+    {
+        _closed.store(true, std::memory_order_release);
+        Signal();
+    }
+
+    inline bool empty() const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    constexpr size_t capacity() const
+    {
+        return kCapacity;
+    }
+
+private:
+    constexpr static size_t kIndexMask = kCapacity - 1;
+    constexpr static size_t kCacheLineSize = 64;
+
+    // Written by the consumer and the producer respectively, keep them on separate cache lines
+    //
+    alignas(kCacheLineSize) std::atomic<size_t> _head{0};
+    alignas(kCacheLineSize) std::atomic<size_t> _tail{0};
+    alignas(kCacheLineSize) std::atomic<uint32_t> _signal{0};
+    std::atomic<bool> _closed{false};
+    std::array<T, kCapacity> _storage{};
+
+    inline void Signal()
+    {
+        _signal.fetch_add(1, std::memory_order_release);
+        _signal.notify_one();
+    }
+};
+
+//////////////////////////////////////////////////
+
 using CbHandle = uint64_t;
 
 template <class Function>
@@ -257,7 +497,10 @@ public:
 
     inline void Stop()
     {
-        _destroyFlag = true;
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _destroyFlag = true;
+        }
         Notify();
         if (_thread.joinable()) {
             _thread.join();
@@ -284,20 +527,176 @@ private:
                 break;
             }
             std::unique_lock<std::mutex> lock{_mutex};
+            if (_destroyFlag) {
+                break;
+            }
             _destroyConVar.wait_for(lock, _interval);
         }
     }
 };
 
+class Timer;
+
+// The time source of `Timer` and of the time-dependent logic built on top of it.
+//
+// The real scheduler follows `std::chrono::steady_clock` and drives every timer of the process on
+// a single thread. A virtual scheduler has no thread, its time only moves when `AdvanceTo` is
+// called, which fires the due timers on the calling thread in deadline order, with `Now()`
+// returning each deadline while its callback runs. So a replay of a day-long capture is able to
+// run all its timers in as long as it takes to invoke the callbacks.
+//
+// Timers are kept in a queue ordered by their scheduled time. `Timer::Reset` only moves the
+// deadline stored in the timer and does not touch the queue. When the scheduler reaches an entry
+// whose deadline has been moved, it reschedules the entry instead of firing it. So a reset is
+// O(1) and lock-free, and a timer that keeps being reset wakes the scheduler at most once per
+// interval.
+//
+// Callbacks must not block for a long time. Use `ConWorker` for periodic blocking work.
+//
+class Scheduler : NonCopyable
+{
+    friend Timer;
+
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    struct Statistics {
+        uint64_t wakeUps{0};     // The scheduler woke up, for any reason
+        uint64_t fired{0};       // A callback was invoked
+        uint64_t rescheduled{0}; // An entry was due but its timer had been reset
+        std::chrono::seconds uptime{};
+
+        inline double WakeUpsPerHour() const
+        {
+            const auto hours = std::chrono::duration<double, std::ratio<3600>>{uptime}.count();
+            return hours == 0 ? 0 : static_cast<double>(wakeUps) / hours;
+        }
+    };
+
+    // The process-wide real scheduler, used by timers constructed without a scheduler
+    //
+    static inline Scheduler &GetReal()
+    {
+        static Scheduler i{RealTag{}};
+        return i;
+    }
+
+    // Constructs a virtual scheduler, its time starts at `start`
+    //
+    inline explicit Scheduler(TimePoint start)
+        : _virtual{true}, _virtualNow{start}, _startTime{start}
+    {
+    }
+
+    inline ~Scheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _destroyFlag = true;
+        }
+        _wakeUpConVar.notify_all();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    inline bool IsVirtual() const
+    {
+        return _virtual;
+    }
+
+    inline TimePoint Now() const
+    {
+        return _virtual ? _virtualNow.load() : Clock::now();
+    }
+
+    // Moves the time of a virtual scheduler forward to `when`, firing the timers due until then.
+    // Moving backward does nothing, and so does calling it on the real scheduler.
+    //
+    inline void AdvanceTo(TimePoint when)
+    {
+        if (!_virtual) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock{_mutex};
+
+        while (!_queue.empty() && _queue.begin()->first <= when) {
+            const auto due = _queue.begin()->first;
+            if (due > _virtualNow.load()) {
+                _virtualNow = due;
+                ++_statistics.wakeUps;
+            }
+            Process(lock, _virtualNow.load());
+        }
+
+        if (when > _virtualNow.load()) {
+            _virtualNow = when;
+        }
+    }
+
+    template <class Rep, class Period>
+    inline void AdvanceBy(std::chrono::duration<Rep, Period> duration)
+    {
+        AdvanceTo(Now() + std::chrono::duration_cast<Clock::duration>(duration));
+    }
+
+    inline Statistics GetStatistics()
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        auto result = _statistics;
+        result.uptime = std::chrono::duration_cast<std::chrono::seconds>(Now() - _startTime);
+        return result;
+    }
+
+private:
+    using Queue = std::multimap<TimePoint, Timer *>;
+
+    struct RealTag {
+    };
+
+    const bool _virtual;
+    std::atomic<TimePoint> _virtualNow{};
+    std::mutex _mutex;
+    std::condition_variable _wakeUpConVar;
+    std::condition_variable _idleConVar;
+    Queue _queue;
+    Timer *_firingTimer{nullptr};
+    std::thread::id _firingThreadId;
+    bool _destroyFlag{false};
+    Statistics _statistics;
+    const TimePoint _startTime;
+    std::thread _thread;
+
+    inline explicit Scheduler(RealTag)
+        : _virtual{false}, _startTime{Clock::now()}, _thread{&Scheduler::Thread, this}
+    {
+    }
+
+    // The following functions require `_mutex` to be held
+    //
+    void Schedule(Timer &timer, TimePoint when);
+    void Cancel(std::unique_lock<std::mutex> &lock, Timer &timer);
+    void Process(std::unique_lock<std::mutex> &lock, TimePoint now);
+
+    void Thread();
+};
+
 class Timer
 {
 public:
     using FnTrigger = std::function<void()>;
 
-    Timer() = default;
+    // The scheduler must outlive the timer. The real one is constructed before any timer using
+    // it, so it does.
+    //
+    inline Timer() : Timer{Scheduler::GetReal()} {}
+    inline explicit Timer(Scheduler &scheduler) : _scheduler{scheduler} {}
 
     template <class... Args>
-    inline Timer(Args &&...args)
+    inline Timer(Args &&...args) : Timer{}
     {
         Start(std::forward<Args>(args)...);
     }
@@ -307,65 +706,188 @@ public:
         Stop();
     }
 
+    // Periodic mode, the callback is invoked every `interval` unless `Reset` postpones it
+    //
     inline void
     Start(std::chrono::milliseconds interval, FnTrigger callback, bool immediatelyOnce = false)
     {
         Stop();
-        _destroyFlag = false;
-        _interval = std::move(interval);
-        _thread =
-            std::thread{&Timer::Thread, this, std::move(callback), immediatelyOnce};
+
+        std::lock_guard<std::mutex> lock{_scheduler._mutex};
+
+        const auto now = _scheduler.Now();
+        _oneShot = false;
+        _active = true;
+        _interval = interval;
+        _callback = std::move(callback);
+        _deadline = immediatelyOnce ? now : now + interval;
+        _scheduler.Schedule(*this, _deadline.load());
     }
 
-    inline void Stop()
+    // One-shot mode, the timer stays idle until `Arm` is called. It does not wake anything up
+    // while idle.
+    //
+    inline void StartOneShot(FnTrigger callback)
     {
-        _destroyFlag = true;
-        _destroyConVar.notify_all();
-        if (_thread.joinable()) {
-            _thread.join();
+        Stop();
+
+        std::lock_guard<std::mutex> lock{_scheduler._mutex};
+
+        _oneShot = true;
+        _active = true;
+        _callback = std::move(callback);
+        _deadline = TimePoint::max();
+    }
+
+    // Makes sure the one-shot callback is invoked once, no later than `timeout` from now. If the
+    // timer is already armed to fire earlier, this is lock-free and does nothing, the callback
+    // is expected to arm the timer again if it fires too early.
+    //
+    inline void Arm(std::chrono::milliseconds timeout)
+    {
+        const auto deadline = _scheduler.Now() + timeout;
+        if (_deadline.load() <= deadline) {
+            return;
         }
+
+        std::lock_guard<std::mutex> lock{_scheduler._mutex};
+        if (!_active || !_oneShot || _deadline.load() <= deadline) {
+            return;
+        }
+
+        if (_entry.has_value()) {
+            _scheduler._queue.erase(_entry.value());
+            _entry.reset();
+        }
+        _deadline = deadline;
+        _scheduler.Schedule(*this, deadline);
+    }
+
+    // After returning, the callback is not running and will not be invoked again, unless it is
+    // called from the callback itself
+    //
+    inline void Stop()
+    {
+        std::unique_lock<std::mutex> lock{_scheduler._mutex};
+        _active = false;
+        _scheduler.Cancel(lock, *this);
     }
 
+    // Postpones a periodic timer to `interval` from now
+    //
     inline void Reset()
     {
-        _deadline = Clock::now() + _interval.load();
+        _deadline = _scheduler.Now() + _interval.load();
+    }
+
+    inline Scheduler &GetScheduler() const
+    {
+        return _scheduler;
+    }
+
+    static inline Scheduler::Statistics GetStatistics()
+    {
+        return Scheduler::GetReal().GetStatistics();
     }
 
 private:
-    using Clock = std::chrono::steady_clock;
-    using TimePoint = Clock::time_point;
+    friend Scheduler;
 
-    std::atomic<bool> _destroyFlag{false};
-    std::mutex _mutex;
-    std::condition_variable _destroyConVar;
-    std::atomic<std::chrono::milliseconds> _interval;
-    std::atomic<TimePoint> _deadline;
-    std::thread _thread;
+    using TimePoint = Scheduler::TimePoint;
 
-    inline void Thread(FnTrigger callback, bool immediatelyOnce)
-    {
-        if (immediatelyOnce) {
-            callback();
-        }
+    Scheduler &_scheduler;
+    std::atomic<std::chrono::milliseconds> _interval{};
+    std::atomic<TimePoint> _deadline{};
+    FnTrigger _callback;
 
-        Reset();
+    // Guarded by the scheduler lock
+    //
+    bool _oneShot{false};
+    bool _active{false};
+    std::optional<Scheduler::Queue::iterator> _entry;
+};
 
-        while (true) {
-            std::unique_lock<std::mutex> lock{_mutex};
-            {
-                _destroyConVar.wait_until(lock, _deadline.load());
-            }
-            lock.unlock();
+inline void Scheduler::Schedule(Timer &timer, TimePoint when)
+{
+    timer._entry = _queue.emplace(when, &timer);
+    if (timer._entry == _queue.begin()) {
+        _wakeUpConVar.notify_one();
+    }
+}
 
-            if (_destroyFlag) {
-                break;
-            }
-            if (_deadline.load() > Clock::now()) {
-                continue;
-            }
-            Reset();
-            callback();
+inline void Scheduler::Cancel(std::unique_lock<std::mutex> &lock, Timer &timer)
+{
+    if (timer._entry.has_value()) {
+        _queue.erase(timer._entry.value());
+        timer._entry.reset();
+    }
+
+    _idleConVar.wait(lock, [&] {
+        return _firingTimer != &timer || _firingThreadId == std::this_thread::get_id();
+    });
+}
+
+// Handles the first entry of the queue, which is due at `now`
+//
+inline void Scheduler::Process(std::unique_lock<std::mutex> &lock, TimePoint now)
+{
+    const auto timer = _queue.begin()->second;
+    _queue.erase(_queue.begin());
+    timer->_entry.reset();
+
+    // The timer has been reset since it was scheduled
+    //
+    const auto deadline = timer->_deadline.load();
+    if (deadline > now) {
+        ++_statistics.rescheduled;
+        Schedule(*timer, deadline);
+        return;
+    }
+
+    // Rearm or disarm before firing, so the callback is able to stop, reset or arm its timer
+    //
+    if (timer->_oneShot) {
+        timer->_deadline = TimePoint::max();
+    }
+    else {
+        timer->_deadline = now + timer->_interval.load();
+        Schedule(*timer, timer->_deadline.load());
+    }
+
+    ++_statistics.fired;
+
+    _firingTimer = timer;
+    _firingThreadId = std::this_thread::get_id();
+    lock.unlock();
+
+    timer->_callback();
+
+    lock.lock();
+    _firingTimer = nullptr;
+    _firingThreadId = {};
+    _idleConVar.notify_all();
+}
+
+inline void Scheduler::Thread()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+
+    while (!_destroyFlag) {
+        if (_queue.empty()) {
+            _wakeUpConVar.wait(lock);
+            ++_statistics.wakeUps;
+            continue;
+        }
+
+        const auto when = _queue.begin()->first;
+        const auto now = Clock::now();
+        if (when > now) {
+            _wakeUpConVar.wait_until(lock, when);
+            ++_statistics.wakeUps;
+            continue;
         }
+
+        Process(lock, now);
     }
-};
+}
 } // namespace Helper
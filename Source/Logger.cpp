@@ -18,13 +18,26 @@
 
 #include "Logger.h"
 
+#include <deque>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+#include <condition_variable>
+
 #include <QUrl>
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QMessageBox>
+#include <QRegularExpression>
+#include <spdlog/async.h>
 #include <spdlog/sinks/sink.h>
-#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/base_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/details/file_helper.h>
 #include <spdlog/pattern_formatter.h>
+#include <zlib.h>
 
 #include <Config.h>
 #include "Helper.h"
@@ -36,12 +49,301 @@
 
 namespace Logger {
 
+namespace Details {
+
+// Messages are written by a worker thread, so the threads logging never wait for the disk. The
+// queue is allocated once with room for bursts of packet logs, when it is full the oldest
+// message is dropped instead of blocking the Bluetooth callbacks.
+//
+constexpr size_t kQueueSize = 4096;
+constexpr auto kFlushInterval = std::chrono::seconds{3};
+
+// The log file is rotated once it reaches `kMaxFileSize`, and the one left by the previous
+// launch is rotated when opening. Rotated files are compressed in the background and only the
+// newest `kMaxRotatedFiles` of them are kept, so the disk usage is bounded.
+//
+constexpr auto kFileName = CONFIG_PROGRAM_NAME ".log";
+constexpr size_t kMaxFileSize = 8 * 1024 * 1024;
+constexpr size_t kMaxRotatedFiles = 5;
+constexpr size_t kCompressChunkSize = 64 * 1024;
+
+namespace Impl {
+
+inline std::filesystem::path ToPath(const QString &path)
+{
+    return std::filesystem::path{path.toStdWString()};
+}
+
+// Rotated files are named after the time they were rotated, so sorting by name sorts by age
+//
+inline QString MakeRotatedFileName()
+{
+    const auto time = QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz");
+    return QString{CONFIG_PROGRAM_NAME ".%1.log"}.arg(time);
+}
+
+inline bool CompressFile(const QString &sourcePath, const QString &targetPath)
+{
+    std::ifstream source{ToPath(sourcePath), std::ios::binary};
+    if (!source.is_open()) {
+        return false;
+    }
+
+    // Written under a temporary name, a file cut short by an exit is never taken for a log
+    //
+    const auto tempPath = targetPath + ".tmp";
+
+#if defined APD_OS_WIN
+    gzFile target = gzopen_w(tempPath.toStdWString().c_str(), "wb");
+#else
+    gzFile target = gzopen(QFile::encodeName(tempPath).constData(), "wb");
+#endif
+    if (target == nullptr) {
+        return false;
+    }
+
+    std::vector<char> buffer(kCompressChunkSize);
+    bool succeeded = true;
+
+    while (succeeded && source) {
+        source.read(buffer.data(), buffer.size());
+        const auto readSize = static_cast<unsigned>(source.gcount());
+        if (readSize != 0) {
+            succeeded = gzwrite(target, buffer.data(), readSize) == static_cast<int>(readSize);
+        }
+    }
+    succeeded = gzclose(target) == Z_OK && succeeded && source.eof();
+    source.close();
+
+    std::error_code error;
+    if (!succeeded) {
+        std::filesystem::remove(ToPath(tempPath), error);
+        return false;
+    }
+
+    std::filesystem::rename(ToPath(tempPath), ToPath(targetPath), error);
+    if (error) {
+        return false;
+    }
+    std::filesystem::remove(ToPath(sourcePath), error);
+    return true;
+}
+
+} // namespace Impl
+
+// Compresses the rotated log files and removes the old ones on its own thread, the logging
+// thread only renames the file when rotating.
+//
+// It never logs, since it's destroyed after the logger.
+//
+class Archiver
+{
+public:
+    explicit Archiver(QDir directory) : _directory{std::move(directory)}
+    {
+        _thread = std::thread{&Archiver::Thread, this};
+    }
+
+    ~Archiver()
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _stop = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    void Push(QString fileName)
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _pending.emplace_back(std::move(fileName));
+            _cleanUpPending = true;
+        }
+        _cv.notify_all();
+    }
+
+    void CleanUp()
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _cleanUpPending = true;
+        }
+        _cv.notify_all();
+    }
+
+private:
+    QDir _directory;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<QString> _pending;
+    bool _cleanUpPending{false};
+    bool _stop{false};
+    std::thread _thread;
+
+    void Thread()
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+
+        while (true) {
+            _cv.wait(lock, [this] { return _stop || _cleanUpPending || !_pending.empty(); });
+
+            // The pending work is finished before stopping, a rotated file is not left as is
+            //
+            if (_pending.empty() && !_cleanUpPending) {
+                break;
+            }
+
+            auto pending = std::move(_pending);
+            _pending.clear();
+            _cleanUpPending = false;
+
+            lock.unlock();
+            for (const auto &fileName : pending) {
+                Compress(fileName);
+            }
+            ScanDirectory();
+            lock.lock();
+        }
+    }
+
+    void Compress(const QString &fileName)
+    {
+        // It may have been compressed by a scan already
+        //
+        if (_directory.exists(fileName)) {
+            Impl::CompressFile(
+                _directory.absoluteFilePath(fileName),
+                _directory.absoluteFilePath(fileName + ".gz"));
+        }
+    }
+
+    // Lists the directory once, instead of probing file names one by one
+    //
+    void ScanDirectory()
+    {
+        // clang-format off
+        static const QRegularExpression rotatedRegex{
+            "^" CONFIG_PROGRAM_NAME R"(\.\d{8}-\d{6}-\d{3}\.log(\.gz)?$)"};
+        static const QRegularExpression staleRegex{
+            "^" CONFIG_PROGRAM_NAME R"(\.(\d+\.log|\d{8}-\d{6}-\d{3}\.log\.gz\.tmp)$)"};
+        // clang-format on
+
+        const auto fileNames = _directory.entryList(
+            {CONFIG_PROGRAM_NAME ".*.log*"}, QDir::Files, QDir::Name | QDir::Reversed);
+
+        size_t retainedCount = 0;
+
+        for (const auto &fileName : fileNames) {
+            // TODO: Stop removing the numbered files, written by the old versions, in [v1.0.0]
+            //
+            if (staleRegex.match(fileName).hasMatch()) {
+                _directory.remove(fileName);
+                continue;
+            }
+
+            const auto match = rotatedRegex.match(fileName);
+            if (!match.hasMatch()) {
+                continue;
+            }
+
+            const bool compressed = match.capturedLength(1) != 0;
+
+            // A rotated file is left both compressed and not by an exit in the middle of
+            // compressing it, the uncompressed one is kept and compressed again
+            //
+            if (compressed && fileNames.contains(fileName.chopped(3))) {
+                _directory.remove(fileName);
+                continue;
+            }
+
+            if (++retainedCount > kMaxRotatedFiles) {
+                _directory.remove(fileName);
+            }
+            else if (!compressed) {
+                Compress(fileName);
+            }
+        }
+    }
+};
+
+class RotatingFileSink final : public spdlog::sinks::base_sink<std::mutex>
+{
+public:
+    RotatingFileSink(QDir directory, QString fileName, std::shared_ptr<Archiver> archiver)
+        : _directory{std::move(directory)},
+          _fileName{std::move(fileName)},
+          _archiver{std::move(archiver)}
+    {
+        if (QFileInfo{_directory, _fileName}.size() != 0) {
+            Rotate();
+        }
+        else {
+            Open(true);
+        }
+    }
+
+protected:
+    void sink_it_(const spdlog::details::log_msg &msg) override
+    {
+        spdlog::memory_buf_t formatted;
+        formatter_->format(msg, formatted);
+
+        if (_fileSize != 0 && _fileSize + formatted.size() > kMaxFileSize) {
+            Rotate();
+        }
+
+        _file.write(formatted);
+        _fileSize += formatted.size();
+    }
+
+    void flush_() override
+    {
+        _file.flush();
+    }
+
+private:
+    QDir _directory;
+    QString _fileName;
+    std::shared_ptr<Archiver> _archiver;
+    spdlog::details::file_helper _file;
+    size_t _fileSize{0};
+
+    void Open(bool truncate)
+    {
+        _file.open(Impl::ToPath(_directory.absoluteFilePath(_fileName)).native(), truncate);
+        _fileSize = 0;
+    }
+
+    void Rotate()
+    {
+        _file.close();
+
+        // Keeps appending to the same file if it can't be renamed, until it grows by another
+        // `kMaxFileSize`, rather than trying again on every message
+        //
+        const auto rotatedFileName = Impl::MakeRotatedFileName();
+        const bool renamed = _directory.rename(_fileName, rotatedFileName);
+        if (renamed) {
+            _archiver->Push(rotatedFileName);
+        }
+        Open(renamed);
+    }
+};
+
+// Shared with the file sink, the thread is joined once both have released it
+//
+std::shared_ptr<Archiver> gArchiver;
+
+} // namespace Details
+
 QDir GetLogFilePath()
 {
     static std::optional<QDir> result;
     if (!result.has_value()) {
         const auto workspace = Utils::File::GetWorkspace();
-        result = QDir{workspace.absoluteFilePath(CONFIG_PROGRAM_NAME ".log")};
+        result = QDir{workspace.absoluteFilePath(Details::kFileName)};
     }
     return result.value();
 }
@@ -53,14 +355,19 @@ bool Initialize(bool enableTrace)
 #endif
 
     try {
-        const auto logFilePath = GetLogFilePath().absolutePath().toStdWString();
+        const auto workspace = Utils::File::GetWorkspace();
+
+        spdlog::init_thread_pool(Details::kQueueSize, 1);
+        Details::gArchiver = std::make_shared<Details::Archiver>(workspace);
 
         // clang-format off
-        auto logger = std::make_shared<spdlog::logger>(
+        auto logger = std::make_shared<spdlog::async_logger>(
             "Main", std::initializer_list<spdlog::sink_ptr>{
-                std::make_shared<spdlog::sinks::basic_file_sink_mt>(logFilePath, true),
+                std::make_shared<Details::RotatingFileSink>(
+                    workspace, Details::kFileName, Details::gArchiver),
                 std::make_shared<spdlog::sinks::stdout_color_sink_mt>()
-            }
+            },
+            spdlog::thread_pool(), spdlog::async_overflow_policy::overrun_oldest
         );
         // clang-format on
 
@@ -68,7 +375,16 @@ bool Initialize(bool enableTrace)
         spdlog::set_default_logger(logger);
 
         spdlog::set_level(enableTrace ? spdlog::level::trace : spdlog::level::info);
+
+        // Only requests the worker to flush, the paths aborting the process call
+        // `FlushBeforeAbort` to write the queued lines before exiting
+        //
+#if defined APD_DEBUG
         spdlog::flush_on(spdlog::level::trace);
+#else
+        spdlog::flush_on(spdlog::level::err);
+#endif
+        spdlog::flush_every(Details::kFlushInterval);
 
 #if defined APD_DEBUG
         spdlog::set_error_handler([](const std::string &msg) { Utils::Debug::BreakPoint(); });
@@ -81,21 +397,33 @@ bool Initialize(bool enableTrace)
     }
 }
 
-// TODO: Remove this function in [v1.0.0]
-void CleanUpOldLogFiles()
+void Shutdown()
 {
-    auto workspace = Utils::File::GetWorkspace();
+    LOG(Info, "Logger shutting down. Dropped messages: {}", GetDroppedCount());
 
-    for (size_t i = 1; i < 10000; ++i) {
-        auto logFile = QString{CONFIG_PROGRAM_NAME ".%1.log"}.arg(i);
+    // Writes the messages left in the queue and joins the worker thread
+    //
+    spdlog::shutdown();
 
-        if (!workspace.exists(logFile)) {
-            LOG(Info, "Clean up old log file: '{}' doesn't exist, break the loop", logFile);
-            break;
-        }
+    // Finishes compressing the rotated files
+    //
+    Details::gArchiver.reset();
 
-        LOG(Info, "Clean up old log file: '{}' exists, remove it", logFile);
-        workspace.remove(logFile);
+    // Anything logged later, by static destructors, is discarded
+    //
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("Main"));
+}
+
+uint64_t GetDroppedCount()
+{
+    const auto threadPool = spdlog::thread_pool();
+    return threadPool != nullptr ? threadPool->overrun_counter() : 0;
+}
+
+void CleanUpOldLogFiles()
+{
+    if (Details::gArchiver != nullptr) {
+        Details::gArchiver->CleanUp();
     }
 }
 } // namespace Logger
@@ -37,32 +37,50 @@ enum class Level : uint32_t {
     Critical,
 };
 
+template <Level level>
+constexpr spdlog::level::level_enum ToSpdlogLevel()
+{
+    if constexpr (level == Level::Trace) {
+        return spdlog::level::trace;
+    }
+    else if constexpr (level == Level::Debug) {
+        return spdlog::level::debug;
+    }
+    else if constexpr (level == Level::Info) {
+        return spdlog::level::info;
+    }
+    else if constexpr (level == Level::Warn) {
+        return spdlog::level::warn;
+    }
+    else if constexpr (level == Level::Error) {
+        return spdlog::level::err;
+    }
+    else {
+        static_assert(level == Level::Critical);
+        return spdlog::level::critical;
+    }
+}
+
+// Levels below `SPDLOG_ACTIVE_LEVEL` are compiled out, the arguments are never evaluated
+//
+template <Level level>
+constexpr bool IsCompiledIn()
+{
+    return ToSpdlogLevel<level>() >= SPDLOG_ACTIVE_LEVEL;
+}
+
+// A relaxed load of the level of the default logger
+//
+template <Level level>
+inline bool ShouldLog()
+{
+    return spdlog::default_logger_raw()->should_log(ToSpdlogLevel<level>());
+}
+
 template <Level level, class... Args>
 inline void Log(const spdlog::source_loc &srcloc, Args &&...args)
 {
-    constexpr auto spdlogLevel = []() {
-        if constexpr (level == Level::Trace) {
-            return spdlog::level::trace;
-        }
-        else if constexpr (level == Level::Debug) {
-            return spdlog::level::debug;
-        }
-        else if constexpr (level == Level::Info) {
-            return spdlog::level::info;
-        }
-        else if constexpr (level == Level::Warn) {
-            return spdlog::level::warn;
-        }
-        else if constexpr (level == Level::Error) {
-            return spdlog::level::err;
-        }
-        else if constexpr (level == Level::Critical) {
-            return spdlog::level::critical;
-        }
-        else {
-            static_assert(false);
-        }
-    }();
+    constexpr auto spdlogLevel = ToSpdlogLevel<level>();
 
     spdlog::default_logger_raw()->log(srcloc, spdlogLevel, std::forward<Args>(args)...);
 }
@@ -71,8 +89,39 @@ inline void Log(const spdlog::source_loc &srcloc, Args &&...args)
 
 bool Initialize(bool enableTrace);
 
+// Must be called once everything that logs is destroyed, the queued messages are lost otherwise
+//
+void Shutdown();
+
+// Writes the queued messages and flushes the sinks before returning, for the paths about to
+// abort the process. The logger stays the default one, but what the other threads log after
+// this is discarded.
+//
+// Header-only, so the core library is able to call it without the logger of the application.
+//
+inline void FlushBeforeAbort()
+{
+    // The worker writes the messages left in the queue and exits once the last reference to the
+    // thread pool is released. No-op if the logger is not asynchronous.
+    //
+    spdlog::details::registry::instance().set_tp(nullptr);
+
+    spdlog::apply_all([](const std::shared_ptr<spdlog::logger> &logger) {
+        for (const auto &sink : logger->sinks()) {
+            sink->flush();
+        }
+    });
+}
+
+// Messages dropped because the queue of the logging thread was full
+//
+uint64_t GetDroppedCount();
+
 QDir GetLogFilePath();
 
+// Compresses the rotated log files left uncompressed and removes the ones not retained, on the
+// archiving thread
+//
 void CleanUpOldLogFiles();
 
 } // namespace Logger
@@ -83,6 +132,15 @@ inline OutStream &operator<<(OutStream &outStream, const QString &qstr)
     return outStream << qstr.toStdString().c_str();
 }
 
+// The arguments are only evaluated if the level is enabled, so a disabled `LOG` costs a branch,
+// or nothing at all if the level is compiled out
+//
 #define LOG(level, ...)                                                                            \
-    Logger::Details::Log<Logger::Details::Level::level>(                                           \
-        spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION}, __VA_ARGS__)
+    do {                                                                                           \
+        if constexpr (Logger::Details::IsCompiledIn<Logger::Details::Level::level>()) {            \
+            if (Logger::Details::ShouldLog<Logger::Details::Level::level>()) {                     \
+                Logger::Details::Log<Logger::Details::Level::level>(                               \
+                    spdlog::source_loc{__FILE__, __LINE__, SPDLOG_FUNCTION}, __VA_ARGS__);         \
+            }                                                                                      \
+        }                                                                                          \
+    } while (false)
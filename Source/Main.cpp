@@ -20,6 +20,9 @@
 
 #include <Config.h>
 #include "Utils.h"
+#include "Logger.h"
+#include "Core/Trace.h"
+#include "Core/Metrics.h"
 
 int main(int argc, char *argv[])
 {
@@ -30,9 +33,18 @@ int main(int argc, char *argv[])
     }
 
     ApdApplication::PreConstruction();
-    ApdApplication app{argc, argv};
-    if (!ApdApp->Prepare(argc, argv)) {
-        return 1;
-    }
-    return ApdApp->Run();
+
+    const auto result = [&] {
+        ApdApplication app{argc, argv};
+        if (!ApdApp->Prepare(argc, argv)) {
+            return 1;
+        }
+        return ApdApp->Run();
+    }();
+
+    LOG(Info, "Metrics:\n{}", Core::Metrics::Render(Core::Metrics::TakeSnapshot()));
+
+    Core::Trace::Close();
+    Logger::Shutdown();
+    return result;
 }
@@ -40,7 +40,15 @@ const LaunchOpts &LaunchOptsManager::Parse(int argc, char *argv[])
 
         parser.add_options()          //
             ("help", "Print options") //
-            ("trace", "Enable trace level logging.", value<bool>()->default_value("false"));
+            ("trace", "Enable trace level logging.", value<bool>()->default_value("false")) //
+            ("capture", "Record received AirPods advertisements to a binary capture file.",
+             value<std::string>()->default_value("")) //
+            ("trace-file", "Record the per-packet trace to a binary file, see ApdTraceDecoder.",
+             value<std::string>()->default_value("")) //
+            ("replay", "Replay a capture file instead of listening to Bluetooth.",
+             value<std::string>()->default_value("")) //
+            ("replay-speed", "Playback rate of `replay` relative to the recorded timing.",
+             value<double>()->default_value("1.0"));
 
         auto names = enum_names<PrintAllLocales>();
         auto namesStr = std::accumulate(
@@ -65,6 +73,10 @@ const LaunchOpts &LaunchOptsManager::Parse(int argc, char *argv[])
         }
 
         _opts.enableTrace = args["trace"].as<bool>();
+        _opts.captureFile = args["capture"].as<std::string>();
+        _opts.traceFile = args["trace-file"].as<std::string>();
+        _opts.replayFile = args["replay"].as<std::string>();
+        _opts.replaySpeed = args["replay-speed"].as<double>();
 
         auto printAllLocales =
             enum_cast<PrintAllLocales>(args["print-all-locales"].as<std::string>());
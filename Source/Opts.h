@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <string>
 #include <format>
 #include <optional>
 
@@ -30,11 +31,19 @@ enum class PrintAllLocales { None, Complete, LangOnly };
 
 struct LaunchOpts {
     bool enableTrace{false};
+    std::string captureFile;
+    std::string traceFile;
+    std::string replayFile;
+    double replaySpeed{1.0};
 
     template <class OutStream>
     friend inline OutStream &operator<<(OutStream &outStream, const Opts::LaunchOpts &opts)
     {
-        return outStream << std::format("{{ trace: {} }}", opts.enableTrace);
+        return outStream << std::format(
+                   "{{ trace: {}, capture: '{}', trace-file: '{}', replay: '{}', "
+                   "replay-speed: {} }}",
+                   opts.enableTrace, opts.captureFile, opts.traceFile, opts.replayFile,
+                   opts.replaySpeed);
     }
 };
 
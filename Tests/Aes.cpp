@@ -0,0 +1,94 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <vector>
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "Core/Aes.h"
+
+namespace {
+
+struct KnownAnswer {
+    Core::Aes::Key key;
+    Core::Aes::Block plaintext, ciphertext;
+};
+
+// FIPS-197 Appendix B and Appendix C.1
+//
+constexpr KnownAnswer kKnownAnswers[] = {
+    {
+        .key = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C},
+        .plaintext = {0x32, 0x43, 0xF6, 0xA8, 0x88, 0x5A, 0x30, 0x8D,
+                      0x31, 0x31, 0x98, 0xA2, 0xE0, 0x37, 0x07, 0x34},
+        .ciphertext = {0x39, 0x25, 0x84, 0x1D, 0x02, 0xDC, 0x09, 0xFB,
+                       0xDC, 0x11, 0x85, 0x97, 0x19, 0x6A, 0x0B, 0x32},
+    },
+    {
+        .key = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F},
+        .plaintext = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                      0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF},
+        .ciphertext = {0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30,
+                       0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A},
+    },
+};
+
+// Up to two groups of four and a tail, so every lane of the hardware path is covered
+//
+constexpr size_t kMaxBatch = 9;
+
+void ExpectKnownAnswers(bool allowHardware)
+{
+    for (const auto &answer : kKnownAnswers) {
+        const Core::Aes::Decryptor decryptor{answer.key, allowHardware};
+
+        for (size_t count = 1; count <= kMaxBatch; ++count) {
+            std::vector<Core::Aes::Block> blocks(count, answer.ciphertext);
+            decryptor.Decrypt(blocks);
+            EXPECT_EQ(std::ranges::count(blocks, answer.plaintext), std::ssize(blocks))
+                << "batch of " << count;
+        }
+    }
+}
+} // namespace
+
+TEST(Aes, PortableKnownAnswers)
+{
+    ExpectKnownAnswers(false);
+}
+
+TEST(Aes, HardwareKnownAnswers)
+{
+    if (!Core::Aes::Decryptor{kKnownAnswers[0].key}.IsHardwareAccelerated()) {
+        GTEST_SKIP() << "AES-NI is not supported by this CPU";
+    }
+    ExpectKnownAnswers(true);
+}
+
+TEST(Aes, ParseKey)
+{
+    const auto key = Core::Aes::Decryptor::ParseKey("00:01:02:03 04-05-06-07 08090A0B0c0d0e0f");
+    ASSERT_TRUE(key.has_value());
+    EXPECT_EQ(key.value(), kKnownAnswers[1].key);
+
+    EXPECT_FALSE(Core::Aes::Decryptor::ParseKey("000102").has_value());
+    EXPECT_FALSE(Core::Aes::Decryptor::ParseKey("000102030405060708090A0B0C0D0E0G").has_value());
+}
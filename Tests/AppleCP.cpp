@@ -0,0 +1,107 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <array>
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "Core/Aes.h"
+#include "Core/AppleCP.h"
+
+using Core::AppleCP::AirPods;
+
+namespace {
+
+// FIPS-197 Appendix C.1
+//
+constexpr Core::Aes::Key kKey{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+
+struct EncryptedBatteries {
+    Core::Aes::Block ciphertext;
+    Core::AirPods::Battery broadcasted, other, caseBox;
+};
+
+// The plaintexts are `5A D5 28 64 00..` (85% charging, 40%, 100%) and `5A 7F 28 E4 00..` (out of
+// range, 40%, 100% charging), encrypted with `openssl enc -aes-128-ecb -nopad`
+//
+const std::array kEncryptedBatteries{
+    EncryptedBatteries{
+        .ciphertext = {0x9F, 0x7F, 0x1B, 0x3A, 0x61, 0x05, 0x53, 0x5E,
+                       0x97, 0x34, 0x25, 0x7B, 0x53, 0x5C, 0xC7, 0x7F},
+        .broadcasted = 85,
+        .other = 40,
+        .caseBox = 100,
+    },
+    EncryptedBatteries{
+        .ciphertext = {0xE4, 0xC7, 0x50, 0x9E, 0xFE, 0xA4, 0x82, 0x35,
+                       0xCC, 0x89, 0xBC, 0x25, 0x6F, 0xBF, 0xF7, 0xDD},
+        .broadcasted = {},
+        .other = 40,
+        .caseBox = 100,
+    },
+};
+
+// See `AirPods::Fields` for the layout
+//
+std::array<uint8_t, AirPods::kSize>
+MakePacket(bool broadcastFromLeft, const Core::Aes::Block &unk12)
+{
+    std::array<uint8_t, AirPods::kSize> packet{};
+    packet[0] = Helper::ToUnderlying(Core::AppleCP::PacketType::ProximityPairing);
+    packet[1] = AirPods::kSize - sizeof(Core::AppleCP::Header);
+    packet[2] = 0x01;
+    packet[3] = 0x0E; // AirPods Pro
+    packet[4] = 0x20;
+    packet[5] = 0b0000'1011 | (broadcastFromLeft ? 0b0010'0000 : 0);
+    packet[6] = 0x88;
+    packet[7] = 0x08;
+    std::ranges::copy(unk12, packet.begin() + AirPods::Fields::kUnk12Offset);
+    return packet;
+}
+} // namespace
+
+TEST(AppleCP, ExactBatteriesRoundTrip)
+{
+    const Core::Aes::Decryptor hardware{kKey}, portable{kKey, false};
+
+    for (const auto &encrypted : kEncryptedBatteries) {
+        for (const bool broadcastFromLeft : {true, false}) {
+            const auto packet = MakePacket(broadcastFromLeft, encrypted.ciphertext);
+            const auto protocol = Core::AppleCP::As<AirPods>(packet);
+            ASSERT_TRUE(protocol.has_value());
+
+            for (const auto decryptor : {&hardware, &portable}) {
+                std::array<Core::Aes::Block, 1> payload;
+                std::ranges::copy(protocol->GetEncryptedPayload(), payload[0].begin());
+                decryptor->Decrypt(payload);
+
+                const auto batteries = AirPods::DecodeExactBatteries(
+                    payload[0], protocol->GetBroadcastedSide());
+
+                const auto &left = broadcastFromLeft ? encrypted.broadcasted : encrypted.other;
+                const auto &right = broadcastFromLeft ? encrypted.other : encrypted.broadcasted;
+                EXPECT_EQ(batteries.left, left);
+                EXPECT_EQ(batteries.right, right);
+                EXPECT_EQ(batteries.caseBox, encrypted.caseBox);
+            }
+        }
+    }
+}
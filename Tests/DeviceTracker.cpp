@@ -0,0 +1,250 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Tests.h"
+#include "Core/DeviceTracker.h"
+#include "Core/StateManager.h"
+
+using Core::AirPods::Details::Advertisement;
+using Core::AirPods::Details::DeviceTracker;
+
+namespace {
+
+constexpr uint64_t kAddress = 0xA1B2C3D4E500, kRotatedAddress = 0xA1B2C3D4E5F0;
+
+Advertisement MakeAdv(uint64_t address)
+{
+    return Advertisement{Tests::MakeAirPodsPacket({.address = address})};
+}
+} // namespace
+
+// The time a device got an address is not the time it was first seen, it is tracked across
+// rotations
+//
+TEST(DeviceTracker, AddressSince)
+{
+    using namespace std::chrono_literals;
+
+    const DeviceTracker::Timestamp start{};
+    DeviceTracker tracker;
+
+    const auto id = tracker.Record(MakeAdv(kAddress), start);
+    tracker.Touch(id, MakeAdv(kAddress), start + 10s);
+    EXPECT_EQ(tracker.GetDevice(id)->GetAddressSince(kAddress), start);
+
+    // Rotated
+    //
+    EXPECT_EQ(tracker.Record(MakeAdv(kRotatedAddress), start + 30s, id), id);
+    EXPECT_EQ(tracker.GetDevice(id)->firstSeen, start);
+    EXPECT_EQ(tracker.GetDevice(id)->GetAddressSince(kRotatedAddress), start + 30s);
+    EXPECT_EQ(tracker.GetDevice(id)->GetAddressSince(kAddress), std::nullopt);
+
+    // Linked into another device, or taken by another device, the address keeps its time
+    //
+    const auto other = tracker.Record(MakeAdv(kAddress), start + 40s);
+    tracker.Link(id, other);
+    EXPECT_EQ(tracker.GetDevice(id), nullptr);
+    EXPECT_EQ(tracker.GetDevice(other)->GetAddressSince(kRotatedAddress), start + 30s);
+
+    const auto taker = tracker.Record(MakeAdv(kRotatedAddress), start + 50s);
+    ASSERT_NE(taker, other);
+    EXPECT_EQ(tracker.GetDevice(taker)->GetAddressSince(kRotatedAddress), start + 30s);
+    EXPECT_EQ(tracker.GetDevice(other)->GetAddressSince(kRotatedAddress), std::nullopt);
+}
+
+TEST(DeviceTracker, PinnedSurvivesEviction)
+{
+    using namespace std::chrono_literals;
+
+    DeviceTracker::Timestamp now{};
+    DeviceTracker tracker;
+
+    const auto pinned = tracker.Record(MakeAdv(kAddress), now);
+    tracker.Pin(pinned);
+
+    // The pinned device is the least recently seen one from the first eviction on
+    //
+    for (uint64_t i = 0; i < DeviceTracker::kCapacity * 2; ++i) {
+        now += 10ms;
+        tracker.Record(MakeAdv(kRotatedAddress + i), now);
+    }
+
+    const auto statistics = tracker.GetStatistics();
+    EXPECT_EQ(statistics.size, DeviceTracker::kCapacity);
+    EXPECT_EQ(statistics.evicted, DeviceTracker::kCapacity + 1);
+    ASSERT_NE(tracker.GetDevice(pinned), nullptr);
+
+    const auto match = tracker.Lookup(MakeAdv(kAddress), now);
+    ASSERT_TRUE(match.has_value());
+    EXPECT_EQ(match->id, pinned);
+    EXPECT_TRUE(match->byAddress);
+}
+
+TEST(DeviceTracker, EvictsLeastRecentlySeen)
+{
+    using namespace std::chrono_literals;
+
+    DeviceTracker::Timestamp now{};
+    DeviceTracker tracker;
+
+    std::vector<DeviceTracker::DeviceId> ids;
+    for (uint64_t i = 0; i < DeviceTracker::kCapacity; ++i) {
+        now += 10ms;
+        ids.push_back(tracker.Record(MakeAdv(kAddress + i), now));
+    }
+    EXPECT_EQ(tracker.GetStatistics().evicted, 0);
+
+    // The first device becomes the most recently seen, so the second one is evicted
+    //
+    now += 10ms;
+    tracker.Touch(ids[0], MakeAdv(kAddress), now);
+
+    now += 10ms;
+    const auto created = tracker.Record(MakeAdv(kRotatedAddress), now);
+
+    EXPECT_EQ(tracker.GetStatistics().evicted, 1);
+    EXPECT_EQ(tracker.GetStatistics().size, DeviceTracker::kCapacity);
+    EXPECT_NE(tracker.GetDevice(ids[0]), nullptr);
+    EXPECT_EQ(tracker.GetDevice(ids[1]), nullptr);
+    for (size_t i = 2; i < ids.size(); ++i) {
+        EXPECT_NE(tracker.GetDevice(ids[i]), nullptr) << i;
+    }
+    EXPECT_EQ(created.slot, ids[1].slot);
+}
+
+TEST(DeviceTracker, StaleIds)
+{
+    using namespace std::chrono_literals;
+
+    DeviceTracker::Timestamp now{};
+    DeviceTracker tracker;
+
+    const auto evicted = tracker.Record(MakeAdv(kAddress), now);
+    DeviceTracker::DeviceId reused;
+    for (uint64_t i = 0; i < DeviceTracker::kCapacity; ++i) {
+        now += 10ms;
+        reused = tracker.Record(MakeAdv(kRotatedAddress + i), now);
+    }
+
+    // The slot is reused by the device which evicted it, but the old id does not reach it
+    //
+    EXPECT_EQ(reused.slot, evicted.slot);
+    EXPECT_NE(reused.generation, evicted.generation);
+    EXPECT_EQ(tracker.GetDevice(evicted), nullptr);
+    EXPECT_NE(tracker.GetDevice(reused), nullptr);
+
+    // Recording with a stale id creates a new device instead of reviving it
+    //
+    const auto created = tracker.GetStatistics().created;
+    EXPECT_NE(tracker.Record(MakeAdv(kAddress - 1), now, evicted), evicted);
+    EXPECT_EQ(tracker.GetStatistics().created, created + 1);
+
+    EXPECT_EQ(tracker.GetDevice({DeviceTracker::kCapacity, 0}), nullptr);
+
+    tracker.Clear();
+    EXPECT_EQ(tracker.GetDevice(reused), nullptr);
+    EXPECT_EQ(tracker.GetStatistics().size, 0);
+}
+
+TEST(DeviceTracker, LinkMovesAddresses)
+{
+    constexpr uint64_t kLeftAddress = 0xB00000000001, kRightAddress = 0xB00000000002;
+
+    const DeviceTracker::Timestamp now{};
+    DeviceTracker tracker;
+
+    auto from = tracker.Record(MakeAdv(kLeftAddress), now);
+    from = tracker.Record(
+        Advertisement{Tests::MakeAirPodsPacket({
+            .broadcastFromLeft = false,
+            .address = kRightAddress,
+        })},
+        now, from);
+
+    const auto to = tracker.Record(MakeAdv(kAddress), now);
+    ASSERT_NE(from, to);
+
+    tracker.Link(from, to);
+
+    EXPECT_EQ(tracker.GetDevice(from), nullptr);
+    EXPECT_EQ(tracker.GetStatistics().linked, 1);
+    EXPECT_EQ(tracker.GetStatistics().size, 1);
+
+    const auto device = tracker.GetDevice(to);
+    ASSERT_NE(device, nullptr);
+    EXPECT_EQ(device->address.left, kLeftAddress);
+    EXPECT_EQ(device->address.right, kRightAddress);
+
+    for (const auto address : {kLeftAddress, kRightAddress}) {
+        const auto match = tracker.Lookup(MakeAdv(address), now);
+        ASSERT_TRUE(match.has_value());
+        EXPECT_EQ(match->id, to);
+        EXPECT_TRUE(match->byAddress);
+    }
+
+    // The replaced address is forgotten, it's only found by the fingerprint now
+    //
+    const auto match = tracker.Lookup(MakeAdv(kAddress), now);
+    ASSERT_TRUE(match.has_value());
+    EXPECT_FALSE(match->byAddress);
+}
+
+TEST(DeviceTracker, FingerprintFallback)
+{
+    using namespace std::chrono_literals;
+
+    const auto makeAdv = [](uint64_t address, uint8_t caseBattery) {
+        return Advertisement{Tests::MakeAirPodsPacket({
+            .leftBattery = 5,
+            .rightBattery = 6,
+            .caseBattery = caseBattery,
+            .address = address,
+        })};
+    };
+
+    const DeviceTracker::Timestamp start{};
+    DeviceTracker tracker;
+
+    const auto first = tracker.Record(makeAdv(kAddress, 7), start);
+
+    const auto rotated = tracker.Lookup(makeAdv(kRotatedAddress, 7), start);
+    ASSERT_TRUE(rotated.has_value());
+    EXPECT_EQ(rotated->id, first);
+    EXPECT_FALSE(rotated->byAddress);
+
+    EXPECT_FALSE(tracker.Lookup(makeAdv(kRotatedAddress, 8), start).has_value());
+
+    // An expired address is not trusted anymore
+    //
+    const auto expired =
+        tracker.Lookup(makeAdv(kAddress, 7), start + DeviceTracker::kAddressTimeout + 1s);
+    ASSERT_TRUE(expired.has_value());
+    EXPECT_EQ(expired->id, first);
+    EXPECT_FALSE(expired->byAddress);
+    EXPECT_EQ(tracker.GetStatistics().addressesExpired, 1);
+
+    // The fingerprint points to the last device which got it, unless another one is preferred
+    //
+    const auto second = tracker.Record(makeAdv(kAddress + 1, 7), start);
+    EXPECT_EQ(tracker.Lookup(makeAdv(kRotatedAddress, 7), start)->id, second);
+    EXPECT_EQ(tracker.Lookup(makeAdv(kRotatedAddress, 7), start, first)->id, first);
+}
@@ -0,0 +1,111 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "Tests.h"
+#include "Core/IdentityScorer.h"
+#include "Core/StateManager.h"
+
+using Core::AirPods::Details::Advertisement;
+using Core::AirPods::Details::IdentityScorer;
+
+namespace {
+
+struct Case {
+    std::string_view name;
+    Tests::AirPodsPacket last, curr;
+    float expected;
+    bool concurrent{false};
+};
+
+float Score(const Case &c)
+{
+    const Advertisement last{Tests::MakeAirPodsPacket(c.last)};
+    const Advertisement curr{Tests::MakeAirPodsPacket(c.curr)};
+    return IdentityScorer{}.Score(curr, {.sameSide = &last}, c.concurrent);
+}
+} // namespace
+
+TEST(IdentityScorer, Score)
+{
+    const IdentityScorer::Parameters p;
+
+    // Every field of two identical packets is a match
+    //
+    const auto same = p.colorMatch + 3 * p.batterySame + 3 * p.chargingMatch + p.lidCountMatch +
+                      p.rssiCloseScore;
+
+    const auto battery = [&](float score) { return same - p.batterySame + score; };
+    const auto rssi = [&](float score) { return same - p.rssiCloseScore + score; };
+    const auto lidMismatch = same - p.lidCountMatch + p.lidCountMismatch;
+
+    const Case cases[]{
+        {"Same", {}, {}, same},
+        {"Concurrent", {}, {}, same + p.concurrent, true},
+
+        // Nothing else is compared
+        //
+        {"ModelMismatch", {}, {.modelId = 0x2014}, p.modelMismatch},
+        {"ModelMismatchConcurrent", {}, {.modelId = 0x2014}, p.modelMismatch + p.concurrent, true},
+
+        {"BatteryStep", {.leftBattery = 9}, {.leftBattery = 8}, battery(p.batteryStep)},
+        {"BatteryStepUp", {.caseBattery = 4}, {.caseBattery = 5}, battery(p.batteryStep)},
+        {"BatteryJump", {.rightBattery = 9}, {.rightBattery = 6}, battery(p.batteryJump)},
+        {"BatteryUnavailable", {}, {.leftBattery = 15}, battery(0.f)},
+
+        // The 3-bit counter counts up by one, wrapping around
+        //
+        {"LidCountUp", {.lidSwitchCount = 3}, {.lidSwitchCount = 4}, same},
+        {"LidCountWrap", {.lidSwitchCount = 7}, {.lidSwitchCount = 0}, same},
+        {"LidCountSkip", {.lidSwitchCount = 6}, {.lidSwitchCount = 0}, lidMismatch},
+        {"LidCountBack", {.lidSwitchCount = 0}, {.lidSwitchCount = 7}, lidMismatch},
+
+        {"RssiBetween", {}, {.rssi = -70}, rssi(0.f)},
+        {"RssiFar", {}, {.rssi = -90}, rssi(p.rssiFarScore)},
+        {"RssiImpossible", {}, {.rssi = -110}, rssi(p.rssiImpossibleScore)},
+    };
+
+    for (const auto &c : cases) {
+        EXPECT_FLOAT_EQ(Score(c), c.expected) << c.name;
+    }
+}
+
+TEST(IdentityScorer, Reference)
+{
+    const IdentityScorer scorer;
+    const auto &p = scorer.GetParameters();
+
+    const Advertisement adv{Tests::MakeAirPodsPacket({})};
+    const Advertisement far{Tests::MakeAirPodsPacket({.rssi = -90})};
+
+    EXPECT_FLOAT_EQ(scorer.Score(adv, {}, false), 0.f);
+    EXPECT_FLOAT_EQ(scorer.Score(adv, {}, true), p.concurrent);
+
+    // The other side is compared if the same side is missing, and the smoothed RSSI is preferred
+    //
+    EXPECT_FLOAT_EQ(
+        scorer.Score(adv, {.anotherSide = &far}, false),
+        scorer.Score(far, {.anotherSide = &adv}, false));
+    EXPECT_FLOAT_EQ(
+        scorer.Score(adv, {.sameSide = &far, .rssi = -50.f}, false),
+        scorer.Score(adv, {.sameSide = &adv}, false));
+}
@@ -0,0 +1,86 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <gtest/gtest.h>
+
+#include "Core/Metrics.h"
+
+using namespace Core;
+
+// The registry is process-wide, so only the differences between two snapshots are checked
+
+TEST(Metrics, Counters)
+{
+    const auto before = Metrics::TakeSnapshot();
+    Metrics::Increment(Metrics::Counter::MediaFailed);
+    Metrics::Increment(Metrics::Counter::MediaFailed, 41);
+    const auto after = Metrics::TakeSnapshot();
+
+    EXPECT_EQ(
+        after.Get(Metrics::Counter::MediaFailed) - before.Get(Metrics::Counter::MediaFailed), 42);
+}
+
+TEST(Metrics, Histograms)
+{
+    // `gui.update_time` is only recorded by the application
+    //
+    constexpr auto kHistogram = Metrics::Histogram::GuiUpdateTime;
+    ASSERT_EQ(Metrics::TakeSnapshot().Get(kHistogram).count, 0);
+
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        Metrics::Record(kHistogram, value);
+    }
+    Metrics::Record(kHistogram, std::chrono::microseconds{50});
+
+    const auto snapshot = Metrics::TakeSnapshot();
+    const auto &histogram = snapshot.Get(kHistogram);
+    EXPECT_EQ(histogram.count, 1001);
+    EXPECT_EQ(histogram.sum, 500'500 + 50'000);
+    EXPECT_EQ(histogram.max, 50'000);
+    EXPECT_DOUBLE_EQ(histogram.Mean(), 550'500.0 / 1001);
+
+    // Within the error of the buckets, at most 12.5% above
+    //
+    EXPECT_GE(histogram.Percentile(50), 500);
+    EXPECT_LE(histogram.Percentile(50), 500 * 9 / 8);
+    EXPECT_GE(histogram.Percentile(99), 990);
+    EXPECT_LE(histogram.Percentile(99), 990 * 9 / 8);
+    EXPECT_EQ(histogram.Percentile(100), 50'000);
+
+    const auto rendered = Metrics::Render(snapshot);
+    EXPECT_NE(rendered.find("gui.update_time: count 1001, mean 549ns"), std::string::npos)
+        << rendered;
+    EXPECT_NE(rendered.find("max 50us"), std::string::npos) << rendered;
+}
+
+TEST(Metrics, SampledTimer)
+{
+    // `media.play_time` is only recorded by the application
+    //
+    constexpr auto kHistogram = Metrics::Histogram::MediaPlayTime;
+    ASSERT_EQ(Metrics::TakeSnapshot().Get(kHistogram).count, 0);
+
+    size_t sampling = 0;
+    for (size_t i = 0; i < Metrics::kSampleInterval * 10; ++i) {
+        Metrics::SampledTimer timer{kHistogram};
+        sampling += timer.IsSampling();
+    }
+
+    EXPECT_EQ(sampling, 10);
+    EXPECT_EQ(Metrics::TakeSnapshot().Get(kHistogram).count, 10);
+}
@@ -0,0 +1,149 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+
+#include <cmath>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "Core/RssiFilter.h"
+
+using Core::AirPods::Proximity;
+using Core::AirPods::Details::RssiFilter;
+
+namespace {
+
+constexpr int16_t kSteady = -60;
+
+// Converged on `kSteady`
+//
+RssiFilter MakeSteady()
+{
+    RssiFilter filter;
+    for (size_t i = 0; i < 100; ++i) {
+        filter.Update(kSteady);
+    }
+    return filter;
+}
+} // namespace
+
+TEST(RssiFilter, FirstSample)
+{
+    RssiFilter filter;
+    EXPECT_FALSE(filter.Available());
+    EXPECT_EQ(filter.GetProximity(), Proximity::Unknown);
+
+    EXPECT_TRUE(filter.Update(-90));
+    EXPECT_TRUE(filter.Available());
+    EXPECT_FLOAT_EQ(filter.Estimate(), -90.f);
+
+    filter.Reset();
+    EXPECT_FALSE(filter.Available());
+
+    // However far it is from the estimate before the reset
+    //
+    EXPECT_TRUE(filter.Update(-30));
+    EXPECT_FLOAT_EQ(filter.Estimate(), -30.f);
+}
+
+TEST(RssiFilter, Outliers)
+{
+    struct Case {
+        std::string_view name;
+        int16_t rssi;
+        bool accepted;
+    };
+
+    // The gate of the converged filter is about 14 dB wide
+    //
+    const Case cases[]{
+        {"Same", kSteady, true},
+        {"Noise", kSteady - 5, true},
+        {"NoiseUp", kSteady + 10, true},
+        {"Wall", kSteady - 20, false},
+        {"Reflection", kSteady + 20, false},
+        {"Lost", kSteady - 40, false},
+    };
+
+    for (const auto &c : cases) {
+        auto filter = MakeSteady();
+        const auto estimate = filter.Estimate();
+
+        EXPECT_EQ(filter.Update(c.rssi), c.accepted) << c.name;
+        if (!c.accepted) {
+            EXPECT_FLOAT_EQ(filter.Estimate(), estimate) << c.name;
+
+            // A single outlier does not make the next packet an outlier
+            //
+            EXPECT_TRUE(filter.Update(kSteady)) << c.name;
+        }
+    }
+}
+
+TEST(RssiFilter, FollowsSteps)
+{
+    struct Case {
+        std::string_view name;
+        int16_t rssi;
+        size_t maxPackets; // To come within 3 dB
+    };
+
+    // A step outside of the gate is rejected until the gate has widened by `kProcessNoise` per
+    // packet enough to take it, so the further the step, the longer it takes
+    //
+    const Case cases[]{
+        {"Small", kSteady - 10, 5},
+        {"Wall", kSteady - 20, 16},
+        {"Closer", kSteady + 20, 16},
+        {"Far", kSteady - 40, 85},
+    };
+
+    for (const auto &c : cases) {
+        auto filter = MakeSteady();
+
+        size_t packets = 0;
+        while (std::abs(filter.Estimate() - c.rssi) > 3.f) {
+            ASSERT_LT(packets++, c.maxPackets) << c.name;
+            filter.Update(c.rssi);
+        }
+    }
+}
+
+TEST(RssiFilter, Proximity)
+{
+    struct Case {
+        int16_t rssi;
+        Proximity proximity;
+    };
+
+    const Case cases[]{
+        {-40, Proximity::Immediate},
+        {-55, Proximity::Immediate},
+        {-56, Proximity::Near},
+        {-70, Proximity::Near},
+        {-71, Proximity::Far},
+        {-100, Proximity::Far},
+    };
+
+    for (const auto &c : cases) {
+        RssiFilter filter;
+        filter.Update(c.rssi);
+        EXPECT_EQ(filter.GetProximity(), c.proximity) << c.rssi;
+    }
+}
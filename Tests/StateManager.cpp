@@ -0,0 +1,192 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <array>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Tests.h"
+#include "Core/StateManager.h"
+
+using Core::AirPods::PackedState;
+using Core::AirPods::Details::Advertisement;
+using Core::AirPods::Details::StateManager;
+
+namespace {
+
+// Each pod reports its own battery fresher than the other one's, so the sides disagree and the
+// state depends on which of them advertised last
+//
+constexpr std::array kPackets{
+    Tests::AirPodsPacket{.leftBattery = 8, .rightBattery = 6, .caseBattery = 5},
+    Tests::AirPodsPacket{.leftBattery = 8, .rightBattery = 6, .caseBattery = 4},
+    Tests::AirPodsPacket{
+        .broadcastFromLeft = false,
+        .leftBattery = 7,
+        .rightBattery = 5,
+        .caseBattery = 5,
+        .address = 0xA1B2C3D4E501},
+    Tests::AirPodsPacket{
+        .broadcastFromLeft = false,
+        .leftBattery = 7,
+        .rightBattery = 6,
+        .caseBattery = 5,
+        .address = 0xA1B2C3D4E501},
+};
+
+struct Step {
+    size_t packetIndex;
+    bool batchEnd;
+};
+
+// The state after each batch. All the packets of a batch are received at the same time, one by
+// one if not `batched`.
+//
+std::vector<std::optional<PackedState>>
+Replay(const std::vector<Step> &steps, bool batched, bool duplicates)
+{
+    Helper::Scheduler scheduler{Helper::Scheduler::TimePoint{}};
+    StateManager stateMgr{scheduler};
+    stateMgr.OnRssiMinChanged(std::numeric_limits<int16_t>::min());
+
+    std::vector<std::optional<PackedState>> result;
+    std::vector<Advertisement> batch;
+    uint8_t serial = 0;
+
+    for (const auto &step : steps) {
+        auto packet = kPackets[step.packetIndex];
+        if (!duplicates) {
+            packet.serial = ++serial;
+        }
+        Advertisement adv{Tests::MakeAirPodsPacket(packet)};
+
+        if (batched) {
+            batch.push_back(std::move(adv));
+        }
+        else {
+            stateMgr.OnAdvReceived(std::move(adv));
+        }
+
+        if (step.batchEnd) {
+            if (batched) {
+                stateMgr.OnAdvBatch(batch);
+                batch.clear();
+            }
+            result.push_back(stateMgr.GetCurrentState());
+            scheduler.AdvanceBy(std::chrono::milliseconds{100});
+        }
+    }
+
+    EXPECT_EQ(stateMgr.GetStatistics().duplicates != 0, duplicates);
+    return result;
+}
+} // namespace
+
+// Duplicates skip rebuilding the state, which must not make any difference, whether the packets
+// are received in batches or one by one
+//
+TEST(StateManager, DuplicatesKeepTheState)
+{
+    std::mt19937 random{0x44555053};
+    std::uniform_int_distribution<size_t> packetDist{0, kPackets.size() - 1};
+    std::uniform_int_distribution<int> batchEndDist{0, 2};
+
+    std::vector<Step> steps(2000);
+    for (auto &step : steps) {
+        step = Step{.packetIndex = packetDist(random), .batchEnd = batchEndDist(random) == 0};
+    }
+    steps.back().batchEnd = true;
+
+    const auto expected = Replay(steps, false, false);
+    ASSERT_FALSE(expected.empty());
+
+    for (const bool batched : {false, true}) {
+        for (const bool duplicates : {false, true}) {
+            const auto actual = Replay(steps, batched, duplicates);
+            ASSERT_EQ(actual.size(), expected.size());
+
+            const auto [expectedIt, actualIt] = std::ranges::mismatch(expected, actual);
+            EXPECT_EQ(actualIt, actual.end())
+                << "batched: " << batched << ", duplicates: " << duplicates
+                << ", first differing batch: " << std::distance(actual.begin(), actualIt);
+        }
+    }
+}
+
+TEST(StateManager, ExpiresOnTheSchedulerTime)
+{
+    using namespace std::chrono_literals;
+
+    const Helper::Scheduler::TimePoint start{};
+    Helper::Scheduler scheduler{start};
+    StateManager stateMgr{scheduler};
+    stateMgr.OnRssiMinChanged(std::numeric_limits<int16_t>::min());
+
+    std::vector<Helper::Scheduler::TimePoint> disconnected;
+    stateMgr.CbDisconnected() += [&] { disconnected.push_back(scheduler.Now()); };
+
+    size_t stateChanges = 0;
+    stateMgr.CbStateChanged() += [&](const auto &) { ++stateChanges; };
+
+    ASSERT_TRUE(stateMgr.OnAdvReceived(Advertisement{Tests::MakeAirPodsPacket(kPackets[0])}));
+
+    // The first packets of the other side, from another address, are only accepted once they
+    // have scored enough
+    //
+    scheduler.AdvanceTo(start + 5s);
+    auto right = kPackets[2];
+    size_t tries = 0;
+    while (!stateMgr.OnAdvReceived(Advertisement{Tests::MakeAirPodsPacket(right)})) {
+        ASSERT_LT(++tries, 10);
+        ++right.serial;
+    }
+
+    const auto changes = stateChanges;
+    ASSERT_TRUE(stateMgr.GetCurrentState().has_value());
+
+    scheduler.AdvanceTo(start + 10s - 1ms);
+    EXPECT_TRUE(stateMgr.GetSignal().left.has_value());
+
+    // Only the left side has expired, the device is still available
+    //
+    scheduler.AdvanceTo(start + 10s);
+    EXPECT_FALSE(stateMgr.GetSignal().left.has_value());
+    EXPECT_TRUE(stateMgr.GetSignal().right.has_value());
+    EXPECT_TRUE(stateMgr.GetCurrentState().has_value());
+    EXPECT_TRUE(disconnected.empty());
+
+    scheduler.AdvanceTo(start + 15s - 1ms);
+    EXPECT_TRUE(stateMgr.GetSignal().right.has_value());
+    EXPECT_TRUE(disconnected.empty());
+
+    // Then the right side, so the device is lost
+    //
+    scheduler.AdvanceTo(start + 15s);
+    EXPECT_FALSE(stateMgr.GetSignal().right.has_value());
+    EXPECT_FALSE(stateMgr.GetCurrentState().has_value());
+    ASSERT_EQ(disconnected.size(), 1);
+    EXPECT_EQ(disconnected.front(), start + 15s);
+
+    // Nothing is left to expire
+    //
+    scheduler.AdvanceBy(1h);
+    EXPECT_EQ(disconnected.size(), 1);
+    EXPECT_EQ(stateChanges, changes);
+}
@@ -0,0 +1,73 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Core/AppleCP.h"
+#include "Core/Bluetooth_abstract.h"
+
+namespace Tests {
+
+struct AirPodsPacket {
+    bool broadcastFromLeft{true};
+    uint8_t leftBattery{10}, rightBattery{10}, caseBattery{10};
+    uint64_t address{0xA1B2C3D4E500};
+
+    // The last byte of the encrypted payload, which is not decrypted without a key. Changing it
+    // only makes the packet differ from the others.
+    //
+    uint8_t serial{0};
+
+    uint16_t modelId{0x200E}; // AirPods Pro
+    uint8_t lidSwitchCount{0};
+    int16_t rssi{-50};
+};
+
+// A pair of AirPods in ear, AirPods Pro unless `modelId` says otherwise, see
+// `AppleCP::AirPods::Fields` for the layout
+//
+inline Core::Bluetooth::AdvertisementReceivedData MakeAirPodsPacket(const AirPodsPacket &packet)
+{
+    const auto currBattery = packet.broadcastFromLeft ? packet.leftBattery : packet.rightBattery;
+    const auto anotBattery = packet.broadcastFromLeft ? packet.rightBattery : packet.leftBattery;
+
+    std::array<uint8_t, Core::AppleCP::AirPods::kSize> payload{};
+    payload[0] = Helper::ToUnderlying(Core::AppleCP::PacketType::ProximityPairing);
+    payload[1] = Core::AppleCP::AirPods::kSize - sizeof(Core::AppleCP::Header);
+    payload[2] = 0x01;
+    payload[3] = static_cast<uint8_t>(packet.modelId);
+    payload[4] = static_cast<uint8_t>(packet.modelId >> 8);
+    payload[5] = 0b0000'1011 | (packet.broadcastFromLeft ? 0b0010'0000 : 0);
+    payload[6] = static_cast<uint8_t>(currBattery | anotBattery << 4);
+    payload[7] = packet.caseBattery;
+    payload[8] = 0b0000'1000 | (packet.lidSwitchCount & 0b111); // Lid closed
+    payload.back() = packet.serial;
+
+    Core::Bluetooth::AdvertisementReceivedData data;
+    data.rssi = packet.rssi;
+    data.address = packet.address;
+
+    auto manufacturerData = data.manufacturerData.emplace_back();
+    manufacturerData->companyId = Core::AppleCP::VendorId;
+    manufacturerData->data.assign(payload);
+    return data;
+}
+} // namespace Tests
@@ -0,0 +1,77 @@
+//
+// AirPodsDesktop - AirPods Desktop User Experience Enhancement Program.
+// Copyright (C) 2021-2022 SpriteOvO
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <cstdio>
+#include <chrono>
+#include <iostream>
+
+#include <spdlog/spdlog.h>
+
+#include "Core/Trace.h"
+
+namespace {
+
+// In UTC, the file does not record the time zone
+//
+void PrintTimestamp(std::chrono::system_clock::time_point timestamp)
+{
+    using namespace std::chrono;
+
+    const auto micros = time_point_cast<microseconds>(timestamp);
+    const auto days = floor<std::chrono::days>(micros);
+    const year_month_day date{days};
+    const hh_mm_ss time{micros - days};
+
+    std::printf(
+        "[%04d-%02u-%02u %02d:%02d:%02d.%06lld]", static_cast<int>(date.year()),
+        static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()),
+        static_cast<int>(time.hours().count()), static_cast<int>(time.minutes().count()),
+        static_cast<int>(time.seconds().count()),
+        static_cast<long long>(time.subseconds().count()));
+}
+} // namespace
+
+// Renders a binary trace file recorded with `--trace-file` to text, one event per line:
+//
+//   ApdTraceDecoder <trace file>
+//
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        std::cerr << "Usage: ApdTraceDecoder <trace file>" << std::endl;
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::warn);
+
+    const auto optEvents = Core::Trace::Decode(argv[1]);
+    if (!optEvents.has_value()) {
+        std::cerr << "Failed to decode trace file '" << argv[1] << "'." << std::endl;
+        return 1;
+    }
+
+    for (const auto &event : optEvents.value()) {
+        const auto &info = Core::Trace::kEvents[Helper::ToUnderlying(event.event)];
+
+        PrintTimestamp(event.timestamp);
+        std::printf(
+            " [thread %u] %s\n", event.thread,
+            Core::Trace::Render(event.event, std::span{event.args}.first(info.argCount)).c_str());
+    }
+    return 0;
+}